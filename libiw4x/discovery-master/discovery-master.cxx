@@ -0,0 +1,498 @@
+// Local master server stand-in for testing server discovery.
+//
+// usage: discovery-master [--listen <address>:<port>]
+//                         [--master <address>:<port>] [--timeout <sec>]
+//                         [--servers <n>] [--churn <n>] [--browse <sec>]
+//                         [--duration <sec>]
+//
+// With --listen, run a master on the specified endpoint: keep a registry of
+// the servers that send heartbeats and answer getserversDelta requests with
+// the changes since the requested version (see discovery-protocol.hxx).
+// Servers are dropped after --timeout seconds without a heartbeat (180 by
+// default, the same as a real master).
+//
+// With --servers, simulate that many game servers, each with its own socket
+// and discovery_service, heartbeating to the --master (by default, the one we
+// listen on or 127.0.0.1 on the default port). Every second --churn of them
+// (0 by default) change their map, which they announce with an immediate
+// heartbeat, and as many go offline or come back.
+//
+// With --browse, keep a server list the way the game does, refreshing it every
+// that many seconds, and print the size of each update next to what fetching
+// the full list would have taken.
+//
+// Any combination runs in a single process, so to test on one machine over
+// loopback:
+//
+// discovery-master --listen 127.0.0.1:20810 --servers 500 --churn 5 --browse 2
+//
+// Or run the three roles as separate processes against the same master. The
+// tool stops after --duration seconds or on interrupt.
+//
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <libiw4x/discovery/discovery-protocol.hxx>
+#include <libiw4x/discovery/discovery-service.hxx>
+#include <libiw4x/discovery/server-registry.hxx>
+
+using namespace std;
+using namespace std::chrono;
+
+using namespace iw4x;
+using namespace iw4x::discovery;
+
+namespace asio = boost::asio;
+using udp = asio::ip::udp;
+
+namespace
+{
+  int
+  usage ()
+  {
+    cerr << "usage: discovery-master [--listen <address>:<port>]" << endl
+         << "                        [--master <address>:<port>] "
+         << "[--timeout <sec>]" << endl
+         << "                        [--servers <n>] [--churn <n>] "
+         << "[--browse <sec>]" << endl
+         << "                        [--duration <sec>]" << endl;
+    return 1;
+  }
+
+  bool
+  parse_uint (const char* s, uint64_t& r)
+  {
+    char* e (nullptr);
+    errno = 0;
+    r = strtoull (s, &e, 10);
+    return errno == 0 && e != s && *e == '\0';
+  }
+
+  udp::endpoint
+  to_asio (const net::udp_endpoint& e)
+  {
+    asio::ip::address_v4::bytes_type b;
+    memcpy (b.data (), e.address, 4);
+
+    // The port is in network order.
+    //
+    return udp::endpoint (asio::ip::address_v4 (b),
+                          static_cast<uint16_t> ((e.port & 0xFF) << 8 |
+                                                 e.port >> 8));
+  }
+
+  net::udp_endpoint
+  from_asio (const udp::endpoint& e)
+  {
+    net::udp_endpoint r {};
+    asio::ip::address_v4::bytes_type b (e.address ().to_v4 ().to_bytes ());
+    memcpy (r.address, b.data (), 4);
+
+    uint16_t p (e.port ());
+    r.port = static_cast<uint16_t> ((p & 0xFF) << 8 | p >> 8);
+    return r;
+  }
+
+  // A socket that hands every datagram it receives to a handler.
+  //
+  class receiver
+  {
+  public:
+    using handler = move_only_function<void (const udp::endpoint&,
+                                             string_view)>;
+
+    receiver (udp::socket& s, handler h)
+      : socket_ (s), handler_ (move (h))
+    {
+      receive ();
+    }
+
+  private:
+    void
+    receive ()
+    {
+      socket_.async_receive_from (
+        asio::buffer (buffer_), from_,
+        [this] (const boost::system::error_code& ec, size_t n)
+      {
+        if (ec == asio::error::operation_aborted)
+          return;
+
+        if (!ec)
+          handler_ (from_, string_view (buffer_, n));
+
+        receive ();
+      });
+    }
+
+    udp::socket& socket_;
+    handler handler_;
+    udp::endpoint from_;
+    char buffer_[2048];
+  };
+
+  bool
+  send_to (udp::socket& s, const net::udp_endpoint& e, const char* d, size_t n)
+  {
+    boost::system::error_code ec;
+    s.send_to (asio::buffer (d, n), to_asio (e), 0, ec);
+    return !ec;
+  }
+
+  // Master.
+  //
+  struct master
+  {
+    udp::socket socket;
+    server_registry registry;
+
+    uint64_t requests = 0;
+    uint64_t failures = 0; // Requests whose reply would not fit.
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+
+    master (asio::io_context& io,
+            const udp::endpoint& e,
+            steady_clock::duration timeout)
+      : socket (io, e),
+        registry (static_cast<uint64_t> (
+                    system_clock::now ().time_since_epoch ().count ()),
+                  timeout)
+    {
+      // Every simulated server sends its first heartbeat at once.
+      //
+      socket.set_option (udp::socket::receive_buffer_size (4 * 1024 * 1024));
+    }
+
+    void
+    handle (const udp::endpoint& from, string_view p)
+    {
+      auto c (split_command (p));
+
+      if (!c)
+        return;
+
+      net::udp_endpoint f (from_asio (from));
+
+      if (c->first == heartbeat_command)
+      {
+        if (optional<string_view> i = parse_heartbeat (c->second))
+          registry.heartbeat (f, *i);
+      }
+      else if (c->first == getservers_command)
+      {
+        uint64_t e, v;
+
+        if (!parse_getservers (c->second, e, v))
+          return;
+
+        vector<server_change> cs;
+        uint64_t r (registry.changes (e, v, cs));
+
+        ++requests;
+
+        vector<string> ps (
+          format_servers_delta (registry.epoch (), r, registry.version (), cs));
+
+        if (ps.empty ())
+          ++failures;
+
+        for (const string& p : ps)
+        {
+          if (send_to (socket, f, p.data (), p.size ()))
+          {
+            ++packets;
+            bytes += p.size ();
+          }
+        }
+      }
+    }
+  };
+
+  // Simulated game server.
+  //
+  struct game_server
+  {
+    udp::socket socket;
+    discovery_service service;
+    string hostname;
+    bool online = true;
+
+    game_server (asio::io_context& io, const net::udp_endpoint& m, size_t i)
+      : socket (io, udp::endpoint (asio::ip::address_v4::loopback (), 0)),
+        service (m,
+                 [this] (const net::udp_endpoint& e, const char* d, size_t n)
+                 {
+                   return send_to (socket, e, d, n);
+                 }),
+        hostname ("test server " + to_string (i))
+    {
+      set_map ("mp_rust");
+      service.enable_heartbeats (true);
+    }
+
+    void
+    set_map (const string& m)
+    {
+      service.set_info ("\\hostname\\" + hostname + "\\mapname\\" + m +
+                        "\\gametype\\war\\sv_maxclients\\18");
+    }
+  };
+
+  // Size of the serversDelta record of a server, that is, what it costs to
+  // send it as part of the full list.
+  //
+  size_t
+  record_size (const net::udp_endpoint& e, const string& info)
+  {
+    return format_endpoint (e).size () + info.size () + 2;
+  }
+}
+
+int
+main (int argc, char* argv[])
+{
+  optional<net::udp_endpoint> listen;
+  optional<net::udp_endpoint> master_ep;
+  uint64_t timeout (duration_cast<seconds> (server_timeout).count ());
+  uint64_t servers (0);
+  uint64_t churn (0);
+  uint64_t browse (0);
+  uint64_t duration (0);
+
+  for (int i (1); i != argc; ++i)
+  {
+    const char* a (argv[i]);
+
+    if (strcmp (a, "--listen") == 0 && i + 1 != argc)
+    {
+      if (!(listen = parse_endpoint (argv[++i])))
+        return usage ();
+    }
+    else if (strcmp (a, "--master") == 0 && i + 1 != argc)
+    {
+      if (!(master_ep = parse_endpoint (argv[++i])))
+        return usage ();
+    }
+    else if (strcmp (a, "--timeout") == 0 && i + 1 != argc)
+    {
+      if (!parse_uint (argv[++i], timeout) || timeout == 0)
+        return usage ();
+    }
+    else if (strcmp (a, "--servers") == 0 && i + 1 != argc)
+    {
+      if (!parse_uint (argv[++i], servers))
+        return usage ();
+    }
+    else if (strcmp (a, "--churn") == 0 && i + 1 != argc)
+    {
+      if (!parse_uint (argv[++i], churn))
+        return usage ();
+    }
+    else if (strcmp (a, "--browse") == 0 && i + 1 != argc)
+    {
+      if (!parse_uint (argv[++i], browse) || browse == 0)
+        return usage ();
+    }
+    else if (strcmp (a, "--duration") == 0 && i + 1 != argc)
+    {
+      if (!parse_uint (argv[++i], duration))
+        return usage ();
+    }
+    else
+      return usage ();
+  }
+
+  if (!listen && servers == 0 && browse == 0)
+    return usage ();
+
+  if (!master_ep)
+  {
+    if (listen)
+      master_ep = listen;
+    else
+      master_ep = parse_endpoint (
+        "127.0.0.1:" + to_string (default_master_port));
+  }
+
+  asio::io_context io;
+
+  try
+  {
+    // Master.
+    //
+    unique_ptr<master> m;
+    unique_ptr<receiver> mr;
+
+    if (listen)
+    {
+      m = make_unique<master> (io, to_asio (*listen), seconds (timeout));
+      mr = make_unique<receiver> (
+        m->socket,
+        [&m] (const udp::endpoint& f, string_view p) {m->handle (f, p);});
+
+      cout << "master listening on " << format_endpoint (*listen)
+           << ", epoch " << m->registry.epoch () << endl;
+    }
+
+    // Servers.
+    //
+    vector<unique_ptr<game_server>> ss;
+
+    for (uint64_t i (0); i != servers; ++i)
+      ss.push_back (make_unique<game_server> (io, *master_ep, i));
+
+    // Browser.
+    //
+    unique_ptr<udp::socket> bs;
+    unique_ptr<discovery_service> b;
+    unique_ptr<receiver> br;
+    uint64_t received (0);
+
+    if (browse != 0)
+    {
+      bs = make_unique<udp::socket> (
+        io, udp::endpoint (asio::ip::address_v4::loopback (), 0));
+
+      b = make_unique<discovery_service> (
+        *master_ep,
+        [&bs] (const net::udp_endpoint& e, const char* d, size_t n)
+      {
+        return send_to (*bs, e, d, n);
+      });
+
+      br = make_unique<receiver> (
+        *bs,
+        [&b, &received] (const udp::endpoint& f, string_view p)
+      {
+        auto c (split_command (p));
+
+        if (!c || c->first != servers_command)
+          return;
+
+        received += p.size ();
+
+        if (!b->handle (from_asio (f), c->second))
+          return;
+
+        const server_list& l (b->servers ());
+
+        size_t full (0);
+        for (const auto& [k, s] : l.servers ())
+          full += record_size (s.endpoint, s.info);
+
+        cout << "list version " << l.version () << ": " << l.size ()
+             << " servers, " << l.last_changes ().size () << " changes in "
+             << received << " bytes (full list " << full << " bytes)"
+             << endl;
+
+        received = 0;
+      });
+    }
+
+    // Drive everything off a single 100ms timer, which is about as often as
+    // the game would tick the services given that nothing here is time
+    // critical.
+    //
+    steady_clock::time_point start (steady_clock::now ());
+    steady_clock::time_point next_second (start);
+    steady_clock::time_point next_browse (start);
+
+    mt19937 rng (random_device {} ());
+    const char* maps[] = {"mp_rust", "mp_terminal", "mp_highrise",
+                          "mp_afghan", "mp_derail", "mp_estate"};
+
+    asio::steady_timer t (io);
+    move_only_function<void (const boost::system::error_code&)> tick;
+
+    tick = [&] (const boost::system::error_code& ec)
+    {
+      if (ec)
+        return;
+
+      steady_clock::time_point now (steady_clock::now ());
+
+      if (duration != 0 && now - start >= seconds (duration))
+      {
+        io.stop ();
+        return;
+      }
+
+      if (now >= next_second)
+      {
+        next_second += seconds (1);
+
+        if (m != nullptr)
+          m->registry.expire (now);
+
+        if (!ss.empty ())
+        {
+          uniform_int_distribution<size_t> pick (0, ss.size () - 1);
+          uniform_int_distribution<size_t> map (0, size (maps) - 1);
+
+          for (uint64_t i (0); i != churn; ++i)
+          {
+            ss[pick (rng)]->set_map (maps[map (rng)]);
+
+            game_server& s (*ss[pick (rng)]);
+            s.online = !s.online;
+            s.service.enable_heartbeats (s.online);
+          }
+        }
+      }
+
+      for (unique_ptr<game_server>& s : ss)
+        s->service.tick (now);
+
+      if (b != nullptr && now >= next_browse)
+      {
+        next_browse += seconds (browse);
+        b->refresh ();
+      }
+
+      t.expires_after (milliseconds (100));
+      t.async_wait ([&tick] (const boost::system::error_code& ec)
+      {
+        tick (ec);
+      });
+    };
+
+    tick ({});
+
+    asio::signal_set sig (io, SIGINT, SIGTERM);
+    sig.async_wait ([&io] (const boost::system::error_code&, int)
+    {
+      io.stop ();
+    });
+
+    io.run ();
+
+    if (m != nullptr)
+      cout << "master: " << m->registry.size () << " servers at version "
+           << m->registry.version () << ", " << m->requests << " requests ("
+           << m->failures << " failed), " << m->packets << " packets, "
+           << m->bytes << " bytes" << endl;
+  }
+  catch (const boost::system::system_error& e)
+  {
+    cerr << "error: " << e.what () << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,224 @@
+// Replay a DemonWare task trace through the service handlers.
+//
+// usage: dw-replay [--iterations <n>] [--user <id>] <trace>
+//
+// Every request in the trace (see IW4X_DW_TRACE) is dispatched to the handler
+// registered for its service the same way remote_task_manager::start_task ()
+// does it, with deferred work run inline, and the reply is compared to the
+// recorded one. At the end we print the per-handler call counts and
+// throughput, which makes this a handy benchmark for the bit buffer and
+// storage paths.
+//
+// Note that the handlers see the current directory as the game directory. In
+// particular, storage reads and writes files relative to it, so you would
+// normally run this from a scratch copy of the directory the trace was
+// captured in. Use --user to set the auth ticket user ID to the one the trace
+// was captured with.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <libiw4x/demonware/core/containers/bit-buffer.hxx>
+#include <libiw4x/demonware/lobby/auth-ticket.hxx>
+#include <libiw4x/demonware/lobby/remote-task-manager/remote-task-manager.hxx>
+#include <libiw4x/demonware/lobby/remote-task-manager/task-trace.hxx>
+#include <libiw4x/demonware/lobby/storage/storage.hxx>
+
+using namespace std;
+using namespace std::chrono;
+
+using namespace iw4x::demonware;
+
+namespace
+{
+  struct handler_stats
+  {
+    uint64_t calls = 0;
+    uint64_t mismatches = 0;
+    uint64_t ns = 0;
+  };
+
+  int
+  usage ()
+  {
+    cerr << "usage: dw-replay [--iterations <n>] [--user <id>] <trace>"
+         << endl;
+    return 1;
+  }
+
+  bool
+  parse_uint (const char* s, uint64_t& r, int base = 10)
+  {
+    char* e (nullptr);
+    errno = 0;
+    r = strtoull (s, &e, base);
+    return errno == 0 && e != s && *e == '\0';
+  }
+}
+
+int
+main (int argc, char* argv[])
+{
+  uint64_t iterations (1);
+  uint64_t user_id (0);
+  bool user (false);
+  const char* file (nullptr);
+
+  for (int i (1); i != argc; ++i)
+  {
+    const char* a (argv[i]);
+
+    if (strcmp (a, "--iterations") == 0 && i + 1 != argc)
+    {
+      if (!parse_uint (argv[++i], iterations) || iterations == 0)
+        return usage ();
+    }
+    else if (strcmp (a, "--user") == 0 && i + 1 != argc)
+    {
+      // Accept the ID in hex if prefixed with 0x since that's how it appears
+      // in the storage paths.
+      //
+      if (!parse_uint (argv[++i], user_id, 0))
+        return usage ();
+
+      user = true;
+    }
+    else if (a[0] != '-' && file == nullptr)
+      file = a;
+    else
+      return usage ();
+  }
+
+  if (file == nullptr)
+    return usage ();
+
+  // Load the whole trace up front so that the file I/O does not skew the
+  // timings.
+  //
+  vector<task_record> rs;
+  {
+    task_trace_reader r;
+
+    if (!r.open (file))
+    {
+      cerr << "error: unable to open trace " << file << endl;
+      return 1;
+    }
+
+    for (task_record t; r.read (t); )
+      rs.push_back (move (t));
+
+    if (r.error ())
+    {
+      cerr << "error: trace " << file << " is corrupt after " << rs.size ()
+           << " records" << endl;
+      return 1;
+    }
+  }
+
+  if (user)
+    auth_ticket.user_id = user_id;
+
+  // Register the services. Only those that do not depend on the engine can
+  // be replayed; tasks for anything else get the generic reply, same as in
+  // the game.
+  //
+  storage ();
+
+  map<uint16_t, handler_stats> stats;
+  uint64_t mismatches (0);
+
+  bit_buffer_writer rep;
+  steady_clock::duration total (0);
+
+  for (uint64_t it (0); it != iterations; ++it)
+  {
+    for (size_t i (0); i != rs.size (); ++i)
+    {
+      const task_record& r (rs[i]);
+
+      bit_buffer_reader req (r.request.data (), r.request.size ());
+      req.set_position (r.type_checking ? 1 : 0);
+
+      rep.clear ();
+      deferred_reply_t d;
+
+      auto s (steady_clock::now ());
+
+      remote_task_manager::dispatch (r.service_id,
+                                     r.sub_function_id,
+                                     req,
+                                     rep,
+                                     d);
+      if (d)
+        d (rep);
+
+      auto e (steady_clock::now () - s);
+      total += e;
+
+      handler_stats& hs (stats[r.service_id << 8 | r.sub_function_id]);
+      ++hs.calls;
+      hs.ns += static_cast<uint64_t> (duration_cast<nanoseconds> (e).count ());
+
+      // Note that the trailing bits of the last byte are always zero on both
+      // sides so we can compare whole bytes.
+      //
+      bool match (rep.bit_size () == r.reply_bits &&
+                  equal (r.reply.begin (), r.reply.end (), rep.data ()));
+
+      if (!match)
+      {
+        ++hs.mismatches;
+        ++mismatches;
+
+        if (it == 0)
+          cerr << "record " << i << ": service "
+               << static_cast<int> (r.service_id) << " sub "
+               << static_cast<int> (r.sub_function_id)
+               << ": reply mismatch (" << rep.bit_size () << " bits, expected "
+               << r.reply_bits << ")" << endl;
+      }
+    }
+  }
+
+  cout << setw (8)  << "service"
+       << setw (6)  << "sub"
+       << setw (12) << "calls"
+       << setw (12) << "mismatches"
+       << setw (12) << "avg ns"
+       << setw (14) << "tasks/s" << endl;
+
+  for (const auto& [k, hs] : stats)
+  {
+    double avg (static_cast<double> (hs.ns) / static_cast<double> (hs.calls));
+
+    cout << setw (8)  << (k >> 8)
+         << setw (6)  << (k & 0xff)
+         << setw (12) << hs.calls
+         << setw (12) << hs.mismatches
+         << setw (12) << fixed << setprecision (0) << avg
+         << setw (14) << (avg > 0 ? 1e9 / avg : 0.0) << endl;
+  }
+
+  double secs (duration<double> (total).count ());
+  uint64_t n (rs.size () * iterations);
+
+  cout << n << " tasks in " << setprecision (3) << secs << "s";
+
+  if (secs > 0)
+    cout << " (" << setprecision (0) << n / secs << " tasks/s)";
+
+  cout << ", " << mismatches << " mismatches" << endl;
+
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+#include <libiw4x/demonware/core/containers/arena.hxx>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    namespace
+    {
+      // Size of the first heap block. Subsequent blocks double in size.
+      //
+      constexpr size_t min_block_size (1024);
+    }
+
+    arena::
+    arena (span<uint8_t> initial)
+    {
+      if (!initial.empty ())
+        blocks_.push_back (block {initial.data (), initial.size ()});
+    }
+
+    uint8_t* arena::
+    allocate (size_t n)
+    {
+      // Skip over the blocks that are too small for this request. They will
+      // be reused after the next reset.
+      //
+      for (; current_ != blocks_.size (); ++current_, offset_ = 0)
+      {
+        block& b (blocks_[current_]);
+
+        if (b.size - offset_ >= n)
+        {
+          uint8_t* p (b.data + offset_);
+          offset_ += n;
+          used_ += n;
+          return p;
+        }
+      }
+
+      size_t s (blocks_.empty () ? min_block_size : blocks_.back ().size * 2);
+      s = max (s, n);
+
+      owned_.push_back (make_unique_for_overwrite<uint8_t[]> (s));
+      blocks_.push_back (block {owned_.back ().get (), s});
+
+      offset_ = n;
+      used_ += n;
+      return blocks_.back ().data;
+    }
+
+    void arena::
+    reset ()
+    {
+      current_ = 0;
+      offset_ = 0;
+      used_ = 0;
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    // Bump allocator for short-lived scratch data.
+    //
+    // Allocations are carved out of a list of blocks and are only released
+    // all at once, either by reset () or when the arena is destroyed. Note
+    // that previously returned pointers stay valid when the arena grows,
+    // which is what makes it suitable for backing views handed out one after
+    // another while parsing a message.
+    //
+    // The arena can be seeded with caller-provided storage (typically a stack
+    // buffer) which is used before anything is allocated on the heap.
+    //
+    class arena
+    {
+    public:
+      arena () = default;
+
+      explicit
+      arena (std::span<std::uint8_t> initial);
+
+      arena (const arena&) = delete;
+      arena& operator = (const arena&) = delete;
+
+      // Allocate n bytes. The memory is uninitialized and byte-aligned.
+      //
+      std::uint8_t*
+      allocate (std::size_t n);
+
+      // Release all allocations at once. Note that heap blocks are kept for
+      // reuse.
+      //
+      void
+      reset ();
+
+      // Total number of bytes handed out since the last reset.
+      //
+      std::size_t
+      used () const {return used_;}
+
+    private:
+      struct block
+      {
+        std::uint8_t* data;
+        std::size_t size;
+      };
+
+      std::vector<block> blocks_;
+      std::vector<std::unique_ptr<std::uint8_t[]>> owned_;
+
+      std::size_t current_ = 0; // Index of the block we allocate from.
+      std::size_t offset_ = 0;  // Offset into the current block.
+      std::size_t used_ = 0;
+    };
+  }
+}
@@ -0,0 +1,146 @@
+#include <libiw4x/demonware/core/containers/bit-buffer.hxx>
+
+#include <atomic>
+#include <cstring>
+
+#include <libiw4x/import.hxx>
+
+#include <libiw4x/demonware/core/containers/pool.hxx>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    namespace
+    {
+      // The engine's bdBitBuffer vtable.
+      //
+      void** const engine_vtable (reinterpret_cast<void**> (0x1403DA2D0));
+
+      // Our copy of it for pooled buffers. Slot 0 is the (scalar deleting)
+      // destructor, which is what the engine calls once the reference count
+      // drops to zero. We do not know how many slots there are past it, but
+      // copying a few extra pointers out of the executable's read-only data
+      // is harmless.
+      //
+      constexpr size_t vtable_slots (8);
+      void* pooled_vtable[vtable_slots];
+
+      // Note that at any given time most buffers are either referenced by a
+      // recent remote task or still waiting to be picked up by the engine, so
+      // this should comfortably exceed the remote task ring.
+      //
+      constexpr size_t buffer_slots (1024);
+
+      slab_pool<bd_bit_buffer, buffer_slots> buffer_pool;
+      bucket_pool data_pool;
+
+      void*
+      pooled_destructor (bd_bit_buffer* b, unsigned int flags)
+      {
+        data_pool.release (b->data);
+        b->data = nullptr;
+
+        // Bit 0 of the flags tells a deleting destructor call apart from a
+        // plain one.
+        //
+        if ((flags & 1) != 0)
+          buffer_pool.release (b);
+
+        return b;
+      }
+
+      void**
+      pooled_vtable_instance ()
+      {
+        static void** v ([]
+        {
+          for (size_t i (0); i != vtable_slots; ++i)
+            pooled_vtable[i] = engine_vtable[i];
+
+          pooled_vtable[0] = reinterpret_cast<void*> (&pooled_destructor);
+          return pooled_vtable;
+        } ());
+
+        return v;
+      }
+    }
+
+    bd_bit_buffer*
+    make_bit_buffer (const bit_buffer_writer& w)
+    {
+      auto s (w.size ());
+
+      // Note that we always allocate one extra byte for the trailing zero.
+      //
+      bd_bit_buffer* b (nullptr);
+      uint8_t* d (data_pool.allocate (s + 1));
+      void* vtable (engine_vtable);
+
+      if (d != nullptr)
+      {
+        b = buffer_pool.allocate ();
+
+        if (b != nullptr)
+          vtable = pooled_vtable_instance ();
+        else
+        {
+          data_pool.release (d);
+          d = nullptr;
+        }
+      }
+
+      if (b == nullptr)
+      {
+        b = static_cast<bd_bit_buffer*> (bdAlloc (sizeof (bd_bit_buffer)));
+        d = static_cast<uint8_t*> (bdAlloc (s + 1));
+      }
+
+      memcpy (d, w.data (), s);
+      d[s] = 0;
+
+      // Wire up the fake buffer. Note how we force the type checking flag
+      // to true and initially set the reference count to 1. This closely
+      // mimics a freshly constructed native object.
+      //
+      *b = bd_bit_buffer
+      {
+        .vtable             = vtable,
+        .refcount           = 1,
+        .pad0               = 0,
+        .data               = d,
+        .capacity           = static_cast<int32_t> (s),
+        .element_count      = static_cast<int32_t> (s),
+        .write_position     = static_cast<int32_t> (w.bit_size ()),
+        .max_write_position = static_cast<int32_t> (w.bit_size ()),
+        .read_position      = 0,
+        .flags              = 0,
+        .type_checking      = 1,
+        .pad1               = 0
+      };
+
+      return b;
+    }
+
+    void
+    release_bit_buffer (bd_bit_buffer* b)
+    {
+      if (b == nullptr)
+        return;
+
+      // The engine manipulates the count with interlocked operations, so
+      // we do the same.
+      //
+      if (atomic_ref<int32_t> (b->refcount).fetch_sub (1) != 1)
+        return;
+
+      // Go through the vtable rather than calling pooled_destructor ()
+      // directly since this may well be a buffer the engine has to free.
+      //
+      using destructor = void* (*) (bd_bit_buffer*, unsigned int);
+      reinterpret_cast<destructor> (static_cast<void**> (b->vtable)[0]) (b, 1);
+    }
+  }
+}
@@ -1,9 +1,10 @@
 #include <libiw4x/demonware/core/containers/bit-buffer.hxx>
 
+#include <bit>
 #include <cassert>
 #include <cstring>
 
-#include <libiw4x/import.hxx>
+#include <libiw4x/demonware/core/containers/bit-copy.hxx>
 
 using namespace std;
 
@@ -11,6 +12,23 @@ namespace iw4x
 {
   namespace demonware
   {
+    // Note that the word-at-a-time kernels below load and store 64-bit words
+    // straight out of the byte buffer, which only yields the LSB-first bit
+    // order of the wire format on a little-endian host.
+    //
+    static_assert (endian::native == endian::little);
+
+    namespace
+    {
+      // Mask for the n least-significant bits (1 <= n <= 64).
+      //
+      inline uint64_t
+      low_mask (unsigned int n)
+      {
+        return n < 64 ? (static_cast<uint64_t> (1) << n) - 1 : ~uint64_t (0);
+      }
+    }
+
     // bit_writer
     //
 
@@ -27,10 +45,24 @@ namespace iw4x
       return (bit_pos_ + 7) / 8;
     }
 
+    void bit_writer::
+    clear ()
+    {
+      // Writes OR bits into place, so everything we have touched must be
+      // zeroed again. Note that nothing past size () is ever made non-zero.
+      //
+      memset (buffer_.data (), 0, size ());
+      bit_pos_ = 0;
+    }
+
     void bit_writer::
     ensure_capacity (size_t additional_bits)
     {
-      size_t required_bytes ((bit_pos_ + additional_bits + 7) / 8);
+      // Besides the bytes we are about to touch, keep a word of zeroed slack
+      // past the end so that write_bits () can always do a full 64-bit
+      // load/store (plus the spill byte) without bounds checks.
+      //
+      size_t required_bytes ((bit_pos_ + additional_bits + 7) / 8 + 8);
 
       if (required_bytes > buffer_.size ())
         buffer_.resize (required_bytes + 64, 0);
@@ -59,15 +91,64 @@ namespace iw4x
 
       ensure_capacity (n);
 
-      for (unsigned int i (0); i < n; ++i)
-        write_bit ((value >> i) & 1);
+      // Merge the value into the word at the current byte. The bits past our
+      // position are guaranteed to be zero (the buffer is zero-filled and we
+      // only ever append), so a plain OR is all it takes.
+      //
+      // With a non-zero bit offset a 64-bit value can straddle into a ninth
+      // byte, in which case we spill the high bits there.
+      //
+      value &= low_mask (n);
+
+      uint8_t* p (buffer_.data () + bit_pos_ / 8);
+      unsigned int o (bit_pos_ % 8);
+
+      uint64_t w;
+      memcpy (&w, p, sizeof (w));
+      w |= value << o;
+      memcpy (p, &w, sizeof (w));
+
+      if (o + n > 64)
+        p[8] |= static_cast<uint8_t> (value >> (64 - o));
+
+      bit_pos_ += n;
     }
 
     void bit_writer::
     write_bytes (const uint8_t* data, size_t len)
     {
-      for (size_t i (0); i < len; ++i)
-        write_bits (data[i], 8);
+      if (len == 0)
+        return;
+
+      // Byte-aligned fast path: a straight copy.
+      //
+      if (bit_pos_ % 8 == 0)
+      {
+        ensure_capacity (len * 8);
+        memcpy (buffer_.data () + bit_pos_ / 8, data, len);
+        bit_pos_ += len * 8;
+        return;
+      }
+
+      // Otherwise the payload straddles byte boundaries. The first byte
+      // merges with the partial byte at our position, the following ones are
+      // a bulk shift of the source, and the high bits of the last source byte
+      // spill into a final byte. Note that everything past our position is
+      // zero so we can simply store rather than merge.
+      //
+      ensure_capacity (len * 8);
+
+      uint8_t* p (buffer_.data () + bit_pos_ / 8);
+      unsigned int o (bit_pos_ % 8);
+
+      p[0] |= static_cast<uint8_t> (data[0] << o);
+
+      if (len > 1)
+        shift_copy_bytes (p + 1, data, len - 1, 8 - o);
+
+      p[len] = static_cast<uint8_t> (data[len - 1] >> (8 - o));
+
+      bit_pos_ += len * 8;
     }
 
     // bit_reader
@@ -96,34 +177,122 @@ namespace iw4x
       if (bit_pos_ + n > size_ * 8)
         return false;
 
-      value = 0;
+      // Load the word at the current byte. Unlike the writer we do not own
+      // the buffer and so cannot assume any slack past its end: near the tail
+      // we assemble the word from whatever bytes remain.
+      //
+      size_t i (bit_pos_ / 8);
+      unsigned int o (bit_pos_ % 8);
+
+      uint64_t w (0);
+
+      if (i + 8 <= size_)
+        memcpy (&w, data_ + i, sizeof (w));
+      else
+        memcpy (&w, data_ + i, size_ - i);
+
+      w >>= o;
+
+      // The bounds check above guarantees the ninth byte exists whenever the
+      // value straddles into it.
+      //
+      if (o + n > 64)
+        w |= static_cast<uint64_t> (data_[i + 8]) << (64 - o);
+
+      value = w & low_mask (n);
+
+      bit_pos_ += n;
+      return true;
+    }
+
+    bool bit_reader::
+    read_bytes (uint8_t* out, size_t len)
+    {
+      if (bit_pos_ + len * 8 > size_ * 8)
+        return false;
 
-      for (unsigned int i (0); i < n; ++i)
+      // Byte-aligned fast path: a straight copy.
+      //
+      if (bit_pos_ % 8 == 0)
       {
-        bool b;
-        if (!read_bit (b))
-          return false;
+        if (len != 0)
+          memcpy (out, data_ + bit_pos_ / 8, len);
 
-        if (b)
-          value |= (static_cast<uint64_t> (1) << i);
+        bit_pos_ += len * 8;
+        return true;
       }
 
+      // Otherwise shift the payload out in bulk. The bounds check above
+      // guarantees the byte following the last one we produce is part of the
+      // stream.
+      //
+      if (len != 0)
+        shift_copy_bytes (out, data_ + bit_pos_ / 8, len, bit_pos_ % 8);
+
+      bit_pos_ += len * 8;
       return true;
     }
 
     bool bit_reader::
-    read_bytes (uint8_t* out, size_t len)
+    read_bytes_view (const uint8_t*& out, size_t len, arena& scratch)
     {
-      for (size_t i (0); i < len; ++i)
+      if (bit_pos_ + len * 8 > size_ * 8)
+        return false;
+
+      if (bit_pos_ % 8 == 0)
+      {
+        out = data_ + bit_pos_ / 8;
+        bit_pos_ += len * 8;
+        return true;
+      }
+
+      uint8_t* p (scratch.allocate (len));
+
+      if (len != 0)
+        shift_copy_bytes (p, data_ + bit_pos_ / 8, len, bit_pos_ % 8);
+
+      out = p;
+      bit_pos_ += len * 8;
+      return true;
+    }
+
+    bool bit_reader::
+    scan_byte (size_t& n, uint8_t value, size_t max) const
+    {
+      size_t i (bit_pos_ / 8);
+      unsigned int o (bit_pos_ % 8);
+
+      // Number of complete bytes left in the stream.
+      //
+      size_t m (bit_pos_ < size_ * 8 ? (size_ * 8 - bit_pos_) / 8 : 0);
+      m = m < max ? m : max;
+
+      if (o == 0)
       {
-        uint64_t v;
-        if (!read_bits (v, 8))
+        auto p (static_cast<const uint8_t*> (memchr (data_ + i, value, m)));
+
+        if (p == nullptr)
           return false;
 
-        out[i] = static_cast<uint8_t> (v);
+        n = static_cast<size_t> (p - (data_ + i));
+        return true;
       }
 
-      return true;
+      // Unaligned: reassemble each byte from its two halves. Note that for
+      // every complete byte the following source byte is part of the stream.
+      //
+      for (size_t j (0); j != m; ++j)
+      {
+        uint8_t b (static_cast<uint8_t> ((data_[i + j] >> o) |
+                                         (data_[i + j + 1] << (8 - o))));
+        if (b == value)
+        {
+          n = j;
+          return true;
+        }
+      }
+
+      return false;
     }
 
     // bit_buffer_writer
@@ -287,21 +456,17 @@ namespace iw4x
       if (!verify_tag (bit_type_tag::string))
         return false;
 
-      s.clear ();
-
-      for (size_t i (0); i <= max_len; ++i)
-      {
-        uint64_t c;
-        if (!reader_.read_bits (c, 8))
-          return false;
+      size_t n;
+      if (!reader_.scan_byte (n, 0, max_len + 1))
+        return false; // No null terminator within max_len characters.
 
-        if (c == 0)
-          return true;
+      s.resize (n);
 
-        s += static_cast<char> (c);
-      }
+      if (!reader_.read_bytes (reinterpret_cast<uint8_t*> (s.data ()), n))
+        return false;
 
-      return false; // no null terminator within max_len charactersb
+      reader_.set_position (reader_.position () + 8);
+      return true;
     }
 
     bool bit_buffer_reader::
@@ -318,39 +483,42 @@ namespace iw4x
       return reader_.read_bytes (out.data (), length);
     }
 
-    bd_bit_buffer*
-    make_bit_buffer (const bit_buffer_writer& w)
+    bool bit_buffer_reader::
+    read_string_view (string_view& s, size_t max_len, arena& scratch)
     {
-      void* vtable (reinterpret_cast<void*> (0x1403DA2D0));
+      if (!verify_tag (bit_type_tag::string))
+        return false;
 
-      auto b (static_cast<bd_bit_buffer*> (bdAlloc (sizeof (bd_bit_buffer))));
-      auto s (w.size ());
-      auto d (static_cast<uint8_t*> (bdAlloc (s + 1)));
+      size_t n;
+      if (!reader_.scan_byte (n, 0, max_len + 1))
+        return false;
 
-      memcpy (d, w.data (), s);
-      d[s] = 0;
+      const uint8_t* p;
+      if (!reader_.read_bytes_view (p, n, scratch))
+        return false;
 
-      // Wire up the fake buffer. Note how we force the type checking flag
-      // to true and initially set the reference count to 1. This closely
-      // mimics a freshly constructed native object.
-      //
-      *b = bd_bit_buffer
-      {
-        .vtable             = vtable,
-        .refcount           = 1,
-        .pad0               = 0,
-        .data               = d,
-        .capacity           = static_cast<int32_t> (s),
-        .element_count      = static_cast<int32_t> (s),
-        .write_position     = static_cast<int32_t> (w.bit_size ()),
-        .max_write_position = static_cast<int32_t> (w.bit_size ()),
-        .read_position      = 0,
-        .flags              = 0,
-        .type_checking      = 1,
-        .pad1               = 0
-      };
-
-      return b;
+      s = string_view (reinterpret_cast<const char*> (p), n);
+
+      reader_.set_position (reader_.position () + 8);
+      return true;
+    }
+
+    bool bit_buffer_reader::
+    read_blob_span (span<const uint8_t>& out, arena& scratch)
+    {
+      if (!verify_tag (bit_type_tag::blob))
+        return false;
+
+      uint32_t length;
+      if (!read_uint32 (length))
+        return false;
+
+      const uint8_t* p;
+      if (!reader_.read_bytes_view (p, length, scratch))
+        return false;
+
+      out = span<const uint8_t> (p, length);
+      return true;
     }
   }
 }
@@ -1,12 +1,16 @@
 #pragma once
 
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstddef>
 #include <cstdint>
 
 #include <libiw4x/export.hxx>
 
+#include <libiw4x/demonware/core/containers/arena.hxx>
+
 namespace iw4x
 {
   namespace demonware
@@ -87,6 +91,17 @@ namespace iw4x
       void
       write_bytes (const std::uint8_t*, std::size_t);
 
+      // Make sure the next n bits can be written without growing the
+      // buffer.
+      //
+      void
+      reserve (std::size_t n) {ensure_capacity (n);}
+
+      // Discard the written bits but keep the allocated buffer.
+      //
+      void
+      clear ();
+
       // Raw data access.
       //
       const std::uint8_t*
@@ -139,6 +154,23 @@ namespace iw4x
       bool
       read_bytes (std::uint8_t*, std::size_t);
 
+      // Read a sequence of complete bytes without copying them if possible.
+      //
+      // If the current position is byte-aligned, point out directly into the
+      // source buffer. Otherwise, the bytes have to be shifted into place and
+      // we copy them into memory allocated from the scratch arena. Returns
+      // false if there are not enough bits remaining.
+      //
+      bool
+      read_bytes_view (const std::uint8_t*& out, std::size_t, arena& scratch);
+
+      // Find the first complete byte equal to value starting from the current
+      // position, looking at no more than max bytes. On success, set n to the
+      // number of bytes preceding it. The position is left unchanged.
+      //
+      bool
+      scan_byte (std::size_t& n, std::uint8_t value, std::size_t max) const;
+
       // Current bit position.
       //
       std::size_t
@@ -200,6 +232,9 @@ namespace iw4x
         writer_.write_bytes (data, size);
       }
 
+      void
+      clear () {writer_.clear ();}
+
       // Access the underlying bit writer (e.g., for raw bit operations).
       //
       bit_writer&
@@ -267,6 +302,22 @@ namespace iw4x
       bool
       read_blob (std::vector<std::uint8_t>&);
 
+      // Non-copying variants of the above.
+      //
+      // The returned view refers to the source buffer if the field happens to
+      // start on a byte boundary and to memory allocated from the scratch
+      // arena otherwise. Either way it is only valid for as long as both of
+      // them are. Note that the string view does not include the null
+      // terminator.
+      //
+      bool
+      read_string_view (std::string_view&,
+                        std::size_t max_len,
+                        arena& scratch);
+
+      bool
+      read_blob_span (std::span<const std::uint8_t>&, arena& scratch);
+
       // Access the underlying bit reader.
       //
       bit_reader&
@@ -291,7 +342,21 @@ namespace iw4x
       bit_reader reader_;
     };
 
+    // Create an engine-compatible bdBitBuffer holding a copy of the writer's
+    // data, with the reference count set to 1.
+    //
+    // The object and its data array normally come from our own pools and go
+    // back there once the engine releases the last reference (we install a
+    // copy of the engine's vtable with the destructor slot pointing to us).
+    // If the pools cannot serve the request, we fall back to allocating both
+    // with bdAlloc () and leave the cleanup to the engine's own destructor.
+    //
     bd_bit_buffer*
     make_bit_buffer (const bit_buffer_writer&);
+
+    // Drop a reference to the buffer, destroying it if it was the last one.
+    //
+    void
+    release_bit_buffer (bd_bit_buffer*);
   }
 }
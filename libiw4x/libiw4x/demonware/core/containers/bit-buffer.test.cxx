@@ -0,0 +1,376 @@
+// Differential tests for bit_writer and bit_reader.
+//
+// The word-at-a-time implementation is checked against the original
+// bit-at-a-time one (reproduced below) which is slow but obviously correct.
+// We cover every bit offset with every width as well as reads that end
+// exactly at, or run past, the end of the buffer.
+//
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <libiw4x/demonware/core/containers/arena.hxx>
+#include <libiw4x/demonware/core/containers/bit-buffer.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace iw4x::demonware;
+
+namespace
+{
+  // The original implementation.
+  //
+  class reference_writer
+  {
+  public:
+    void
+    write_bit (bool b)
+    {
+      if (bit_pos_ / 8 == buffer_.size ())
+        buffer_.push_back (0);
+
+      if (b)
+        buffer_[bit_pos_ / 8] |= static_cast<uint8_t> (1u << (bit_pos_ % 8));
+
+      ++bit_pos_;
+    }
+
+    void
+    write_bits (uint64_t value, unsigned int n)
+    {
+      for (unsigned int i (0); i < n; ++i)
+        write_bit ((value >> i) & 1);
+    }
+
+    void
+    write_bytes (const uint8_t* data, size_t len)
+    {
+      for (size_t i (0); i < len; ++i)
+        write_bits (data[i], 8);
+    }
+
+    void
+    clear ()
+    {
+      buffer_.clear ();
+      bit_pos_ = 0;
+    }
+
+    const vector<uint8_t>&
+    bytes () const {return buffer_;}
+
+    size_t
+    bit_size () const {return bit_pos_;}
+
+  private:
+    vector<uint8_t> buffer_;
+    size_t bit_pos_ = 0;
+  };
+
+  class reference_reader
+  {
+  public:
+    reference_reader (const uint8_t* data, size_t size, size_t bit_pos)
+      : data_ (data), size_ (size), bit_pos_ (bit_pos) {}
+
+    bool
+    read_bit (bool& b)
+    {
+      if (bit_pos_ >= size_ * 8)
+        return false;
+
+      b = (data_[bit_pos_ / 8] >> (bit_pos_ % 8)) & 1;
+      ++bit_pos_;
+      return true;
+    }
+
+    bool
+    read_bits (uint64_t& value, unsigned int n)
+    {
+      if (bit_pos_ + n > size_ * 8)
+        return false;
+
+      value = 0;
+
+      for (unsigned int i (0); i < n; ++i)
+      {
+        bool b;
+        read_bit (b);
+
+        if (b)
+          value |= static_cast<uint64_t> (1) << i;
+      }
+
+      return true;
+    }
+
+    bool
+    read_bytes (uint8_t* out, size_t len)
+    {
+      if (bit_pos_ + len * 8 > size_ * 8)
+        return false;
+
+      for (size_t i (0); i < len; ++i)
+      {
+        uint64_t v;
+        read_bits (v, 8);
+        out[i] = static_cast<uint8_t> (v);
+      }
+
+      return true;
+    }
+
+    size_t
+    position () const {return bit_pos_;}
+
+  private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t bit_pos_;
+  };
+
+  void
+  check_equal (const bit_writer& w, const reference_writer& r)
+  {
+    assert (w.bit_size () == r.bit_size ());
+    assert (w.size () == r.bytes ().size ());
+    assert (w.size () == 0 ||
+            memcmp (w.data (), r.bytes ().data (), w.size ()) == 0);
+  }
+
+  // Write a value of every width at every bit offset within a word.
+  //
+  void
+  test_write_bits (mt19937_64& g)
+  {
+    for (unsigned int o (0); o != 64; ++o)
+    {
+      for (unsigned int n (1); n <= 64; ++n)
+      {
+        bit_writer w;
+        reference_writer r;
+
+        uint64_t p (g ());
+        uint64_t v (g ());
+
+        if (o != 0)
+        {
+          w.write_bits (p, o);
+          r.write_bits (p, o);
+        }
+
+        // High bits past the width must be ignored.
+        //
+        w.write_bits (v, n);
+        r.write_bits (v, n);
+
+        check_equal (w, r);
+      }
+    }
+  }
+
+  // Random mix of all the write operations, including payloads long enough
+  // to go through the vector kernels, and reuse after clear ().
+  //
+  void
+  test_write_mixed (mt19937_64& g)
+  {
+    bit_writer w;
+
+    for (size_t round (0); round != 200; ++round)
+    {
+      reference_writer r;
+
+      for (size_t op (0), ops (g () % 64); op != ops; ++op)
+      {
+        switch (g () % 3)
+        {
+        case 0:
+          {
+            bool b (g () & 1);
+            w.write_bit (b);
+            r.write_bit (b);
+            break;
+          }
+        case 1:
+          {
+            unsigned int n (static_cast<unsigned int> (g () % 64 + 1));
+            uint64_t v (g ());
+            w.write_bits (v, n);
+            r.write_bits (v, n);
+            break;
+          }
+        case 2:
+          {
+            vector<uint8_t> d (g () % 100);
+
+            for (uint8_t& b : d)
+              b = static_cast<uint8_t> (g ());
+
+            w.write_bytes (d.data (), d.size ());
+            r.write_bytes (d.data (), d.size ());
+            break;
+          }
+        }
+
+        check_equal (w, r);
+      }
+
+      w.clear ();
+      assert (w.bit_size () == 0);
+    }
+  }
+
+  // Read at every position of buffers of various sizes. The buffer is
+  // allocated at its exact size so that the sanitizers catch any read past
+  // the end.
+  //
+  void
+  test_read (mt19937_64& g)
+  {
+    for (size_t size (0); size <= 24; ++size)
+    {
+      unique_ptr<uint8_t[]> d (new uint8_t[size]);
+
+      for (size_t i (0); i != size; ++i)
+        d[i] = static_cast<uint8_t> (g ());
+
+      for (size_t pos (0); pos <= size * 8; ++pos)
+      {
+        for (unsigned int n (1); n <= 64; ++n)
+        {
+          bit_reader x (d.get (), size);
+          x.set_position (pos);
+          reference_reader y (d.get (), size, pos);
+
+          uint64_t a (~uint64_t (0)), b (~uint64_t (0));
+          bool ra (x.read_bits (a, n));
+          bool rb (y.read_bits (b, n));
+
+          assert (ra == rb);
+          assert (x.position () == y.position ());
+
+          if (ra)
+            assert (a == b);
+        }
+
+        {
+          bit_reader x (d.get (), size);
+          x.set_position (pos);
+          reference_reader y (d.get (), size, pos);
+
+          bool a, b;
+          bool ra (x.read_bit (a));
+          bool rb (y.read_bit (b));
+
+          assert (ra == rb && (!ra || a == b));
+        }
+
+        for (size_t len (0); len <= size + 1; ++len)
+        {
+          vector<uint8_t> a (len), b (len);
+
+          bit_reader x (d.get (), size);
+          x.set_position (pos);
+          reference_reader y (d.get (), size, pos);
+
+          bool ra (x.read_bytes (a.data (), len));
+          bool rb (y.read_bytes (b.data (), len));
+
+          assert (ra == rb);
+          assert (x.position () == y.position ());
+
+          if (ra)
+            assert (a == b);
+
+          // The non-copying variant must yield the same bytes.
+          //
+          arena s;
+          const uint8_t* v (nullptr);
+
+          bit_reader z (d.get (), size);
+          z.set_position (pos);
+
+          assert (z.read_bytes_view (v, len, s) == rb);
+
+          if (rb && len != 0)
+            assert (memcmp (v, b.data (), len) == 0);
+        }
+
+        // Scan for a byte that is present (the value of each complete byte
+        // in turn) and then one that may or may not be.
+        //
+        size_t m (size * 8 >= pos ? (size * 8 - pos) / 8 : 0);
+        vector<uint8_t> b (m);
+        reference_reader (d.get (), size, pos).read_bytes (b.data (), m);
+
+        for (size_t k (0); k <= m; ++k)
+        {
+          uint8_t v (k != m ? b[k] : static_cast<uint8_t> (g ()));
+
+          size_t e (0);
+          while (e != m && b[e] != v)
+            ++e;
+
+          bit_reader x (d.get (), size);
+          x.set_position (pos);
+
+          size_t n;
+          bool r (x.scan_byte (n, v, m));
+
+          assert (r == (e != m));
+          assert (!r || n == e);
+          assert (x.position () == pos);
+        }
+      }
+    }
+  }
+
+  // Write through the new writer and read back through the new reader at
+  // unaligned offsets.
+  //
+  void
+  test_round_trip (mt19937_64& g)
+  {
+    for (unsigned int o (0); o != 8; ++o)
+    {
+      for (size_t len (0); len != 80; ++len)
+      {
+        vector<uint8_t> d (len);
+
+        for (uint8_t& b : d)
+          b = static_cast<uint8_t> (g ());
+
+        bit_writer w;
+
+        if (o != 0)
+          w.write_bits (0, o);
+
+        w.write_bytes (d.data (), d.size ());
+
+        bit_reader r (w.data (), w.size ());
+        r.set_position (o);
+
+        vector<uint8_t> a (len);
+        assert (r.read_bytes (a.data (), len));
+        assert (a == d);
+      }
+    }
+  }
+}
+
+int
+main ()
+{
+  mt19937_64 g (0x1d7e5eed);
+
+  test_write_bits (g);
+  test_write_mixed (g);
+  test_read (g);
+  test_round_trip (g);
+}
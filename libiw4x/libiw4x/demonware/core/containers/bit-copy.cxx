@@ -0,0 +1,186 @@
+#include <libiw4x/demonware/core/containers/bit-copy.hxx>
+
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+using namespace std;
+
+// GCC and Clang refuse to inline AVX2 intrinsics into a function that is not
+// compiled for AVX2. Since we do not want to raise the baseline for the whole
+// library, we only enable it for the one kernel that needs it. MSVC has no
+// such restriction.
+//
+#if defined(__GNUC__) || defined(__clang__)
+#  define LIBIW4X_TARGET_AVX2 __attribute__ ((target ("avx2")))
+#else
+#  define LIBIW4X_TARGET_AVX2
+#endif
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    static_assert (endian::native == endian::little);
+
+    namespace
+    {
+      using kernel = size_t (*) (uint8_t* out,
+                                 const uint8_t* in,
+                                 size_t n,
+                                 unsigned int r);
+
+      // Each kernel processes as many leading bytes as it can in its native
+      // width and returns the number of bytes it produced. The remainder is
+      // left for the portable tail loop.
+      //
+
+      // 64-bit shift-merge.
+      //
+      // An output word is the input word shifted down by r with the low r
+      // bits of the following byte shifted into the top.
+      //
+      size_t
+      shift_copy_word (uint8_t* out,
+                       const uint8_t* in,
+                       size_t n,
+                       unsigned int r)
+      {
+        size_t j (0);
+
+        for (; j + 8 <= n; j += 8)
+        {
+          uint64_t w;
+          memcpy (&w, in + j, sizeof (w));
+
+          w = (w >> r) | (static_cast<uint64_t> (in[j + 8]) << (64 - r));
+          memcpy (out + j, &w, sizeof (w));
+        }
+
+        return j;
+      }
+
+      // SSE2 and AVX2 lack per-byte shifts, so we shift 16-bit lanes and mask
+      // off the bits that crossed over from the neighbouring byte. The high
+      // part comes from a second load one byte further along, which saves us
+      // from having to carry across lanes.
+      //
+      size_t
+      shift_copy_sse2 (uint8_t* out,
+                       const uint8_t* in,
+                       size_t n,
+                       unsigned int r)
+      {
+        const __m128i lm (_mm_set1_epi8 (static_cast<char> (0xFF >> r)));
+        const __m128i hm (_mm_set1_epi8 (static_cast<char> (0xFF << (8 - r))));
+        const __m128i rs (_mm_cvtsi32_si128 (static_cast<int> (r)));
+        const __m128i ls (_mm_cvtsi32_si128 (static_cast<int> (8 - r)));
+
+        size_t j (0);
+
+        for (; j + 16 <= n; j += 16)
+        {
+          __m128i lo (
+            _mm_loadu_si128 (reinterpret_cast<const __m128i*> (in + j)));
+          __m128i hi (
+            _mm_loadu_si128 (reinterpret_cast<const __m128i*> (in + j + 1)));
+
+          __m128i v (_mm_or_si128 (_mm_and_si128 (_mm_srl_epi16 (lo, rs), lm),
+                                   _mm_and_si128 (_mm_sll_epi16 (hi, ls), hm)));
+
+          _mm_storeu_si128 (reinterpret_cast<__m128i*> (out + j), v);
+        }
+
+        return j;
+      }
+
+      LIBIW4X_TARGET_AVX2 size_t
+      shift_copy_avx2 (uint8_t* out,
+                       const uint8_t* in,
+                       size_t n,
+                       unsigned int r)
+      {
+        const __m256i lm (_mm256_set1_epi8 (static_cast<char> (0xFF >> r)));
+        const __m256i hm (
+          _mm256_set1_epi8 (static_cast<char> (0xFF << (8 - r))));
+        const __m128i rs (_mm_cvtsi32_si128 (static_cast<int> (r)));
+        const __m128i ls (_mm_cvtsi32_si128 (static_cast<int> (8 - r)));
+
+        size_t j (0);
+
+        for (; j + 32 <= n; j += 32)
+        {
+          __m256i lo (
+            _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (in + j)));
+          __m256i hi (
+            _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (in + j + 1)));
+
+          __m256i v (
+            _mm256_or_si256 (_mm256_and_si256 (_mm256_srl_epi16 (lo, rs), lm),
+                             _mm256_and_si256 (_mm256_sll_epi16 (hi, ls), hm)));
+
+          _mm256_storeu_si256 (reinterpret_cast<__m256i*> (out + j), v);
+        }
+
+        // Let the SSE2 kernel have a go at what's left over.
+        //
+        return j + shift_copy_sse2 (out + j, in + j, n - j, r);
+      }
+
+      bool
+      have_avx2 ()
+      {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_cpu_init ();
+        return __builtin_cpu_supports ("avx2");
+#elif defined(_MSC_VER)
+        // Besides the CPUID feature bit we have to make sure the OS actually
+        // saves the YMM state across context switches (OSXSAVE + XCR0).
+        //
+        int r[4];
+
+        __cpuid (r, 1);
+        if ((r[2] & (1 << 27)) == 0)
+          return false;
+
+        if ((_xgetbv (0) & 0x6) != 0x6)
+          return false;
+
+        __cpuidex (r, 7, 0);
+        return (r[1] & (1 << 5)) != 0;
+#else
+        return false;
+#endif
+      }
+
+      kernel
+      select_kernel ()
+      {
+        return have_avx2 () ? &shift_copy_avx2 : &shift_copy_sse2;
+      }
+    }
+
+    void
+    shift_copy_bytes (uint8_t* out,
+                      const uint8_t* in,
+                      size_t n,
+                      unsigned int r)
+    {
+      assert (r >= 1 && r <= 7);
+
+      static const kernel k (select_kernel ());
+
+      size_t j (k (out, in, n, r));
+      j += shift_copy_word (out + j, in + j, n - j, r);
+
+      for (; j != n; ++j)
+        out[j] = static_cast<uint8_t> ((in[j] >> r) | (in[j + 1] << (8 - r)));
+    }
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    // Bulk bit-offset copy.
+    //
+    // Produce n output bytes where output byte j is made up of the 8 bits
+    // starting at bit r of input byte j (LSB-first), that is:
+    //
+    //   out[j] = (in[j] >> r) | (in[j + 1] << (8 - r))
+    //
+    // This is the core of copying a byte-aligned payload into (or out of) a
+    // bit stream positioned at a sub-byte offset, which is what happens to
+    // every blob after a 5-bit type tag. Note that n + 1 input bytes are read
+    // and that 1 <= r <= 7.
+    //
+    // The copy proceeds front to back so, like memmove () in that direction,
+    // out may be the same as in or start before it but must not overlap it
+    // from above.
+    //
+    // The implementation is picked once at runtime: AVX2 if the CPU and OS
+    // support it, SSE2 otherwise (always available on x86-64), with a 64-bit
+    // shift-merge loop for the tail.
+    //
+    void
+    shift_copy_bytes (std::uint8_t* out,
+                      const std::uint8_t* in,
+                      std::size_t n,
+                      unsigned int r);
+  }
+}
@@ -0,0 +1,138 @@
+// Differential tests for shift_copy_bytes ().
+//
+// The vector and word kernels are checked against a bit-at-a-time copy for
+// every shift, for lengths that end in each of the kernels' tails, at every
+// alignment of the source and destination, and in place.
+//
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <libiw4x/demonware/core/containers/bit-copy.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace iw4x::demonware;
+
+namespace
+{
+  // Output bit k is input bit k + r.
+  //
+  vector<uint8_t>
+  reference_copy (const uint8_t* in, size_t n, unsigned int r)
+  {
+    vector<uint8_t> out (n, 0);
+
+    for (size_t k (0); k != n * 8; ++k)
+    {
+      size_t s (k + r);
+
+      if ((in[s / 8] >> (s % 8)) & 1)
+        out[k / 8] |= static_cast<uint8_t> (1u << (k % 8));
+    }
+
+    return out;
+  }
+
+  // Separate source and destination. Both are allocated at their exact size
+  // (n + 1 bytes are read and n written) so that the sanitizers catch any
+  // access past either end.
+  //
+  void
+  test_disjoint (mt19937_64& g)
+  {
+    for (unsigned int r (1); r <= 7; ++r)
+    {
+      for (size_t n (0); n != 160; ++n)
+      {
+        for (size_t a (0); a != 8; ++a)
+        {
+          size_t o ((a + r) % 8);
+
+          unique_ptr<uint8_t[]> ib (new uint8_t[a + n + 1]);
+          unique_ptr<uint8_t[]> ob (new uint8_t[o + n]);
+
+          uint8_t* in (ib.get () + a);
+          uint8_t* out (ob.get () + o);
+
+          for (size_t i (0); i != n + 1; ++i)
+            in[i] = static_cast<uint8_t> (g ());
+
+          vector<uint8_t> e (reference_copy (in, n, r));
+
+          shift_copy_bytes (out, in, n, r);
+
+          assert (n == 0 || memcmp (out, e.data (), n) == 0);
+        }
+      }
+    }
+  }
+
+  // The destination may be the source itself or start before it (the copy
+  // proceeds front to back, like memmove () in that direction).
+  //
+  void
+  test_overlap (mt19937_64& g)
+  {
+    for (unsigned int r (1); r <= 7; ++r)
+    {
+      for (size_t n (0); n != 160; ++n)
+      {
+        for (size_t d (0); d != 40; ++d)
+        {
+          vector<uint8_t> b (d + n + 1);
+
+          for (uint8_t& c : b)
+            c = static_cast<uint8_t> (g ());
+
+          vector<uint8_t> e (reference_copy (b.data () + d, n, r));
+
+          // Everything past the destination must be left alone.
+          //
+          vector<uint8_t> t (b.begin () + n, b.end ());
+
+          shift_copy_bytes (b.data (), b.data () + d, n, r);
+
+          assert (n == 0 || memcmp (b.data (), e.data (), n) == 0);
+          assert (equal (t.begin (), t.end (), b.begin () + n));
+        }
+      }
+    }
+  }
+
+  // Large copies with the top and bottom bits set to catch masking errors
+  // between the lanes.
+  //
+  void
+  test_patterns ()
+  {
+    for (unsigned int r (1); r <= 7; ++r)
+    {
+      for (uint8_t p : {uint8_t (0x00), uint8_t (0xFF), uint8_t (0x80),
+                        uint8_t (0x01), uint8_t (0xA5)})
+      {
+        size_t n (1000);
+        vector<uint8_t> in (n + 1, p), out (n, 0x5A);
+
+        shift_copy_bytes (out.data (), in.data (), n, r);
+        assert (out == reference_copy (in.data (), n, r));
+      }
+    }
+  }
+}
+
+int
+main ()
+{
+  mt19937_64 g (0xb17c0b7);
+
+  test_disjoint (g);
+  test_overlap (g);
+  test_patterns ();
+}
@@ -11,22 +11,144 @@ namespace iw4x
     // byte_buffer_writer
     //
 
+    byte_buffer_writer::
+    byte_buffer_writer ()
+      : data_ (inline_),
+        capacity_ (inline_capacity),
+        storage_ (storage::inline_buffer)
+    {
+    }
+
+    byte_buffer_writer::
+    byte_buffer_writer (span<uint8_t> b)
+      : data_ (b.data ()),
+        capacity_ (b.size ()),
+        storage_ (storage::fixed)
+    {
+    }
+
+    byte_buffer_writer::
+    byte_buffer_writer (demonware::arena& a)
+      : data_ (nullptr),
+        capacity_ (0),
+        storage_ (storage::arena),
+        arena_ (&a)
+    {
+    }
+
+    bool byte_buffer_writer::
+    reserve (size_t n)
+    {
+      return n <= capacity_ || grow (n);
+    }
+
+    bool byte_buffer_writer::
+    ensure (size_t n)
+    {
+      if (overflow_)
+        return false;
+
+      return size_ + n <= capacity_ || grow (size_ + n);
+    }
+
+    bool byte_buffer_writer::
+    grow (size_t required)
+    {
+      // Grow geometrically so that a sequence of small appends stays
+      // amortized constant.
+      //
+      size_t c (capacity_ * 2 > required ? capacity_ * 2 : required);
+
+      switch (storage_)
+      {
+        case storage::fixed:
+        {
+          overflow_ = true;
+          return false;
+        }
+
+        case storage::inline_buffer:
+        {
+          heap_.resize (c);
+          memcpy (heap_.data (), data_, size_);
+          storage_ = storage::heap;
+          break;
+        }
+
+        case storage::heap:
+        {
+          heap_.resize (c);
+          break;
+        }
+
+        case storage::arena:
+        {
+          if (c < inline_capacity)
+            c = inline_capacity;
+
+          uint8_t* d (arena_->allocate (c));
+
+          if (size_ != 0)
+            memcpy (d, data_, size_);
+
+          data_ = d;
+          capacity_ = c;
+          return true;
+        }
+      }
+
+      data_ = heap_.data ();
+      capacity_ = c;
+      return true;
+    }
+
+    vector<uint8_t> byte_buffer_writer::
+    release ()
+    {
+      vector<uint8_t> r;
+
+      if (storage_ == storage::heap)
+      {
+        heap_.resize (size_);
+        r = move (heap_);
+        heap_ = vector<uint8_t> ();
+
+        data_ = inline_;
+        capacity_ = inline_capacity;
+        storage_ = storage::inline_buffer;
+      }
+      else
+        r.assign (data_, data_ + size_);
+
+      size_ = 0;
+      return r;
+    }
+
     void byte_buffer_writer::
     append (const void* data, size_t size)
     {
-      auto p (static_cast<const uint8_t*> (data));
-      buffer_.insert (buffer_.end (), p, p + size);
+      // Note that memcpy () with a null pointer is undefined even if size is
+      // zero, which can happen for an empty blob.
+      //
+      if (size != 0)
+      {
+        memcpy (data_ + size_, data, size);
+        size_ += size;
+      }
     }
 
     void byte_buffer_writer::
     append_tag (byte_type_tag tag)
     {
-      buffer_.push_back (static_cast<uint8_t> (tag));
+      data_[size_++] = static_cast<uint8_t> (tag);
     }
 
     void byte_buffer_writer::
     write_bool (bool v)
     {
+      if (!ensure (1 + 1))
+        return;
+
       append_tag (byte_type_tag::boolean);
 
       uint8_t b (v ? 1 : 0);
@@ -36,6 +158,9 @@ namespace iw4x
     void byte_buffer_writer::
     write_uint8 (uint8_t v)
     {
+      if (!ensure (1 + 1))
+        return;
+
       append_tag (byte_type_tag::boolean);
       append (&v, 1);
     }
@@ -43,6 +168,9 @@ namespace iw4x
     void byte_buffer_writer::
     write_uint32 (uint32_t v)
     {
+      if (!ensure (1 + sizeof (v)))
+        return;
+
       append_tag (byte_type_tag::integer32);
       append (&v, sizeof (v));
     }
@@ -50,6 +178,9 @@ namespace iw4x
     void byte_buffer_writer::
     write_int32 (int32_t v)
     {
+      if (!ensure (1 + sizeof (v)))
+        return;
+
       append_tag (byte_type_tag::integer32);
       append (&v, sizeof (v));
     }
@@ -57,6 +188,9 @@ namespace iw4x
     void byte_buffer_writer::
     write_uint64 (uint64_t v)
     {
+      if (!ensure (1 + sizeof (v)))
+        return;
+
       append_tag (byte_type_tag::integer64);
       append (&v, sizeof (v));
     }
@@ -64,6 +198,9 @@ namespace iw4x
     void byte_buffer_writer::
     write_int64 (int64_t v)
     {
+      if (!ensure (1 + sizeof (v)))
+        return;
+
       append_tag (byte_type_tag::integer64);
       append (&v, sizeof (v));
     }
@@ -71,6 +208,9 @@ namespace iw4x
     void byte_buffer_writer::
     write_float (float v)
     {
+      if (!ensure (1 + sizeof (uint32_t) + sizeof (v)))
+        return;
+
       append_tag (byte_type_tag::floating);
 
       uint32_t len (sizeof (float));
@@ -79,8 +219,11 @@ namespace iw4x
     }
 
     void byte_buffer_writer::
-    write_string (const string& s)
+    write_string (string_view s)
     {
+      if (!ensure (1 + sizeof (uint32_t) + s.size () + 1))
+        return;
+
       append_tag (byte_type_tag::string);
 
       // Length includes the null terminator.
@@ -96,6 +239,9 @@ namespace iw4x
     void byte_buffer_writer::
     write_blob (const uint8_t* data, size_t size)
     {
+      if (!ensure (1 + sizeof (uint32_t) + size))
+        return;
+
       append_tag (byte_type_tag::blob);
 
       uint32_t len (static_cast<uint32_t> (size));
@@ -106,6 +252,9 @@ namespace iw4x
     void byte_buffer_writer::
     write_struct_header (uint32_t error_code)
     {
+      if (!ensure (1 + sizeof (error_code)))
+        return;
+
       append_tag (byte_type_tag::struct_header);
       append (&error_code, sizeof (error_code));
     }
@@ -113,6 +262,9 @@ namespace iw4x
     void byte_buffer_writer::
     write_array_count (uint32_t count)
     {
+      if (!ensure (1 + sizeof (count)))
+        return;
+
       append_tag (byte_type_tag::array_count);
       append (&count, sizeof (count));
     }
@@ -221,6 +373,28 @@ namespace iw4x
 
     bool byte_buffer_reader::
     read_string (string& s)
+    {
+      string_view v;
+      if (!read_string_view (v))
+        return false;
+
+      s.assign (v);
+      return true;
+    }
+
+    bool byte_buffer_reader::
+    read_blob (vector<uint8_t>& out)
+    {
+      span<const uint8_t> v;
+      if (!read_blob_span (v))
+        return false;
+
+      out.assign (v.begin (), v.end ());
+      return true;
+    }
+
+    bool byte_buffer_reader::
+    read_string_view (string_view& s)
     {
       if (!verify_tag (byte_type_tag::string))
         return false;
@@ -234,13 +408,13 @@ namespace iw4x
 
       // Length includes the null terminator.
       //
-      s.assign (reinterpret_cast<const char*> (data_ + pos_), len - 1);
+      s = string_view (reinterpret_cast<const char*> (data_ + pos_), len - 1);
       pos_ += len;
       return true;
     }
 
     bool byte_buffer_reader::
-    read_blob (vector<uint8_t>& out)
+    read_blob_span (span<const uint8_t>& out)
     {
       if (!verify_tag (byte_type_tag::blob))
         return false;
@@ -252,7 +426,7 @@ namespace iw4x
       if (pos_ + len > size_)
         return false;
 
-      out.assign (data_ + pos_, data_ + pos_ + len);
+      out = span<const uint8_t> (data_ + pos_, len);
       pos_ += len;
       return true;
     }
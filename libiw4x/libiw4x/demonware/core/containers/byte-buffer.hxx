@@ -1,12 +1,16 @@
 #pragma once
 
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstddef>
 #include <cstdint>
 
 #include <libiw4x/export.hxx>
 
+#include <libiw4x/demonware/core/containers/arena.hxx>
+
 namespace iw4x
 {
   namespace demonware
@@ -35,10 +39,43 @@ namespace iw4x
     // prefixed with a one-byte type tag followed by the data in native byte
     // order.
     //
+    // By default the data is accumulated in an inline buffer that is large
+    // enough for a typical reply and only spills over to the heap when that
+    // runs out. Alternatively, the writer can be pointed to caller-provided
+    // storage:
+    //
+    // span   -- write into a fixed-size buffer. Once a field does not fit, the
+    //           writer enters the overflow state: the field and everything
+    //           after it is dropped and overflow () returns true.
+    //
+    // arena  -- allocate (and grow) the buffer from the arena. Note that the
+    //           space used by outgrown buffers is only reclaimed when the
+    //           arena is reset.
+    //
+    // Note that the writer is neither copyable nor movable since it may
+    // refer to its own inline storage.
+    //
     class byte_buffer_writer
     {
     public:
-      byte_buffer_writer () = default;
+      static constexpr std::size_t inline_capacity = 256;
+
+      byte_buffer_writer ();
+
+      explicit
+      byte_buffer_writer (std::span<std::uint8_t> buffer);
+
+      explicit
+      byte_buffer_writer (arena&);
+
+      byte_buffer_writer (const byte_buffer_writer&) = delete;
+      byte_buffer_writer& operator = (const byte_buffer_writer&) = delete;
+
+      // Make sure the buffer can hold at least n bytes in total without
+      // growing. Return false if that is not possible (fixed-size buffer).
+      //
+      bool
+      reserve (std::size_t n);
 
       // Typed field writers. Each writes a type tag followed by the value.
       //
@@ -70,7 +107,7 @@ namespace iw4x
       // (including null terminator), chars, null byte.
       //
       void
-      write_string (const std::string&);
+      write_string (std::string_view);
 
       // Write a binary blob. The wire format is: type tag, uint32 length,
       // raw bytes.
@@ -92,20 +129,38 @@ namespace iw4x
       // Raw data access.
       //
       const std::uint8_t*
-      data () const {return buffer_.data ();}
+      data () const {return data_;}
 
       std::size_t
-      size () const {return buffer_.size ();}
+      size () const {return size_;}
+
+      std::size_t
+      capacity () const {return capacity_;}
 
       bool
-      empty () const {return buffer_.empty ();}
+      empty () const {return size_ == 0;}
 
-      // Detach the internal buffer.
+      // True if a write did not fit into the fixed-size buffer.
+      //
+      bool
+      overflow () const {return overflow_;}
+
+      // Detach the data as an owned buffer and reset the writer to empty.
+      // Note that unless the data is already on the heap, this makes a copy.
       //
       std::vector<std::uint8_t>
-      release () {return std::move (buffer_);}
+      release ();
 
     private:
+      // Fields are written as a unit: we first make room for the whole thing
+      // and then append its parts unchecked.
+      //
+      bool
+      ensure (std::size_t additional);
+
+      bool
+      grow (std::size_t required);
+
       void
       append (const void*, std::size_t);
 
@@ -113,7 +168,25 @@ namespace iw4x
       append_tag (byte_type_tag);
 
     private:
-      std::vector<std::uint8_t> buffer_;
+      enum class storage : std::uint8_t
+      {
+        inline_buffer,
+        heap,
+        fixed,
+        arena
+      };
+
+      std::uint8_t* data_;
+      std::size_t size_ = 0;
+      std::size_t capacity_;
+
+      storage storage_;
+      bool overflow_ = false;
+
+      std::vector<std::uint8_t> heap_;
+      demonware::arena* arena_ = nullptr;
+
+      alignas (8) std::uint8_t inline_[inline_capacity];
     };
 
     // Byte-level typed buffer reader.
@@ -161,6 +234,16 @@ namespace iw4x
       bool
       read_blob (std::vector<std::uint8_t>&);
 
+      // Non-copying variants of the above. The returned view points directly
+      // into the source buffer and is only valid for as long as it is. Note
+      // that the string view does not include the null terminator.
+      //
+      bool
+      read_string_view (std::string_view&);
+
+      bool
+      read_blob_span (std::span<const std::uint8_t>&);
+
       bool
       read_struct_header (std::uint32_t& error_code);
 
@@ -0,0 +1,97 @@
+#include <libiw4x/demonware/core/containers/pool.hxx>
+
+#include <bit>
+#include <cassert>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    namespace
+    {
+      // Size of the chunk the free lists are refilled from.
+      //
+      constexpr size_t chunk_size (64 * 1024);
+
+      constexpr size_t
+      class_size (size_t c)
+      {
+        return bucket_pool::min_size << c;
+      }
+
+      static_assert (class_size (8) == bucket_pool::max_size);
+    }
+
+    uint8_t* bucket_pool::
+    allocate (size_t n)
+    {
+      if (n > max_size)
+        return nullptr;
+
+      // Map the request to its size class: 0 for up to min_size, 1 for up to
+      // twice that, and so on.
+      //
+      size_t c (n <= min_size
+                ? 0
+                : bit_width (n - 1) - bit_width (min_size - 1));
+
+      assert (c < classes && class_size (c) >= n);
+
+      lock_guard<mutex> l (m_);
+
+      if (free_[c] == nullptr)
+        refill (c);
+
+      free_block* b (free_[c]);
+      free_[c] = b->next;
+
+      // Stash the class in the header and hand out the payload behind it.
+      //
+      auto p (reinterpret_cast<uint8_t*> (b));
+      p[0] = static_cast<uint8_t> (c);
+
+      return p + header_size;
+    }
+
+    void bucket_pool::
+    release (uint8_t* p)
+    {
+      p -= header_size;
+
+      size_t c (p[0]);
+      assert (c < classes);
+
+      auto b (reinterpret_cast<free_block*> (p));
+
+      lock_guard<mutex> l (m_);
+
+      b->next = free_[c];
+      free_[c] = b;
+    }
+
+    void bucket_pool::
+    refill (size_t c)
+    {
+      size_t stride (header_size + class_size (c));
+      size_t n (chunk_size / stride);
+
+      if (n == 0)
+        n = 1;
+
+      chunks_.push_back (make_unique_for_overwrite<uint8_t[]> (n * stride));
+      uint8_t* d (chunks_.back ().get ());
+
+      // Thread the new blocks onto the free list back to front so they are
+      // handed out in address order.
+      //
+      for (size_t i (n); i != 0; --i)
+      {
+        auto b (reinterpret_cast<free_block*> (d + (i - 1) * stride));
+        b->next = free_[c];
+        free_[c] = b;
+      }
+    }
+  }
+}
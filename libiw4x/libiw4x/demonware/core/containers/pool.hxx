@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    // Fixed-capacity object pool.
+    //
+    // Storage for N objects of type T is reserved up front (typically as part
+    // of a static object) and handed out from a free list. When the pool is
+    // exhausted, allocate () returns NULL and it is up to the caller to fall
+    // back to some other allocator; owns () can then be used to tell the two
+    // apart on release.
+    //
+    // Note that the pool only manages raw storage: constructing and
+    // destroying the objects is the caller's business. In practice T is one
+    // of the engine-compatible layouts which are trivial.
+    //
+    template <typename T, std::size_t N>
+    class slab_pool
+    {
+    public:
+      slab_pool ()
+      {
+        for (std::size_t i (0); i != N; ++i)
+          free_[i] = static_cast<std::uint32_t> (N - 1 - i);
+
+        top_ = N;
+      }
+
+      slab_pool (const slab_pool&) = delete;
+      slab_pool& operator = (const slab_pool&) = delete;
+
+      T*
+      allocate ()
+      {
+        std::lock_guard<std::mutex> l (m_);
+
+        if (top_ == 0)
+          return nullptr;
+
+        return reinterpret_cast<T*> (&slots_[free_[--top_]]);
+      }
+
+      void
+      release (T* p)
+      {
+        std::lock_guard<std::mutex> l (m_);
+
+        free_[top_++] = static_cast<std::uint32_t> (
+          reinterpret_cast<slot*> (p) - slots_.data ());
+      }
+
+      bool
+      owns (const void* p) const
+      {
+        auto b (reinterpret_cast<const std::byte*> (slots_.data ()));
+        auto e (reinterpret_cast<const std::byte*> (slots_.data () + N));
+        auto x (static_cast<const std::byte*> (p));
+
+        return x >= b && x < e;
+      }
+
+      // Number of objects that can still be allocated.
+      //
+      std::size_t
+      available () const
+      {
+        std::lock_guard<std::mutex> l (m_);
+        return top_;
+      }
+
+    private:
+      struct alignas (alignof (T)) slot
+      {
+        std::byte data[sizeof (T)];
+      };
+
+      std::array<slot, N> slots_;
+      std::array<std::uint32_t, N> free_;
+      std::size_t top_;
+
+      mutable std::mutex m_;
+    };
+
+    // Size-classed byte array pool.
+    //
+    // Requests are rounded up to the next power of two between min_size and
+    // max_size and served from a per-class free list. The free lists are
+    // refilled a chunk at a time so, once the working set has been reached,
+    // allocation and release never go to the general-purpose heap. Memory is
+    // never returned to the system.
+    //
+    // Requests larger than max_size are not served (NULL is returned).
+    //
+    class bucket_pool
+    {
+    public:
+      static constexpr std::size_t min_size = 64;
+      static constexpr std::size_t max_size = 16384;
+
+      bucket_pool () = default;
+
+      bucket_pool (const bucket_pool&) = delete;
+      bucket_pool& operator = (const bucket_pool&) = delete;
+
+      std::uint8_t*
+      allocate (std::size_t n);
+
+      // Return an array previously obtained from allocate ().
+      //
+      void
+      release (std::uint8_t*);
+
+    private:
+      // Every block is preceded by a header that records its size class so
+      // that release () does not need to be told the size. It also keeps the
+      // payload 16-byte aligned.
+      //
+      static constexpr std::size_t header_size = 16;
+      static constexpr std::size_t classes = 9; // 64 .. 16384
+
+      struct free_block
+      {
+        free_block* next;
+      };
+
+      void
+      refill (std::size_t c);
+
+      std::mutex m_;
+      std::array<free_block*, classes> free_ {};
+      std::vector<std::unique_ptr<std::uint8_t[]>> chunks_;
+    };
+  }
+}
@@ -0,0 +1,549 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <libiw4x/demonware/core/containers/bit-buffer.hxx>
+#include <libiw4x/demonware/core/containers/byte-buffer.hxx>
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    // Compile-time message schemas.
+    //
+    // Rather than writing a reply field by field and hoping the reader pulls
+    // them back in the same order, we describe the message once as a list of
+    // data member pointers and let the compiler generate the encode and
+    // decode functions for both wire formats. For example:
+    //
+    //   struct file_header
+    //   {
+    //     std::uint64_t file_id;
+    //     std::uint32_t file_size;
+    //     std::string   filename;
+    //   };
+    //
+    //   using file_header_schema = schema<&file_header::file_id,
+    //                                     &file_header::file_size,
+    //                                     &file_header::filename>;
+    //
+    //   file_header_schema::encode (reply, h);
+    //
+    // The wire type of each field is derived from the member type:
+    //
+    //   bool                                   boolean
+    //   std::uint8_t                           byte
+    //   std::int32_t, std::uint32_t            32-bit integer
+    //   std::int64_t, std::uint64_t            64-bit integer
+    //   float                                  floating point
+    //   const char*, std::string[_view]        null-terminated string
+    //   std::vector<uint8_t>, std::span<...>   length-prefixed blob
+    //
+    // On the bit-level format the leading run of fixed-size fields has a
+    // compile-time size (fixed_bits) and every fixed-size field, tag
+    // included, is packed into a word accumulator that is flushed to the
+    // stream 64 bits at a time. The exact encoded size of a message is known
+    // before encoding starts so the writer is grown at most once.
+    //
+    // Note that decoding into non-owning member types (const char*, views,
+    // spans) is not supported since there is nothing for them to point to.
+    //
+    namespace schema_detail
+    {
+      // Longest string we are prepared to decode from a bit stream (the
+      // bit-level string has no length prefix).
+      //
+      inline constexpr std::size_t max_string (1024);
+
+      template <typename M>
+      struct member_traits;
+
+      template <typename C, typename V>
+      struct member_traits<V C::*>
+      {
+        using class_type = C;
+        using value_type = V;
+      };
+
+      template <auto M>
+      using field_type = typename member_traits<decltype (M)>::value_type;
+
+      // Per-type wire description.
+      //
+      // Fixed-size types provide the tags, the value width in bits/bytes,
+      // and conversions to and from the raw bit representation. Dynamic
+      // types (strings and blobs) are handled separately below.
+      //
+      template <typename V>
+      struct wire
+      {
+        static constexpr bool fixed = false;
+      };
+
+      template <bit_type_tag BT, unsigned int B, typename V>
+      struct fixed_wire
+      {
+        static constexpr bool fixed = true;
+        static constexpr bit_type_tag bit_tag = BT;
+        static constexpr unsigned int bits = B;
+
+        static std::uint64_t
+        to_bits (V v)
+        {
+          if constexpr (std::is_same_v<V, bool>)
+            return v ? 1 : 0;
+          else
+          {
+            std::make_unsigned_t<
+              std::conditional_t<std::is_floating_point_v<V>, std::int32_t, V>>
+              u;
+            static_assert (sizeof (u) == sizeof (V));
+            std::memcpy (&u, &v, sizeof (u));
+            return u;
+          }
+        }
+
+        static V
+        from_bits (std::uint64_t u)
+        {
+          if constexpr (std::is_same_v<V, bool>)
+            return u != 0;
+          else
+          {
+            V v;
+            std::memcpy (&v, &u, sizeof (v)); // Little-endian host.
+            return v;
+          }
+        }
+      };
+
+      template <>
+      struct wire<bool>: fixed_wire<bit_type_tag::boolean, 1, bool>
+      {
+        static constexpr std::size_t bytes = 1 + 1;
+
+        static void
+        write (byte_buffer_writer& w, bool v) {w.write_bool (v);}
+
+        static bool
+        read (byte_buffer_reader& r, bool& v) {return r.read_bool (v);}
+      };
+
+      template <>
+      struct wire<std::uint8_t>: fixed_wire<bit_type_tag::byte,
+                                            8,
+                                            std::uint8_t>
+      {
+        static constexpr std::size_t bytes = 1 + 1;
+
+        static void
+        write (byte_buffer_writer& w, std::uint8_t v) {w.write_uint8 (v);}
+
+        static bool
+        read (byte_buffer_reader& r, std::uint8_t& v) {return r.read_uint8 (v);}
+      };
+
+      template <>
+      struct wire<std::uint32_t>: fixed_wire<bit_type_tag::uint32,
+                                             32,
+                                             std::uint32_t>
+      {
+        static constexpr std::size_t bytes = 1 + 4;
+
+        static void
+        write (byte_buffer_writer& w, std::uint32_t v) {w.write_uint32 (v);}
+
+        static bool
+        read (byte_buffer_reader& r, std::uint32_t& v)
+        {
+          return r.read_uint32 (v);
+        }
+      };
+
+      template <>
+      struct wire<std::int32_t>: fixed_wire<bit_type_tag::int32,
+                                            32,
+                                            std::int32_t>
+      {
+        static constexpr std::size_t bytes = 1 + 4;
+
+        static void
+        write (byte_buffer_writer& w, std::int32_t v) {w.write_int32 (v);}
+
+        static bool
+        read (byte_buffer_reader& r, std::int32_t& v) {return r.read_int32 (v);}
+      };
+
+      template <>
+      struct wire<std::uint64_t>: fixed_wire<bit_type_tag::uint64,
+                                             64,
+                                             std::uint64_t>
+      {
+        static constexpr std::size_t bytes = 1 + 8;
+
+        static void
+        write (byte_buffer_writer& w, std::uint64_t v) {w.write_uint64 (v);}
+
+        static bool
+        read (byte_buffer_reader& r, std::uint64_t& v)
+        {
+          return r.read_uint64 (v);
+        }
+      };
+
+      template <>
+      struct wire<std::int64_t>: fixed_wire<bit_type_tag::int64,
+                                            64,
+                                            std::int64_t>
+      {
+        static constexpr std::size_t bytes = 1 + 8;
+
+        static void
+        write (byte_buffer_writer& w, std::int64_t v) {w.write_int64 (v);}
+
+        static bool
+        read (byte_buffer_reader& r, std::int64_t& v) {return r.read_int64 (v);}
+      };
+
+      template <>
+      struct wire<float>: fixed_wire<bit_type_tag::floating, 32, float>
+      {
+        // Tag, uint32 length, value.
+        //
+        static constexpr std::size_t bytes = 1 + 4 + 4;
+
+        static void
+        write (byte_buffer_writer& w, float v) {w.write_float (v);}
+
+        static bool
+        read (byte_buffer_reader& r, float& v) {return r.read_float (v);}
+      };
+
+      template <typename V>
+      concept string_like = std::is_same_v<V, const char*> ||
+                            std::is_same_v<V, std::string> ||
+                            std::is_same_v<V, std::string_view>;
+
+      template <typename V>
+      concept blob_like = std::is_same_v<V, std::vector<std::uint8_t>> ||
+                          std::is_same_v<V, std::span<const std::uint8_t>>;
+
+      inline std::string_view
+      as_string (const char* s) {return s != nullptr ? s : "";}
+
+      inline std::string_view
+      as_string (std::string_view s) {return s;}
+
+      inline std::span<const std::uint8_t>
+      as_blob (std::span<const std::uint8_t> b) {return b;}
+
+      // Field-level sizes.
+      //
+      template <typename V>
+      constexpr std::size_t
+      field_bits (const V& v)
+      {
+        if constexpr (wire<V>::fixed)
+          return 5 + wire<V>::bits;
+        else if constexpr (string_like<V>)
+          return 5 + (as_string (v).size () + 1) * 8;
+        else
+        {
+          static_assert (blob_like<V>, "unsupported schema field type");
+          return 5 + (5 + 32) + as_blob (v).size () * 8;
+        }
+      }
+
+      template <typename V>
+      constexpr std::size_t
+      field_bytes (const V& v)
+      {
+        if constexpr (wire<V>::fixed)
+          return wire<V>::bytes;
+        else if constexpr (string_like<V>)
+          return 1 + 4 + as_string (v).size () + 1;
+        else
+        {
+          static_assert (blob_like<V>, "unsupported schema field type");
+          return 1 + 4 + as_blob (v).size ();
+        }
+      }
+
+      // Word accumulator for the bit-level encoder.
+      //
+      // Consecutive fixed-size fields (tags included) are merged into a
+      // 64-bit word that is handed to the bit_writer only once it fills up,
+      // so a run of small fields costs one store per 64 bits rather than two
+      // calls per field.
+      //
+      class bit_packer
+      {
+      public:
+        explicit
+        bit_packer (bit_writer& w)
+          : w_ (w) {}
+
+        ~bit_packer () {flush ();}
+
+        bit_packer (const bit_packer&) = delete;
+        bit_packer& operator = (const bit_packer&) = delete;
+
+        // Append the n least-significant bits of v (1 <= n <= 64). Note that
+        // v must not have any bits set above n.
+        //
+        void
+        put (std::uint64_t v, unsigned int n)
+        {
+          acc_ |= v << n_;
+
+          if (n_ + n >= 64)
+          {
+            w_.write_bits (acc_, 64);
+            acc_ = n_ != 0 ? v >> (64 - n_) : 0;
+            n_ = n_ + n - 64;
+          }
+          else
+            n_ += n;
+        }
+
+        void
+        flush ()
+        {
+          if (n_ != 0)
+          {
+            w_.write_bits (acc_, n_);
+            acc_ = 0;
+            n_ = 0;
+          }
+        }
+
+      private:
+        bit_writer& w_;
+        std::uint64_t acc_ = 0;
+        unsigned int n_ = 0;
+      };
+
+      template <typename V>
+      void
+      encode_field (bit_packer& p, bit_writer& w, const V& v)
+      {
+        if constexpr (wire<V>::fixed)
+        {
+          p.put (static_cast<std::uint8_t> (wire<V>::bit_tag), 5);
+          p.put (wire<V>::to_bits (v), wire<V>::bits);
+        }
+        else if constexpr (string_like<V>)
+        {
+          std::string_view s (as_string (v));
+
+          p.put (static_cast<std::uint8_t> (bit_type_tag::string), 5);
+          p.flush ();
+
+          w.write_bytes (reinterpret_cast<const std::uint8_t*> (s.data ()),
+                         s.size ());
+          w.write_bits (0, 8);
+        }
+        else
+        {
+          std::span<const std::uint8_t> b (as_blob (v));
+
+          p.put (static_cast<std::uint8_t> (bit_type_tag::blob), 5);
+          p.put (static_cast<std::uint8_t> (bit_type_tag::uint32), 5);
+          p.put (static_cast<std::uint32_t> (b.size ()), 32);
+          p.flush ();
+
+          w.write_bytes (b.data (), b.size ());
+        }
+      }
+
+      template <typename V>
+      bool
+      decode_field (bit_buffer_reader& r, V& v)
+      {
+        bit_reader& br (r.reader ());
+
+        auto tag ([&br] (bit_type_tag t)
+        {
+          std::uint64_t u;
+          return br.read_bits (u, 5) && u == static_cast<std::uint8_t> (t);
+        });
+
+        if constexpr (wire<V>::fixed)
+        {
+          std::uint64_t u;
+
+          if (!tag (wire<V>::bit_tag) || !br.read_bits (u, wire<V>::bits))
+            return false;
+
+          v = wire<V>::from_bits (u);
+          return true;
+        }
+        else if constexpr (std::is_same_v<V, std::string>)
+          return r.read_string (v, max_string);
+        else if constexpr (std::is_same_v<V, std::vector<std::uint8_t>>)
+          return r.read_blob (v);
+        else
+        {
+          static_assert (!sizeof (V), "cannot decode into a non-owning field");
+          return false;
+        }
+      }
+
+      template <typename V>
+      void
+      encode_field (byte_buffer_writer& w, const V& v)
+      {
+        if constexpr (wire<V>::fixed)
+          wire<V>::write (w, v);
+        else if constexpr (string_like<V>)
+          w.write_string (as_string (v));
+        else
+        {
+          std::span<const std::uint8_t> b (as_blob (v));
+          w.write_blob (b.data (), b.size ());
+        }
+      }
+
+      template <typename V>
+      bool
+      decode_field (byte_buffer_reader& r, V& v)
+      {
+        if constexpr (wire<V>::fixed)
+          return wire<V>::read (r, v);
+        else if constexpr (std::is_same_v<V, std::string>)
+          return r.read_string (v);
+        else if constexpr (std::is_same_v<V, std::vector<std::uint8_t>>)
+          return r.read_blob (v);
+        else
+        {
+          static_assert (!sizeof (V), "cannot decode into a non-owning field");
+          return false;
+        }
+      }
+
+      // Size of the leading run of fixed-size fields.
+      //
+      template <typename V, typename... R>
+      constexpr std::size_t
+      fixed_prefix_bits ()
+      {
+        if constexpr (!wire<V>::fixed)
+          return 0;
+        else if constexpr (sizeof... (R) == 0)
+          return 5 + wire<V>::bits;
+        else
+          return 5 + wire<V>::bits + fixed_prefix_bits<R...> ();
+      }
+
+      template <typename V, typename... R>
+      constexpr std::size_t
+      fixed_prefix_bytes ()
+      {
+        if constexpr (!wire<V>::fixed)
+          return 0;
+        else if constexpr (sizeof... (R) == 0)
+          return wire<V>::bytes;
+        else
+          return wire<V>::bytes + fixed_prefix_bytes<R...> ();
+      }
+    }
+
+    template <auto M0, auto... M>
+    struct schema
+    {
+      using type =
+        typename schema_detail::member_traits<decltype (M0)>::class_type;
+
+      static_assert (
+        (std::is_same_v<
+           typename schema_detail::member_traits<decltype (M)>::class_type,
+           type> && ...),
+        "all schema fields must belong to the same message type");
+
+      // True if every field has a fixed wire size.
+      //
+      static constexpr bool fixed =
+        (schema_detail::wire<schema_detail::field_type<M0>>::fixed && ... &&
+         schema_detail::wire<schema_detail::field_type<M>>::fixed);
+
+      // Encoded size of the leading run of fixed-size fields. For an
+      // all-fixed schema this is the size of the whole message.
+      //
+      static constexpr std::size_t fixed_bits =
+        schema_detail::fixed_prefix_bits<schema_detail::field_type<M0>,
+                                         schema_detail::field_type<M>...> ();
+
+      static constexpr std::size_t fixed_bytes =
+        schema_detail::fixed_prefix_bytes<schema_detail::field_type<M0>,
+                                          schema_detail::field_type<M>...> ();
+
+      // Exact encoded size of the message.
+      //
+      static constexpr std::size_t
+      bit_size (const type& m)
+      {
+        if constexpr (fixed)
+          return fixed_bits;
+        else
+          return (schema_detail::field_bits (m.*M0) + ... +
+                  schema_detail::field_bits (m.*M));
+      }
+
+      static constexpr std::size_t
+      byte_size (const type& m)
+      {
+        if constexpr (fixed)
+          return fixed_bytes;
+        else
+          return (schema_detail::field_bytes (m.*M0) + ... +
+                  schema_detail::field_bytes (m.*M));
+      }
+
+      // Bit-level format.
+      //
+      static void
+      encode (bit_buffer_writer& w, const type& m)
+      {
+        bit_writer& bw (w.writer ());
+        bw.reserve (bit_size (m));
+
+        schema_detail::bit_packer p (bw);
+
+        schema_detail::encode_field (p, bw, m.*M0);
+        (schema_detail::encode_field (p, bw, m.*M), ...);
+      }
+
+      static bool
+      decode (bit_buffer_reader& r, type& m)
+      {
+        return schema_detail::decode_field (r, m.*M0) &&
+               (schema_detail::decode_field (r, m.*M) && ...);
+      }
+
+      // Byte-level format.
+      //
+      static void
+      encode (byte_buffer_writer& w, const type& m)
+      {
+        w.reserve (w.size () + byte_size (m));
+
+        schema_detail::encode_field (w, m.*M0);
+        (schema_detail::encode_field (w, m.*M), ...);
+      }
+
+      static bool
+      decode (byte_buffer_reader& r, type& m)
+      {
+        return schema_detail::decode_field (r, m.*M0) &&
+               (schema_detail::decode_field (r, m.*M) && ...);
+      }
+    };
+  }
+}
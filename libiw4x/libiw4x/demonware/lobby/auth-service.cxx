@@ -13,8 +13,6 @@ namespace iw4x
 {
   namespace demonware
   {
-    bd_auth_ticket auth_ticket {};
-
     auth_service::
     auth_service ()
     {
@@ -55,11 +53,5 @@ namespace iw4x
       ranges::generate (auth_ticket.session_key, std::ref (r));
       ranges::generate (auth_ticket.ticket_data, std::ref (r));
     }
-
-    const bd_auth_ticket& auth_service::
-    ticket ()
-    {
-      return auth_ticket;
-    }
   }
 }
@@ -1 +1,21 @@
 #include <libiw4x/demonware/lobby/auth-ticket.hxx>
+
+#include <libiw4x/demonware/lobby/auth-service.hxx>
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    // The ticket is filled in by auth_service on startup. It lives here
+    // rather than next to the service so that code which only reads it does
+    // not pull in the platform-specific parts (see dw-replay).
+    //
+    bd_auth_ticket auth_ticket {};
+
+    const bd_auth_ticket& auth_service::
+    ticket ()
+    {
+      return auth_ticket;
+    }
+  }
+}
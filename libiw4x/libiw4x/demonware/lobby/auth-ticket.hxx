@@ -16,5 +16,11 @@ namespace iw4x
       std::array<uint8_t, 128> session_key;
       std::array<uint8_t, 256> ticket_data;
     };
+
+    // The ticket itself (defined in auth-ticket.cxx). It is filled in by
+    // auth_service on startup (or by dw-replay) and read through
+    // auth_service::ticket () everywhere else.
+    //
+    extern bd_auth_ticket auth_ticket;
   }
 }
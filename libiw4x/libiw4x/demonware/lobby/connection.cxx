@@ -41,8 +41,10 @@ namespace iw4x
                                  void* payload,
                                  float timeout)
     {
-      auto task (
-        remote_task_manager::start_task (service_id, sub_func_id, payload));
+      auto task (remote_task_manager::start_task (service_id,
+                                                  sub_func_id,
+                                                  payload,
+                                                  timeout));
 
       // See if the caller expects a task object back.
       //
@@ -8,6 +8,7 @@
 #include <libiw4x/detour.hxx>
 #include <libiw4x/logger.hxx>
 
+#include <libiw4x/demonware/lobby/remote-task-manager/remote-task-manager.hxx>
 #include <libiw4x/demonware/lobby/storage/storage.hxx>
 
 using namespace std;
@@ -49,9 +50,11 @@ namespace iw4x
       void
       lobby_service_impl_pump (bd_lobby_service_impl*)
       {
-        // We handle task completion inside startTask directly, so the pump
-        // mechanism does not need to do anything.
+        // Most tasks are completed inside startTask directly. The ones whose
+        // handlers deferred their work to the background are finished (or
+        // timed out) here.
         //
+        remote_task_manager::pump ();
       }
 
       void
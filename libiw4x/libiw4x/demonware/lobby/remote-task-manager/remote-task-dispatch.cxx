@@ -0,0 +1,173 @@
+#include <libiw4x/demonware/lobby/remote-task-manager/remote-task-manager.hxx>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    // Note that this part of the remote task manager (handler registry,
+    // dispatch, and statistics) must not depend on the engine since it is
+    // also used by the dw-replay tool.
+    //
+
+    namespace
+    {
+      // Per-(service, sub-function) counters.
+      //
+      struct call_counters
+      {
+        atomic<uint64_t> calls {0};
+        atomic<uint64_t> total_ns {0};
+        atomic<uint64_t> max_ns {0};
+
+        void
+        record (uint64_t ns)
+        {
+          calls.fetch_add (1, memory_order_relaxed);
+          total_ns.fetch_add (ns, memory_order_relaxed);
+
+          uint64_t m (max_ns.load (memory_order_relaxed));
+          while (ns > m &&
+                 !max_ns.compare_exchange_weak (m, ns, memory_order_relaxed))
+            ;
+        }
+      };
+
+      struct service_entry
+      {
+        service_handler_t handler;
+        array<call_counters, 256> counters;
+      };
+
+      // Service handlers registry.
+      //
+      // The service ID is a byte so we simply index a fixed table. Each slot
+      // holds a pointer to an immutable entry which registration replaces
+      // wholesale (copy-on-write) and which dispatch loads without locking.
+      //
+      // Note that a replaced entry may still be in use by a concurrent
+      // dispatch, so we never free it. Since registration only happens at
+      // startup, this is at most a handful of objects.
+      //
+      array<atomic<service_entry*>, 256> handlers {};
+
+      mutex retired_m;
+      vector<unique_ptr<service_entry>> retired;
+
+      // Tasks for services nobody registered for.
+      //
+      array<call_counters, 256> unhandled;
+
+      // Deferred reply registered by the handler currently being dispatched
+      // on this thread, if any.
+      //
+      thread_local deferred_reply_t* current_deferred (nullptr);
+    }
+
+    void remote_task_manager::
+    register_handler (uint8_t service_id,
+                      service_handler_t h)
+    {
+      auto e (make_unique<service_entry> ());
+      e->handler = move (h);
+
+      service_entry* o (
+        handlers[service_id].exchange (e.release (), memory_order_acq_rel));
+
+      if (o != nullptr)
+      {
+        lock_guard<mutex> lk (retired_m);
+        retired.emplace_back (o);
+      }
+    }
+
+    void remote_task_manager::
+    dispatch (uint8_t service_id,
+              uint8_t sub_function_id,
+              bit_buffer_reader& request,
+              bit_buffer_writer& reply,
+              deferred_reply_t& deferred)
+    {
+      auto start (steady_clock::now ());
+      service_entry* e (handlers[service_id].load (memory_order_acquire));
+
+      if (e != nullptr)
+      {
+        current_deferred = &deferred;
+        e->handler (service_id, sub_function_id, request, reply);
+        current_deferred = nullptr;
+      }
+
+      auto ns (static_cast<uint64_t> (
+        duration_cast<nanoseconds> (steady_clock::now () - start).count ()));
+
+      if (e != nullptr)
+        e->counters[sub_function_id].record (ns);
+      else
+        unhandled[service_id].record (ns);
+    }
+
+    vector<remote_task_stats> remote_task_manager::
+    statistics ()
+    {
+      vector<remote_task_stats> r;
+
+      auto collect ([&r] (uint8_t s, uint8_t f, bool h, const call_counters& c)
+      {
+        uint64_t n (c.calls.load (memory_order_relaxed));
+
+        if (n == 0)
+          return;
+
+        r.push_back (remote_task_stats {
+          .service_id      = s,
+          .sub_function_id = f,
+          .handled         = h,
+          .calls           = n,
+          .total_ns        = c.total_ns.load (memory_order_relaxed),
+          .max_ns          = c.max_ns.load (memory_order_relaxed)});
+      });
+
+      for (size_t s (0); s != handlers.size (); ++s)
+      {
+        uint8_t sid (static_cast<uint8_t> (s));
+
+        if (const service_entry* e = handlers[s].load (memory_order_acquire))
+        {
+          for (size_t f (0); f != e->counters.size (); ++f)
+            collect (sid, static_cast<uint8_t> (f), true, e->counters[f]);
+        }
+
+        collect (sid, 0, false, unhandled[s]);
+      }
+
+      ranges::sort (r, [] (const auto& x, const auto& y)
+      {
+        return x.calls > y.calls;
+      });
+
+      return r;
+    }
+
+    void remote_task_manager::
+    defer (deferred_reply_t r)
+    {
+      assert (current_deferred != nullptr);
+
+      if (current_deferred != nullptr)
+        *current_deferred = move (r);
+    }
+  }
+}
@@ -1,17 +1,26 @@
 #include <libiw4x/demonware/lobby/remote-task-manager/remote-task-manager.hxx>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
-#include <map>
 #include <mutex>
+#include <span>
+#include <vector>
+
+#include <boost/asio.hpp>
 
 #include <libiw4x/detour.hxx>
 #include <libiw4x/import.hxx>
 #include <libiw4x/logger.hxx>
 
 #include <libiw4x/demonware/lobby/connection.hxx>
+#include <libiw4x/demonware/lobby/remote-task-manager/task-trace.hxx>
 
 using namespace std;
+using namespace std::chrono;
 
 namespace iw4x
 {
@@ -19,11 +28,46 @@ namespace iw4x
   {
     namespace
     {
-      // Service handlers registry, along with a mutex to protect it from
-      // concurrent access during registration and dispatch.
+      // Tasks handed to the engine in the pending state.
+      //
+      struct pending_task
+      {
+        bd_remote_task* task;
+        uint64_t id;
+        steady_clock::time_point deadline;
+      };
+
+      mutex pending_m;
+      vector<pending_task> pending;
+
+      // Deferred work that has finished, waiting for the pump.
       //
-      mutex handlers_m;
-      map<uint8_t, service_handler_t> handlers;
+      struct finished_task
+      {
+        bd_remote_task* task;
+        uint64_t id;
+        bit_buffer_writer reply;
+      };
+
+      mutex finished_m;
+      vector<finished_task> finished;
+
+      // The timeout if the caller did not supply one.
+      //
+      constexpr seconds default_timeout (30);
+
+      // Background executor for deferred work.
+      //
+      // A single thread is enough to get the I/O off the frame and it keeps
+      // the work in submission order. In particular, a file read that follows
+      // a write will observe it.
+      //
+      boost::asio::thread_pool&
+      executor ()
+      {
+        static boost::asio::thread_pool p (1);
+        return p;
+      }
 
       // Transaction ID counter.
       //
@@ -32,20 +76,82 @@ namespace iw4x
       // some edge cases.
       //
       uint64_t next_tid (1);
+
+      // Task capture (see capture ()).
+      //
+      task_trace_writer trace;
+      atomic<bool> tracing (false);
+    }
+
+    bool remote_task_manager::
+    capture (const filesystem::path& p)
+    {
+      if (!trace.open (p))
+      {
+        log::warning << "dw: unable to open task trace " << p.string ();
+        return false;
+      }
+
+      tracing.store (true, memory_order_release);
+
+      log::info << "dw: capturing tasks to " << p.string ();
+      return true;
     }
 
     void remote_task_manager::
-    register_handler (uint8_t service_id,
-                      service_handler_t h)
+    pump ()
     {
-      lock_guard<mutex> lk (handlers_m);
-      handlers[service_id] = move (h);
+      vector<finished_task> fs;
+      {
+        lock_guard<mutex> l (finished_m);
+        fs.swap (finished);
+      }
+
+      lock_guard<mutex> l (pending_m);
+
+      for (finished_task& f : fs)
+      {
+        auto i (ranges::find_if (pending, [&f] (const pending_task& p)
+        {
+          return p.task == f.task && p.id == f.id;
+        }));
+
+        // The task has already been failed because it took too long.
+        //
+        if (i == pending.end ())
+        {
+          log::warning << "dw: task " << f.id << " finished after timeout";
+          continue;
+        }
+
+        if (f.reply.size () == 0)
+        {
+          f.reply.write_uint32 (0); // BD_NO_ERROR.
+          f.reply.write_uint8 (0);  // No results.
+        }
+
+        complete_task (f.task, make_bit_buffer (f.reply));
+        pending.erase (i);
+      }
+
+      auto now (steady_clock::now ());
+
+      erase_if (pending, [now] (const pending_task& p)
+      {
+        if (p.deadline > now)
+          return false;
+
+        log::warning << "dw: task " << p.id << " timed out";
+        fail_task (p.task);
+        return true;
+      });
     }
 
     bd_remote_task* remote_task_manager::
     start_task (uint8_t service_id,
                 uint8_t sub_function_id,
-                void*   payload)
+                void*   payload,
+                float   timeout)
     {
       // We need to extract the underlying raw bytes from the game's
       // bdBitBuffer object. Since we receive this as an opaque payload and
@@ -92,6 +198,8 @@ namespace iw4x
                        ? data_size
                        : 0);
 
+      size_t req_bits (req_size != 0 ? static_cast<size_t> (write_bits) : 0);
+
       bool use_types (buf != nullptr && buf[0x2D] != 0);
 
       // Build a reader over the raw request data.
@@ -105,19 +213,88 @@ namespace iw4x
 
       // Now dispatch to whoever is registered to handle this.
       //
-      bit_buffer_writer rep;
+      // Note that we reuse the reply writer from one task to the next: once
+      // it has grown to fit the largest reply, it no longer allocates. The
+      // result is copied out by make_bit_buffer () anyway.
+      //
+      static thread_local bit_buffer_writer rep;
+      rep.clear ();
+
+      // Check if we actually have a handler for this service and let it
+      // populate our reply buffer.
+      //
+      deferred_reply_t deferred;
+
+      dispatch (service_id, sub_function_id, req, rep, deferred);
+
+      auto id (next_tid++);
+
+      bool traced (tracing.load (memory_order_acquire));
 
+      // If the handler deferred its work, hand out a pending task and let
+      // the executor take it from here.
+      //
+      // Note that if we are capturing, then the request has to be copied
+      // since it is gone by the time the reply is ready.
+      //
+      if (deferred)
       {
-        lock_guard<mutex> lk (handlers_m);
-        auto i (handlers.find (service_id));
+        auto t (make_pending_task (id, timeout));
 
-        // Check if we actually have a handler for this service and let it
-        // populate our reply buffer.
-        //
-        if (i != handlers.end ())
-          i->second (service_id, sub_function_id, req, rep);
+        auto d (timeout > 0.0f
+                ? duration_cast<steady_clock::duration> (
+                    duration<float> (timeout))
+                : duration_cast<steady_clock::duration> (default_timeout));
+        {
+          lock_guard<mutex> l (pending_m);
+          pending.push_back (pending_task {t, id, steady_clock::now () + d});
+        }
+
+        vector<uint8_t> q;
+
+        if (traced)
+          q.assign (req_data, req_data + req_size);
+
+        boost::asio::post (executor (),
+                           [t, id,
+                            w = move (deferred),
+                            traced,
+                            q = move (q),
+                            service_id,
+                            sub_function_id,
+                            req_bits,
+                            use_types] () mutable
+        {
+          bit_buffer_writer r;
+          w (r);
+
+          if (traced)
+            trace.write (service_id,
+                         sub_function_id,
+                         use_types,
+                         true,
+                         q,
+                         req_bits,
+                         span<const uint8_t> (r.data (), r.size ()),
+                         r.bit_size ());
+
+          lock_guard<mutex> l (finished_m);
+          finished.push_back (finished_task {t, id, move (r)});
+        });
+
+        return t;
       }
 
+      if (traced)
+        trace.write (service_id,
+                     sub_function_id,
+                     use_types,
+                     false,
+                     span<const uint8_t> (req_data, req_size),
+                     req_bits,
+                     span<const uint8_t> (rep.data (), rep.size ()),
+                     rep.bit_size ());
+
       // If the handler didn't write a reply, or if we didn't find a handler
       // in the first place, we just fake a generic success response.
       //
@@ -130,7 +307,6 @@ namespace iw4x
       // Finally, stitch together the completed task with a new sequence ID
       // and our prepared reply buffer.
       //
-      auto id (next_tid++);
       auto res (make_bit_buffer (rep));
 
       return make_completed_task (res, id);
@@ -140,6 +316,9 @@ namespace iw4x
     remote_task_manager ()
     {
       detour (bdLobbyConnectionStartTask, &lobby_connection_start_task);
+
+      if (const char* p = getenv ("IW4X_DW_TRACE"); p != nullptr && *p != '\0')
+        capture (p);
     }
   }
 }
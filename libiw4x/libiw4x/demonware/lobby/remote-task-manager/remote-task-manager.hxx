@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <filesystem>
 #include <functional>
+#include <vector>
 
 #include <libiw4x/demonware/core/containers/bit-buffer.hxx>
 #include <libiw4x/demonware/lobby/remote-task-manager/remote-task.hxx>
@@ -16,6 +18,25 @@ namespace iw4x
                                     bit_buffer_reader& request,
                                     bit_buffer_writer& reply)>;
 
+    // Reply work deferred to the background executor (see defer () below).
+    //
+    using deferred_reply_t =
+      std::move_only_function<void (bit_buffer_writer& reply)>;
+
+    // Dispatch counters for one (service, sub-function) pair. Services
+    // without a registered handler are only counted per service (with the
+    // sub-function ID set to 0).
+    //
+    struct remote_task_stats
+    {
+      std::uint8_t  service_id;
+      std::uint8_t  sub_function_id;
+      bool          handled;
+      std::uint64_t calls;
+      std::uint64_t total_ns;
+      std::uint64_t max_ns;
+    };
+
     class remote_task_manager
     {
     public:
@@ -24,10 +45,61 @@ namespace iw4x
       static void
       register_handler (uint8_t service_id, service_handler_t handler);
 
-      // Create a completed task for the given request.
+      // Create a task for the given request.
+      //
+      // Normally the handler writes the reply right away and the task is
+      // returned already completed. If instead the handler calls defer (),
+      // the task is returned pending and its reply is produced later (see
+      // pump ()). If that does not happen within timeout seconds (or the
+      // default if it is not positive), the task fails.
       //
       static bd_remote_task*
-      start_task (uint8_t service_id, uint8_t sub_function_id, void* payload);
+      start_task (uint8_t service_id,
+                  uint8_t sub_function_id,
+                  void* payload,
+                  float timeout = 0.0f);
+
+      // Complete the task being dispatched asynchronously.
+      //
+      // Must only be called from within a service handler, which should then
+      // not write anything to its reply. The work is run on a background
+      // executor and should parse nothing from the request, which is gone by
+      // then. Note that deferred work is executed in submission order.
+      //
+      static void
+      defer (deferred_reply_t);
+
+      // Run the handler registered for the service (if any) on the request
+      // and update the dispatch counters. If the handler defers its work, it
+      // is returned in deferred and nothing is written to the reply.
+      //
+      // This is what start_task () does once it has unpacked the engine's
+      // request and it is exposed for the dw-replay tool.
+      //
+      static void
+      dispatch (uint8_t service_id,
+                uint8_t sub_function_id,
+                bit_buffer_reader& request,
+                bit_buffer_writer& reply,
+                deferred_reply_t& deferred);
+
+      // Start recording every task (request and reply) to the trace file
+      // (see task-trace.hxx). This is also done on startup if the
+      // IW4X_DW_TRACE environment variable is set to the trace path.
+      //
+      static bool
+      capture (const std::filesystem::path&);
+
+      // Move deferred tasks whose work has finished to done and fail those
+      // that timed out. Called from the lobby service pump on every frame.
+      //
+      static void
+      pump ();
+
+      // Snapshot the dispatch counters, busiest first.
+      //
+      static std::vector<remote_task_stats>
+      statistics ();
     };
   }
 }
@@ -1,9 +1,13 @@
 #include <libiw4x/demonware/lobby/remote-task-manager/remote-task.hxx>
 
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cstring>
+#include <mutex>
 
 #include <libiw4x/import.hxx>
+#include <libiw4x/logger.hxx>
 
 using namespace std;
 
@@ -11,30 +15,158 @@ namespace iw4x
 {
   namespace demonware
   {
+    namespace
+    {
+      // Remote task ring.
+      //
+      // Unlike bdBitBuffer, our task objects have no vtable or reference
+      // count for the engine to go through, so it never tells us when it is
+      // done with one (with bdAlloc () they were simply leaked). Instead, we
+      // hand them out round-robin from a fixed ring: the engine picks up a
+      // completed task within a frame or two, so by the time a slot comes
+      // around again its previous user is long gone.
+      //
+      // When a slot is reused, we also drop the task's reference to its
+      // result buffer, which lets the buffer go back to its pool. Note that
+      // slots with a task still in flight are skipped and if all of them are,
+      // we fall back to allocating (and leaking) the task with bdAlloc ().
+      //
+      // The "frame or two" is an assumption, not something the engine tells
+      // us, so we check it as best we can: if the result buffer of a slot we
+      // are about to reuse still has the engine's reference, the engine may
+      // not have picked the result up yet. Such reuses are counted and
+      // logged.
+      //
+      constexpr size_t task_slots (512);
+
+      mutex tasks_m;
+      array<bd_remote_task, task_slots> tasks {};
+      size_t next_task (0);
+      size_t early_reuses (0);
+
+      bd_remote_task*
+      acquire_task ()
+      {
+        bd_remote_task* t (nullptr);
+        bd_bit_buffer* o (nullptr);
+        {
+          lock_guard<mutex> l (tasks_m);
+
+          for (size_t n (0); n != task_slots; ++n)
+          {
+            bd_remote_task& s (tasks[next_task]);
+            next_task = (next_task + 1) % task_slots;
+
+            // The status is published by complete_task () and fail_task ()
+            // without the lock.
+            //
+            atomic_ref<int32_t> st (s.status);
+
+            if (st.load (memory_order_acquire) != 1)
+            {
+              t = &s;
+              break;
+            }
+          }
+
+          if (t != nullptr)
+          {
+            o = t->result_buffer;
+            t->result_buffer = nullptr;
+
+            if (o != nullptr)
+            {
+              atomic_ref<int32_t> rc (o->refcount);
+
+              if (rc.load (memory_order_acquire) > 1 &&
+                  early_reuses++ % 1024 == 0)
+                log::warning << "reusing remote task slot whose result may "
+                             << "not have been picked up yet ("
+                             << early_reuses << " so far)";
+            }
+          }
+        }
+
+        if (t == nullptr)
+          return static_cast<bd_remote_task*> (
+            bdAlloc (sizeof (bd_remote_task)));
+
+        release_bit_buffer (o);
+        return t;
+      }
+
+      void
+      set_result (bd_remote_task* t, bd_bit_buffer* r)
+      {
+        t->result_buffer = r;
+
+        // Bump the reference count on the result buffer. That is, it's now
+        // conceptually owned by both the task itself and the caller, so it
+        // has to survive until both are finished with it.
+        //
+        if (r != nullptr)
+          r->refcount = 2;
+      }
+    }
+
     bd_remote_task*
     make_completed_task (bd_bit_buffer* r, uint64_t id)
     {
-      auto t (static_cast<bd_remote_task*> (bdAlloc (sizeof (bd_remote_task))));
+      bd_remote_task* t (acquire_task ());
 
       *t = bd_remote_task
       {
         .next           = nullptr,
         .timeout        = 0.0f,
         .status         = 2, // bd_done
-        .result_buffer  = r,
+        .result_buffer  = nullptr,
         .request_buffer = nullptr,
         .transaction_id = id,
         .reserved       = 0
       };
 
-      // Bump the reference count on the result buffer. That is, it's now
-      // conceptually owned by both the task itself and the caller, so it has to
-      // survive until both are finished with it.
-      //
-      if (r != nullptr)
-        r->refcount = 2;
+      set_result (t, r);
+      return t;
+    }
+
+    bd_remote_task*
+    make_pending_task (uint64_t id, float timeout)
+    {
+      bd_remote_task* t (acquire_task ());
+
+      *t = bd_remote_task
+      {
+        .next           = nullptr,
+        .timeout        = timeout,
+        .status         = 1, // bd_pending
+        .result_buffer  = nullptr,
+        .request_buffer = nullptr,
+        .transaction_id = id,
+        .reserved       = 0
+      };
 
       return t;
     }
+
+    void
+    complete_task (bd_remote_task* t, bd_bit_buffer* r)
+    {
+      assert (t->status == 1);
+
+      set_result (t, r);
+
+      // The engine polls the status, so publish it only once the result is
+      // in place.
+      //
+      atomic_ref<int32_t> (t->status).store (2, memory_order_release);
+    }
+
+    void
+    fail_task (bd_remote_task* t)
+    {
+      assert (t->status == 1);
+
+      atomic_ref<int32_t> (t->status).store (3, memory_order_release);
+    }
   }
 }
@@ -31,7 +31,22 @@ namespace iw4x
 
     static_assert (sizeof (bd_remote_task) == 0x30);
 
+    // Create a task that is already done with the specified result.
+    //
     bd_remote_task*
     make_completed_task (bd_bit_buffer*, uint64_t transaction_id);
+
+    // Create a task that is still in flight. It must later be finished with
+    // either complete_task () or fail_task () from the thread the engine polls
+    // it on.
+    //
+    bd_remote_task*
+    make_pending_task (uint64_t transaction_id, float timeout);
+
+    void
+    complete_task (bd_remote_task*, bd_bit_buffer*);
+
+    void
+    fail_task (bd_remote_task*);
   }
 }
@@ -0,0 +1,113 @@
+#include <libiw4x/demonware/lobby/remote-task-manager/task-trace.hxx>
+
+#include <cstring>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    namespace
+    {
+      constexpr char magic[8] = {'I', 'W', '4', 'X', 'D', 'W', 'T', '\0'};
+      constexpr uint32_t version (1);
+
+      // Record flags.
+      //
+      constexpr uint8_t flag_type_checking (0x01);
+      constexpr uint8_t flag_deferred      (0x02);
+
+      // Fixed part of a record.
+      //
+      constexpr size_t record_header_size (12);
+
+      // Largest request or reply we are prepared to read back. Anything
+      // bigger is most likely a corrupt trace.
+      //
+      constexpr size_t max_bits (size_t (64) * 1024 * 1024 * 8);
+    }
+
+    // task_trace_writer
+    //
+
+    bool task_trace_writer::
+    open (const filesystem::path& p)
+    {
+      return file_.open (p, magic, version);
+    }
+
+    void task_trace_writer::
+    write (uint8_t service_id,
+           uint8_t sub_function_id,
+           bool type_checking,
+           bool deferred,
+           span<const uint8_t> request,
+           size_t request_bits,
+           span<const uint8_t> reply,
+           size_t reply_bits)
+    {
+      size_t qn ((request_bits + 7) / 8);
+      size_t rn ((reply_bits + 7) / 8);
+
+      // The callers hand us whole buffers so this should always hold.
+      //
+      if (request.size () < qn || reply.size () < rn)
+        return;
+
+      file_.write (record_header_size + qn + rn, [&] (char* p)
+      {
+        p[0] = static_cast<char> (service_id);
+        p[1] = static_cast<char> (sub_function_id);
+        p[2] = static_cast<char> ((type_checking ? flag_type_checking : 0) |
+                                  (deferred ? flag_deferred : 0));
+        p[3] = 0;
+        store_le (p + 4, static_cast<uint32_t> (request_bits));
+        store_le (p + 8, static_cast<uint32_t> (reply_bits));
+
+        if (qn != 0)
+          memcpy (p + record_header_size, request.data (), qn);
+
+        if (rn != 0)
+          memcpy (p + record_header_size + qn, reply.data (), rn);
+      });
+    }
+
+    // task_trace_reader
+    //
+
+    bool task_trace_reader::
+    open (const filesystem::path& p)
+    {
+      return file_.open (p, magic, version);
+    }
+
+    bool task_trace_reader::
+    read (task_record& r)
+    {
+      uint8_t h[record_header_size];
+
+      if (!file_.read_header (h, sizeof (h)))
+        return false;
+
+      r.service_id = h[0];
+      r.sub_function_id = h[1];
+      r.type_checking = (h[2] & flag_type_checking) != 0;
+      r.deferred = (h[2] & flag_deferred) != 0;
+      r.request_bits = load_le<uint32_t> (h + 4);
+      r.reply_bits = load_le<uint32_t> (h + 8);
+
+      if (r.request_bits > max_bits || r.reply_bits > max_bits)
+      {
+        file_.fail ();
+        return false;
+      }
+
+      r.request.resize ((r.request_bits + 7) / 8);
+      r.reply.resize ((r.reply_bits + 7) / 8);
+
+      return file_.read (r.request.data (), r.request.size ()) &&
+             file_.read (r.reply.data (), r.reply.size ());
+    }
+  }
+}
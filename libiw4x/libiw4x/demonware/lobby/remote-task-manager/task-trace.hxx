@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include <libiw4x/record-file.hxx>
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    // DemonWare task trace.
+    //
+    // A trace is a sequence of records, each holding a request as the engine
+    // handed it to us and the reply its handler produced. It is written by
+    // remote_task_manager in the capture mode and read back by the dw-replay
+    // tool. It is a record file (see record-file.hxx) with the following
+    // records:
+    //
+    //   magic:  "IW4XDWT\0"
+    //   record: uint8(service) uint8(sub-function) uint8(flags) uint8(0)
+    //           uint32(request bits) uint32(reply bits)
+    //           request bytes, reply bytes
+    //
+    // All integers are little-endian and the number of bytes that follows is
+    // the corresponding bit count rounded up.
+    //
+    // Note that the reply is recorded as written by the handler, before any
+    // defaults are filled in, so that replaying the trace produces exactly the
+    // same bytes.
+    //
+    struct task_record
+    {
+      std::uint8_t service_id = 0;
+      std::uint8_t sub_function_id = 0;
+
+      bool type_checking = false; // Request has the type checking header bit.
+      bool deferred = false;      // Reply was produced via defer ().
+
+      std::vector<std::uint8_t> request;
+      std::size_t request_bits = 0;
+
+      std::vector<std::uint8_t> reply;
+      std::size_t reply_bits = 0;
+    };
+
+    class task_trace_writer
+    {
+    public:
+      // Create (or truncate) the trace file and write the header.
+      //
+      bool
+      open (const std::filesystem::path&);
+
+      bool
+      is_open () const {return file_.is_open ();}
+
+      // Append a record. Safe to call from multiple threads.
+      //
+      void
+      write (std::uint8_t service_id,
+             std::uint8_t sub_function_id,
+             bool type_checking,
+             bool deferred,
+             std::span<const std::uint8_t> request,
+             std::size_t request_bits,
+             std::span<const std::uint8_t> reply,
+             std::size_t reply_bits);
+
+    private:
+      record_file_writer file_;
+    };
+
+    class task_trace_reader
+    {
+    public:
+      // Open the trace and verify the header.
+      //
+      bool
+      open (const std::filesystem::path&);
+
+      // Read the next record. Return false at the end of the trace or if the
+      // record is truncated or malformed, in which case error () is true.
+      //
+      bool
+      read (task_record&);
+
+      bool
+      error () const {return file_.error ();}
+
+    private:
+      record_file_reader file_;
+    };
+  }
+}
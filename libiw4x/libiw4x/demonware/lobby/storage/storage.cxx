@@ -1,17 +1,30 @@
 #include <libiw4x/demonware/lobby/storage/storage.hxx>
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <libiw4x/demonware/core/containers/bit-buffer.hxx>
+#include <libiw4x/demonware/core/containers/schema.hxx>
+#include <libiw4x/demonware/lobby/auth-service.hxx>
 #include <libiw4x/demonware/lobby/remote-task-manager/remote-task-manager.hxx>
+#include <libiw4x/demonware/lobby/storage/user-store.hxx>
+#include <libiw4x/demonware/lobby/storage/write-behind.hxx>
 
 #include <libiw4x/logger.hxx>
+#include <libiw4x/scheduler.hxx>
 
 using namespace std;
+using namespace std::chrono;
 using namespace std::filesystem;
 
 namespace iw4x
@@ -45,19 +58,50 @@ namespace iw4x
 
       // Publisher file context.
       //
+      // The publisher file (playlists) is served from an immutable snapshot
+      // that replies encode straight from. The snapshot is replaced as a whole
+      // when the file changes on disk so that operators can push a new
+      // playlist without a restart; replies that are being built at the time
+      // hold on to the previous generation until they are done.
+      //
       constexpr const char* publisher_filename ("playlists.patch2");
 
-      vector<uint8_t> publisher_data;
-      bool publisher_loaded (false);
+      struct publisher_snapshot
+      {
+        vector<uint8_t> data;
+
+        // What the file looked like when we read it.
+        //
+        uintmax_t size;
+        file_time_type mtime;
+
+        uint64_t generation;
+      };
+
+      atomic<shared_ptr<const publisher_snapshot>> publisher;
+
+      // Set by a slow timer on the frame thread to have the next access check
+      // the file for changes. Starts out set so that the first access loads
+      // it.
+      //
+      constexpr seconds publisher_check_interval (5);
+
+      atomic<bool> publisher_stale (true);
+
+      // Serializes reloads.
+      //
+      mutex publisher_m;
 
       // User file context.
       //
       constexpr const char* user_file_dir ("players");
       constexpr const char* user_filename ("mpdata");
 
-      vector<uint8_t> user_data;
-      bool user_loaded (false);
-      bool user_exists (false);
+      // Upper bound on the memory taken by cached user files. A typical
+      // mpdata is around 8KB so this keeps a few thousand players warm,
+      // which is plenty for a busy dedicated server.
+      //
+      constexpr size_t user_cache_bytes (32 * 1024 * 1024);
 
       // Read a file into a byte vector.
       //
@@ -103,95 +147,119 @@ namespace iw4x
         return data;
       }
 
-      // Write a byte vector to a file.
+      // Uploaded files.
       //
-      // We ensure the parent directories exist before attempting to write.
-      // Return true on success so the caller knows if the cache should be
-      // updated safely.
+      // The game saves stats quite eagerly (after every match, on class
+      // changes, etc). Rather than hitting the disk every time, we keep the
+      // latest upload in memory and let a background thread write it out once
+      // things have calmed down.
       //
-      bool
-      write_file_data (const path& p,
-                       const uint8_t* data,
-                       size_t size,
-                       const char* label)
-      {
-        create_directories (p.parent_path ());
+      write_behind uploads (chrono::seconds (2));
 
-        ofstream f (p, ios::binary | ios::trunc);
+      // Per-user files, keyed by the auth ticket user ID.
+      //
+      user_store users (user_file_dir,
+                        user_filename,
+                        user_cache_bytes,
+                        uploads);
 
-        if (!f.write (reinterpret_cast<const char*> (data),
-                      static_cast<streamsize> (size)))
+      // Return the current publisher file snapshot, reloading it first if
+      // the timer says so and the file has changed since we last read it.
+      //
+      // Note that this may touch the disk and so should only be called from
+      // deferred work.
+      //
+      shared_ptr<const publisher_snapshot>
+      publisher_file ()
+      {
+        if (publisher_stale.exchange (false, memory_order_acq_rel))
         {
-          log::warning << "dw: storage: failed to write " << label << ": "
-                       << p.string ();
-          return false;
-        }
+          lock_guard<mutex> l (publisher_m);
 
-        log::info << "dw: storage: saved " << label << ": " << p.string ()
-                  << " (" << size << "B)";
+          shared_ptr<const publisher_snapshot> c (publisher.load ());
 
-        return true;
-      }
+          // Checking the size and modification time is a lot cheaper than
+          // reading the file. If either cannot be obtained, the file is most
+          // likely gone, which is a change in its own right.
+          //
+          error_code ec;
+          uintmax_t sz (file_size (publisher_filename, ec));
 
-      // The publisher file (playlists) is relatively static, so we only need
-      // to load it once from disk and then serve it from memory.
-      //
-      const vector<uint8_t>&
-      ensure_publisher_data ()
-      {
-        if (!publisher_loaded)
-        {
-          publisher_data =
-            read_file_data (publisher_filename, "publisher file");
-          publisher_loaded = true;
+          if (ec)
+            sz = 0;
+
+          file_time_type mt (last_write_time (publisher_filename, ec));
+
+          if (ec)
+            mt = file_time_type::min ();
+
+          if (c == nullptr || c->size != sz || c->mtime != mt)
+          {
+            auto n (make_shared<publisher_snapshot> ());
+
+            n->data = read_file_data (publisher_filename, "publisher file");
+            n->size = sz;
+            n->mtime = mt;
+            n->generation = c != nullptr ? c->generation + 1 : 1;
+
+            if (c != nullptr)
+              log::info << "dw: storage: " << publisher_filename
+                        << " changed, now at generation " << n->generation;
+
+            publisher.store (move (n));
+          }
         }
 
-        return publisher_data;
+        return publisher.load ();
       }
 
-      // Ensure the user data is loaded into memory.
+      // bdLobbyFileHeader.
       //
-      // Similar to publisher data, but tracks explicit existence state so we
-      // can gracefully handle new players who don't have files yet.
+      // The layout of this header is dictated by the bdBitBuffer wire format.
+      // We have to write these exact fields in this exact order, which the
+      // schema below takes care of. Note that everything up to the filename
+      // is fixed-size and so gets packed into whole words.
       //
-      void
-      ensure_user_data ()
+      struct lobby_file_header
       {
-        if (!user_loaded)
-        {
-          path p (path (user_file_dir) / user_filename);
-          user_data = read_file_data (p, "user file");
-          user_exists = !user_data.empty ();
-          user_loaded = true;
-        }
-      }
+        uint64_t    file_id;
+        uint32_t    file_size;
+        uint32_t    create_time;
+        bool        has_data;
+        bool        visibility;
+        uint64_t    owner_id;
+        const char* filename;
+      };
+
+      using lobby_file_header_schema =
+        schema<&lobby_file_header::file_id,
+               &lobby_file_header::file_size,
+               &lobby_file_header::create_time,
+               &lobby_file_header::has_data,
+               &lobby_file_header::visibility,
+               &lobby_file_header::owner_id,
+               &lobby_file_header::filename>;
+
+      static_assert (lobby_file_header_schema::fixed_bits ==
+                     (5 + 64) + 2 * (5 + 32) + 2 * (5 + 1) + (5 + 64));
 
       // Write a bdLobbyFileHeader into a reply bit_buffer_writer.
       //
-      // The layout of this header is dictated by the bdBitBuffer wire format.
-      // We have to write these exact fields in this exact order.
-      //
-      //  uint64(10) : file_id
-      //  uint32(8)  : file_size
-      //  uint32(8)  : create_time
-      //  bool(1)    : has_data
-      //  bool(1)    : visibility
-      //  uint64(10) : owner_id
-      //  string(16) : filename
-      //
       void
       write_file_header (bit_buffer_writer& reply,
                          uint64_t file_id,
                          uint32_t file_size,
                          const char* filename)
       {
-        reply.write_uint64 (file_id);
-        reply.write_uint32 (file_size);
-        reply.write_uint32 (0); // create_time
-        reply.write_bool (true); // has_data
-        reply.write_bool (false); // visibility
-        reply.write_uint64 (0); // owner_id
-        reply.write_string (filename);
+        lobby_file_header_schema::encode (reply,
+                                          lobby_file_header {
+                                            .file_id     = file_id,
+                                            .file_size   = file_size,
+                                            .create_time = 0,
+                                            .has_data    = true,
+                                            .visibility  = false,
+                                            .owner_id    = 0,
+                                            .filename    = filename});
       }
 
       // Handle a bdStorage request.
@@ -201,6 +269,13 @@ namespace iw4x
       // even if the requested file itself was not found. Returning false would
       // drop the connection.
       //
+      // Reads that may end up touching the disk are deferred to the
+      // background executor so that the frame does not wait on I/O. Since the
+      // request buffer is gone by the time the deferred work runs, we parse
+      // it here and hand over owned copies. The file caches above are safe
+      // to use from any thread. Writes go through the write-behind queue and
+      // complete right away.
+      //
       bool
       storage_handler (uint8_t service_id,
                        uint8_t sub_function_id,
@@ -220,28 +295,32 @@ namespace iw4x
           //
           case sub_get_publisher_file_info:
           {
-            auto& data (ensure_publisher_data ());
-
-            if (data.empty ())
+            remote_task_manager::defer ([] (bit_buffer_writer& reply)
             {
-              log::warning << "dw: storage: publisher file not available";
-              reply.write_uint32 (0);
-              reply.write_uint8 (0);
-              return true;
-            }
+              auto pf (publisher_file ());
+              const vector<uint8_t>& data (pf->data);
+
+              if (data.empty ())
+              {
+                log::warning << "dw: storage: publisher file not available";
+                reply.write_uint32 (0);
+                reply.write_uint8 (0);
+                return;
+              }
 
-            auto file_size (static_cast<uint32_t> (data.size ()));
+              auto file_size (static_cast<uint32_t> (data.size ()));
 
-            log::info << "dw: storage: getPublisherFileInfo -> "
-                      << publisher_filename << " (" << file_size << "B)";
+              log::info << "dw: storage: getPublisherFileInfo -> "
+                        << publisher_filename << " (" << file_size << "B)";
 
-            reply.write_uint32 (0);
-            reply.write_uint8 (1);
-            reply.write_uint32 (file_size);
-            write_file_header (reply,
-                               publisher_file_id,
-                               file_size,
-                               publisher_filename);
+              reply.write_uint32 (0);
+              reply.write_uint8 (1);
+              reply.write_uint32 (file_size);
+              write_file_header (reply,
+                                 publisher_file_id,
+                                 file_size,
+                                 publisher_filename);
+            });
 
             return true;
           }
@@ -255,27 +334,32 @@ namespace iw4x
           //
           case sub_get_user_file:
           {
-            ensure_user_data ();
+            uint64_t user_id (auth_service::ticket ().user_id);
 
-            if (!user_exists)
+            remote_task_manager::defer ([user_id] (bit_buffer_writer& reply)
             {
-              log::info << "dw: storage: getUserFile -> " << user_filename
-                        << " (not found, using defaults)";
+              auto uf (users.load (user_id));
 
-              reply.write_uint32 (0);
-              reply.write_uint8 (0);
-              return true;
-            }
+              if (!uf->exists)
+              {
+                log::info << "dw: storage: getUserFile -> " << user_filename
+                          << " (not found, using defaults)";
 
-            auto file_size (static_cast<uint32_t> (user_data.size ()));
+                reply.write_uint32 (0);
+                reply.write_uint8 (0);
+                return;
+              }
 
-            log::info << "dw: storage: getUserFile -> " << user_filename << " ("
-                      << file_size << "B)";
+              auto file_size (static_cast<uint32_t> (uf->data.size ()));
 
-            reply.write_uint32 (0);
-            reply.write_uint8 (1);
-            reply.write_uint32 (file_size);
-            write_file_header (reply, user_file_id, file_size, user_filename);
+              log::info << "dw: storage: getUserFile -> " << user_filename
+                        << " (" << file_size << "B)";
+
+              reply.write_uint32 (0);
+              reply.write_uint8 (1);
+              reply.write_uint32 (file_size);
+              write_file_header (reply, user_file_id, file_size, user_filename);
+            });
 
             return true;
           }
@@ -302,59 +386,70 @@ namespace iw4x
 
             log::trace_l1 << "dw: storage: getFile file_id=" << file_id;
 
-            if (file_id == user_file_id)
+            uint64_t user_id (auth_service::ticket ().user_id);
+
+            remote_task_manager::defer ([file_id, user_id]
+                                        (bit_buffer_writer& reply)
             {
-              ensure_user_data ();
+              if (file_id == user_file_id)
+              {
+                auto uf (users.load (user_id));
+                const vector<uint8_t>& data (uf->data);
+
+                if (!uf->exists || data.empty ())
+                {
+                  log::warning
+                    << "dw: storage: user file not available for download";
+                  reply.write_uint32 (0);
+                  reply.write_uint8 (0);
+                  return;
+                }
+
+                auto file_size (static_cast<uint32_t> (data.size ()));
+
+                log::info << "dw: storage: getFile -> " << user_filename
+                          << " (" << file_size << "B)";
+
+                reply.write_uint32 (0);
+                reply.write_uint8 (1);
+                reply.write_uint32 (file_size);
+                write_file_header (reply,
+                                   user_file_id,
+                                   file_size,
+                                   user_filename);
+                reply.write_blob (data.data (), data.size ());
+                return;
+              }
 
-              if (!user_exists || user_data.empty ())
+              // Default route. We assume the game wants the publisher
+              // playlists.
+              //
+              auto pf (publisher_file ());
+              const vector<uint8_t>& data (pf->data);
+
+              if (data.empty ())
               {
                 log::warning
-                  << "dw: storage: user file not available for download";
+                  << "dw: storage: publisher file not available for download";
                 reply.write_uint32 (0);
                 reply.write_uint8 (0);
-                return true;
+                return;
               }
 
-              auto file_size (static_cast<uint32_t> (user_data.size ()));
+              auto file_size (static_cast<uint32_t> (data.size ()));
 
-              log::info << "dw: storage: getFile -> " << user_filename << " ("
-                        << file_size << "B)";
+              log::info << "dw: storage: getFile -> " << publisher_filename
+                        << " (" << file_size << "B)";
 
               reply.write_uint32 (0);
               reply.write_uint8 (1);
               reply.write_uint32 (file_size);
-              write_file_header (reply, user_file_id, file_size, user_filename);
-              reply.write_blob (user_data.data (), user_data.size ());
-
-              return true;
-            }
-
-            // Default route. We assume the game wants the publisher playlists.
-            //
-            auto& data (ensure_publisher_data ());
-
-            if (data.empty ())
-            {
-              log::warning
-                << "dw: storage: publisher file not available for download";
-              reply.write_uint32 (0);
-              reply.write_uint8 (0);
-              return true;
-            }
-
-            auto file_size (static_cast<uint32_t> (data.size ()));
-
-            log::info << "dw: storage: getFile -> " << publisher_filename
-                      << " (" << file_size << "B)";
-
-            reply.write_uint32 (0);
-            reply.write_uint8 (1);
-            reply.write_uint32 (file_size);
-            write_file_header (reply,
-                               publisher_file_id,
-                               file_size,
-                               publisher_filename);
-            reply.write_blob (data.data (), data.size ());
+              write_file_header (reply,
+                                 publisher_file_id,
+                                 file_size,
+                                 publisher_filename);
+              reply.write_blob (data.data (), data.size ());
+            });
 
             return true;
           }
@@ -365,18 +460,26 @@ namespace iw4x
           // byte(0) + bool(vis) + string(filename, no null) +
           // raw_byte(0x00, no type tag) + bool(vis2) + blob(file_data).
           //
-          // Notice that our read_string() implementation automatically consumes
-          // the raw 0x00 as the null terminator, so no manual skipping is
-          // needed here.
+          // Notice that our read_string_view() implementation automatically
+          // consumes the raw 0x00 as the null terminator, so no manual
+          // skipping is needed here.
+          //
+          // We read the filename and the payload as views and make a single
+          // copy of the payload for the write-behind queue. If they are not
+          // byte-aligned in the request, they get shifted into the stack
+          // buffer below first.
           //
           case sub_set_file:
           {
+            uint8_t scratch_buf[256];
+            arena scratch (scratch_buf);
+
             uint8_t pad;
             bool vis;
-            string filename;
+            string_view filename;
 
             if (!request.read_uint8 (pad) || !request.read_bool (vis) ||
-                !request.read_string (filename, 127))
+                !request.read_string_view (filename, 127, scratch))
             {
               log::warning << "dw: storage: setFile parse error (header)";
               reply.write_uint32 (0);
@@ -385,9 +488,10 @@ namespace iw4x
             }
 
             bool vis2;
-            vector<uint8_t> blob;
+            span<const uint8_t> blob;
 
-            if (!request.read_bool (vis2) || !request.read_blob (blob))
+            if (!request.read_bool (vis2) ||
+                !request.read_blob_span (blob, scratch))
             {
               log::warning << "dw: storage: setFile parse error (blob)";
               reply.write_uint32 (0);
@@ -398,9 +502,8 @@ namespace iw4x
             log::info << "dw: storage: setFile \"" << filename << "\" ("
                       << blob.size () << "B)";
 
-            path p (path (user_file_dir) / filename);
-
-            write_file_data (p, blob.data (), blob.size (), filename.c_str ());
+            uploads.put (path (user_file_dir) / filename,
+                         vector<uint8_t> (blob.begin (), blob.end ()));
 
             reply.write_uint32 (0);
             reply.write_uint8 (0);
@@ -412,9 +515,13 @@ namespace iw4x
           // The wire format (from reversing 0x14031F820) is relatively simple:
           // byte(0) + uint64(owner_id) + blob(file_data).
           //
-          // We write the file to disk and, importantly, update our in-memory
-          // cache so that any subsequent reads in this session reflect the
-          // newly saved data.
+          // The file is stored under the auth ticket's user ID, the same key
+          // getUserFile and getFile look it up with. We don't know of a case
+          // where the owner legitimately differs from it (it is normally
+          // either the same or 0) so if it does, we log it rather than fork
+          // the player's stats into a file that is never read back. The store
+          // updates its cache right away so that a following getUserFile sees
+          // the new data whether or not it is on disk yet.
           //
           case sub_set_user_file:
           {
@@ -434,14 +541,14 @@ namespace iw4x
             log::info << "dw: storage: setUserFile owner=" << owner_id
                       << " size=" << blob.size ();
 
-            path p (path (user_file_dir) / user_filename);
+            uint64_t user_id (auth_service::ticket ().user_id);
 
-            if (write_file_data (p, blob.data (), blob.size (), "user file"))
-            {
-              user_data = move (blob);
-              user_exists = true;
-              user_loaded = true;
-            }
+            if (owner_id != 0 && owner_id != user_id)
+              log::warning << "dw: storage: setUserFile owner " << owner_id
+                           << " does not match ticket user " << user_id
+                           << ", storing under the latter";
+
+            users.store (user_id, move (blob));
 
             reply.write_uint32 (0);
             reply.write_uint8 (0);
@@ -465,8 +572,35 @@ namespace iw4x
       remote_task_manager::register_handler (storage_service_id,
                                              &storage_handler);
 
+      // Pick up the file saved before user files were stored per user.
+      //
+      users.legacy_path (auth_service::ticket ().user_id,
+                         path (user_file_dir) / user_filename);
+
+      // Have the publisher file checked for changes every now and then.
+      //
+      scheduler::post (com_frame_domain,
+                       []
+      {
+        static steady_clock::time_point next;
+
+        auto now (steady_clock::now ());
+
+        if (now >= next)
+        {
+          publisher_stale.store (true, memory_order_release);
+          next = now + publisher_check_interval;
+        }
+      }, repeat_every_tick);
+
       log::info << "dw: storage service registered (id="
                 << static_cast<int> (storage_service_id) << ")";
     }
+
+    void storage::
+    shutdown ()
+    {
+      uploads.shutdown ();
+    }
   }
 }
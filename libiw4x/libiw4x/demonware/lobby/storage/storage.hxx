@@ -23,6 +23,12 @@ namespace iw4x
     {
     public:
       storage ();
+
+      // Write out the uploaded files that are still pending. Call on the way
+      // out while the process is still intact (see mod-demonware.cxx).
+      //
+      static void
+      shutdown ();
     };
   }
 }
@@ -0,0 +1,232 @@
+#include <libiw4x/demonware/lobby/storage/user-store.hxx>
+
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+
+#include <libiw4x/logger.hxx>
+
+using namespace std;
+using namespace std::filesystem;
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    namespace
+    {
+      // Read the file returning NULL if it does not exist or could not be
+      // read.
+      //
+      unique_ptr<vector<uint8_t>>
+      read_file (const path& p)
+      {
+        error_code ec;
+        auto size (file_size (p, ec));
+
+        if (ec)
+          return nullptr;
+
+        auto r (make_unique<vector<uint8_t>> (static_cast<size_t> (size)));
+        ifstream f (p, ios::binary);
+
+        if (!f.read (reinterpret_cast<char*> (r->data ()),
+                     static_cast<streamsize> (size)))
+        {
+          log::warning << "dw: storage: failed to read " << p.string ();
+          return nullptr;
+        }
+
+        return r;
+      }
+    }
+
+    user_store::
+    user_store (path r, const char* n, size_t m, write_behind& w)
+      : root_ (move (r)), name_ (n), max_bytes_ (m), writer_ (w)
+    {
+    }
+
+    void user_store::
+    legacy_path (uint64_t id, path p)
+    {
+      lock_guard<mutex> l (m_);
+
+      legacy_id_ = id;
+      legacy_path_ = move (p);
+    }
+
+    path user_store::
+    file_path (uint64_t id) const
+    {
+      char d[17];
+      snprintf (d, sizeof (d), "%016llx", static_cast<unsigned long long> (id));
+
+      return root_ / (d + 14) / d / name_;
+    }
+
+    shared_ptr<const user_file> user_store::
+    load (uint64_t id)
+    {
+      promise<file_ptr> p;
+
+      {
+        unique_lock<mutex> l (m_);
+
+        if (auto i (index_.find (id)); i != index_.end ())
+        {
+          lru_.splice (lru_.begin (), lru_, i->second);
+          ++hits_;
+          return i->second->file;
+        }
+
+        // If someone is already loading this user, wait for their result
+        // rather than going to the disk ourselves. Note that we can't wait
+        // while holding the lock since the loader needs it to publish the
+        // result.
+        //
+        if (auto i (loading_.find (id)); i != loading_.end ())
+        {
+          shared_future<file_ptr> f (i->second);
+          ++shared_;
+
+          l.unlock ();
+          return f.get ();
+        }
+
+        loading_.emplace (id, p.get_future ().share ());
+        ++misses_;
+      }
+
+      file_ptr r (read (id));
+
+      {
+        lock_guard<mutex> l (m_);
+
+        // Note that a store () may have happened while we were reading in
+        // which case its entry is newer than what we have read.
+        //
+        if (auto i (index_.find (id)); i != index_.end ())
+          r = i->second->file;
+        else
+          insert (id, r);
+
+        loading_.erase (id);
+      }
+
+      p.set_value (r);
+      return r;
+    }
+
+    void user_store::
+    store (uint64_t id, vector<uint8_t> d)
+    {
+      path p (file_path (id));
+
+      // Note that the write-behind queue makes its own copy which it keeps
+      // until the data is on disk.
+      //
+      writer_.put (p, d);
+
+      auto f (make_shared<user_file> ());
+      f->exists = true;
+      f->data = move (d);
+
+      lock_guard<mutex> l (m_);
+      insert (id, move (f));
+    }
+
+    user_store_stats user_store::
+    statistics () const
+    {
+      lock_guard<mutex> l (m_);
+
+      return user_store_stats {hits_,
+                               misses_,
+                               shared_,
+                               evictions_,
+                               index_.size (),
+                               bytes_,
+                               writer_.bytes ()};
+    }
+
+    user_store::file_ptr user_store::
+    read (uint64_t id)
+    {
+      path p (file_path (id));
+
+      auto r (make_shared<user_file> ());
+      r->exists = false;
+
+      // A pending write is always newer than what's on disk.
+      //
+      if (auto d = writer_.get (p))
+      {
+        r->exists = true;
+        r->data = *d;
+        return r;
+      }
+
+      auto d (read_file (p));
+
+      if (d == nullptr)
+      {
+        path lp;
+        {
+          lock_guard<mutex> l (m_);
+
+          if (id == legacy_id_)
+            lp = legacy_path_;
+        }
+
+        if (!lp.empty () && (d = read_file (lp)) != nullptr)
+          log::info << "dw: storage: using legacy " << lp.string ()
+                    << " for user " << id;
+      }
+
+      if (d != nullptr)
+      {
+        r->exists = true;
+        r->data = move (*d);
+
+        log::trace_l1 << "dw: storage: loaded user " << id << " ("
+                      << r->data.size () << "B)";
+      }
+
+      return r;
+    }
+
+    void user_store::
+    insert (uint64_t id, file_ptr f)
+    {
+      if (auto i (index_.find (id)); i != index_.end ())
+      {
+        bytes_ -= i->second->file->data.size ();
+        lru_.erase (i->second);
+        index_.erase (i);
+      }
+
+      bytes_ += f->data.size ();
+      lru_.push_front (node {id, move (f)});
+      index_.emplace (id, lru_.begin ());
+
+      // Evict from the back but never the entry we have just inserted, even
+      // if on its own it is over the limit. Note that the write-behind queue
+      // only lets go of its data once it is on disk, so there is nothing we
+      // can do about its share.
+      //
+      size_t q (writer_.bytes ());
+
+      while (bytes_ + q > max_bytes_ && lru_.size () > 1)
+      {
+        node& n (lru_.back ());
+
+        bytes_ -= n.file->data.size ();
+        index_.erase (n.user_id);
+        lru_.pop_back ();
+
+        ++evictions_;
+      }
+    }
+  }
+}
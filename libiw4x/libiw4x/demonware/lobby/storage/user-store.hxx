@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <libiw4x/demonware/lobby/storage/write-behind.hxx>
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    // Per-user storage file.
+    //
+    // Note that a user without a file on disk is represented by an entry that
+    // does not exist rather than by the lack of an entry, so that repeated
+    // lookups for new players do not go to the disk every time.
+    //
+    struct user_file
+    {
+      bool exists;
+      std::vector<std::uint8_t> data;
+    };
+
+    struct user_store_stats
+    {
+      std::uint64_t hits;
+      std::uint64_t misses;    // Loaded from disk (or the write queue).
+      std::uint64_t shared;    // Waited for a load already in progress.
+      std::uint64_t evictions;
+      std::size_t   entries;
+      std::size_t   bytes;
+      std::size_t   pending;   // Held by the write-behind queue.
+    };
+
+    // Multi-tenant user file store.
+    //
+    // Files are keyed by the DemonWare user ID and laid out on disk as
+    //
+    //   <root>/<xx>/<id>/<name>
+    //
+    // where <id> is the 16-digit hex user ID and <xx> its last two digits,
+    // which keeps the directories reasonably small with many players.
+    //
+    // Recently used files are kept in memory in an LRU cache bounded by the
+    // total size of the data. The data still held by the write-behind queue
+    // counts against the same bound since, until it is on disk, a stored
+    // file is in memory twice. If several threads ask for the same user that
+    // is not cached, only one of them goes to the disk and the rest wait for
+    // its result. Writes update the cache and go to disk via the write-behind
+    // queue; loads consult the queue first so an evicted file whose write is
+    // still pending is not read back stale.
+    //
+    class user_store
+    {
+    public:
+      user_store (std::filesystem::path root,
+                  const char* name,
+                  std::size_t max_bytes,
+                  write_behind&);
+
+      user_store (const user_store&) = delete;
+      user_store& operator = (const user_store&) = delete;
+
+      // Fall back to the specified path when loading the file for this user
+      // and it does not exist in the store. This is used to pick up the file
+      // saved by the single-user layout.
+      //
+      void
+      legacy_path (std::uint64_t user_id, std::filesystem::path);
+
+      std::shared_ptr<const user_file>
+      load (std::uint64_t user_id);
+
+      void
+      store (std::uint64_t user_id, std::vector<std::uint8_t>);
+
+      user_store_stats
+      statistics () const;
+
+      std::filesystem::path
+      file_path (std::uint64_t user_id) const;
+
+    private:
+      using file_ptr = std::shared_ptr<const user_file>;
+
+      file_ptr
+      read (std::uint64_t user_id);
+
+      // Insert or replace the cached entry and evict as necessary. Must be
+      // called with the lock held.
+      //
+      void
+      insert (std::uint64_t user_id, file_ptr);
+
+      struct node
+      {
+        std::uint64_t user_id;
+        file_ptr file;
+      };
+
+      const std::filesystem::path root_;
+      const char* name_;
+      const std::size_t max_bytes_;
+      write_behind& writer_;
+
+      std::uint64_t legacy_id_ = 0;
+      std::filesystem::path legacy_path_;
+
+      mutable std::mutex m_;
+
+      // Most recently used first.
+      //
+      std::list<node> lru_;
+      std::unordered_map<std::uint64_t, std::list<node>::iterator> index_;
+      std::size_t bytes_ = 0;
+
+      std::unordered_map<std::uint64_t, std::shared_future<file_ptr>> loading_;
+
+      std::uint64_t hits_ = 0;
+      std::uint64_t misses_ = 0;
+      std::uint64_t shared_ = 0;
+      std::uint64_t evictions_ = 0;
+    };
+  }
+}
@@ -0,0 +1,297 @@
+#include <libiw4x/demonware/lobby/storage/write-behind.hxx>
+
+#include <algorithm>
+#include <system_error>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <libiw4x/logger.hxx>
+
+using namespace std;
+using namespace std::filesystem;
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    namespace
+    {
+      // Write the data to a new file and flush it all the way to the disk
+      // (not just out of our buffers). Otherwise, after a power loss or an OS
+      // crash, the file we rename it to could turn out empty or truncated.
+      //
+#ifdef _WIN32
+      bool
+      write_synced (const path& p, const vector<uint8_t>& d)
+      {
+        HANDLE h (CreateFileW (p.c_str (),
+                               GENERIC_WRITE,
+                               0,
+                               nullptr,
+                               CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL,
+                               nullptr));
+
+        if (h == INVALID_HANDLE_VALUE)
+          return false;
+
+        bool r (true);
+
+        for (size_t o (0); r && o != d.size (); )
+        {
+          DWORD n (static_cast<DWORD> (min<size_t> (d.size () - o, 1 << 30)));
+          DWORD w (0);
+
+          r = WriteFile (h, d.data () + o, n, &w, nullptr) && w != 0;
+          o += w;
+        }
+
+        r = r && FlushFileBuffers (h);
+        return CloseHandle (h) && r;
+      }
+#else
+      bool
+      write_synced (const path& p, const vector<uint8_t>& d)
+      {
+        int f (open (p.c_str (),
+                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644));
+
+        if (f == -1)
+          return false;
+
+        bool r (true);
+
+        for (size_t o (0); r && o != d.size (); )
+        {
+          ssize_t w (write (f, d.data () + o, d.size () - o));
+
+          if (w > 0)
+            o += static_cast<size_t> (w);
+          else
+            r = w == -1 && errno == EINTR;
+        }
+
+        r = r && fsync (f) == 0;
+        return close (f) == 0 && r;
+      }
+#endif
+    }
+
+    write_behind::
+    write_behind (chrono::milliseconds w)
+      : window_ (w)
+    {
+    }
+
+    write_behind::
+    ~write_behind ()
+    {
+      shutdown ();
+    }
+
+    void write_behind::
+    put (const path& p, vector<uint8_t> d)
+    {
+      lock_guard<mutex> l (m_);
+
+      entry& e (files_[p]);
+
+      // Note that we only push the deadline out when the entry goes from
+      // clean to dirty. Otherwise, a file that is updated more often than
+      // the window would never be written.
+      //
+      if (!e.dirty)
+      {
+        e.dirty = true;
+        e.due = clock::now () + window_;
+      }
+
+      if (e.data != nullptr)
+        bytes_ -= e.data->size ();
+
+      bytes_ += d.size ();
+      e.data = make_shared<const vector<uint8_t>> (move (d));
+
+      changed_ = true;
+
+      if (!thread_.joinable () && !stopped_)
+        thread_ = jthread ([this] (stop_token st) {run (st);});
+
+      cv_.notify_one ();
+    }
+
+    shared_ptr<const vector<uint8_t>> write_behind::
+    get (const path& p) const
+    {
+      lock_guard<mutex> l (m_);
+
+      auto i (files_.find (p));
+      return i != files_.end () ? i->second.data : nullptr;
+    }
+
+    void write_behind::
+    flush ()
+    {
+      unique_lock<mutex> l (m_);
+      write_pending (l, true);
+    }
+
+    size_t write_behind::
+    bytes () const
+    {
+      lock_guard<mutex> l (m_);
+      return bytes_;
+    }
+
+    void write_behind::
+    shutdown ()
+    {
+      {
+        lock_guard<mutex> l (m_);
+        stopped_ = true;
+      }
+
+      // Note that with stopped_ set put () no longer starts the thread so we
+      // can look at it without the lock.
+      //
+      if (thread_.joinable ())
+      {
+        thread_.request_stop ();
+        thread_.join ();
+      }
+
+      flush ();
+    }
+
+    void write_behind::
+    run (stop_token st)
+    {
+      unique_lock<mutex> l (m_);
+
+      while (!st.stop_requested ())
+      {
+        // Sleep until the earliest deadline or until something changes.
+        //
+        clock::time_point t (clock::time_point::max ());
+
+        for (const auto& [p, e] : files_)
+          if (e.dirty && e.due < t)
+            t = e.due;
+
+        auto changed ([this] {return changed_;});
+
+        if (t == clock::time_point::max ())
+          cv_.wait (l, st, changed);
+        else
+          cv_.wait_until (l, st, t, changed);
+
+        changed_ = false;
+
+        if (!st.stop_requested ())
+          write_pending (l, false);
+      }
+    }
+
+    void write_behind::
+    write_pending (unique_lock<mutex>& l, bool force)
+    {
+      auto now (clock::now ());
+
+      vector<pair<path, data_ptr>> ws;
+
+      for (auto& [p, e] : files_)
+      {
+        if (e.dirty && (force || e.due <= now))
+        {
+          ws.emplace_back (p, e.data);
+          e.dirty = false;
+        }
+      }
+
+      if (ws.empty ())
+        return;
+
+      l.unlock ();
+
+      vector<bool> written;
+      written.reserve (ws.size ());
+
+      for (const auto& [p, d] : ws)
+        written.push_back (write_file (p, *d));
+
+      l.lock ();
+
+      for (size_t i (0); i != ws.size (); ++i)
+      {
+        const auto& [p, d] (ws[i]);
+
+        // If the file has been updated in the meantime, then it is either
+        // dirty again or being written with the newer data by someone else
+        // and there is nothing for us to do.
+        //
+        auto j (files_.find (p));
+
+        if (j == files_.end () || j->second.dirty || j->second.data != d)
+          continue;
+
+        entry& e (j->second);
+
+        // Once written, the data is on disk and we no longer need to hold
+        // on to it. Otherwise, retry after another window.
+        //
+        if (written[i])
+        {
+          bytes_ -= d->size ();
+          files_.erase (j);
+        }
+        else
+        {
+          e.dirty = true;
+          e.due = clock::now () + window_;
+        }
+      }
+    }
+
+    bool write_behind::
+    write_file (const path& p, const vector<uint8_t>& d)
+    {
+      error_code ec;
+      create_directories (p.parent_path (), ec);
+
+      path t (p);
+      t += ".tmp";
+
+      if (!write_synced (t, d))
+      {
+        log::warning << "dw: storage: failed to write " << t.string ();
+        return false;
+      }
+
+      // Note that rename replaces the target atomically.
+      //
+      rename (t, p, ec);
+
+      if (ec)
+      {
+        log::warning << "dw: storage: failed to replace " << p.string ()
+                     << ": " << ec.message ();
+        return false;
+      }
+
+      log::info << "dw: storage: saved " << p.string () << " (" << d.size ()
+                << "B)";
+
+      return true;
+    }
+  }
+}
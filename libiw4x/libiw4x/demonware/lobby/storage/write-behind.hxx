@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace iw4x
+{
+  namespace demonware
+  {
+    // Write-behind file persistence.
+    //
+    // put () records the new contents of a file in memory and returns
+    // immediately. The actual write happens on a background thread once the
+    // file has been left alone for the coalescing window, so a burst of
+    // uploads of the same file results in a single write of the last one.
+    //
+    // Files are written crash-safe: the data goes to a temporary file next
+    // to the target which is then renamed over it. A crash at any point thus
+    // leaves either the old or the new contents, never a truncated file.
+    //
+    // The data is only held until it is on disk, so the memory used is
+    // bounded by what is uploaded within a window rather than by everything
+    // ever uploaded.
+    //
+    // Anything still pending is written by shutdown (), which should be
+    // called on the way out while the process is still intact. The
+    // destructor does the same as a last resort.
+    //
+    class write_behind
+    {
+    public:
+      explicit
+      write_behind (std::chrono::milliseconds window);
+
+      ~write_behind ();
+
+      write_behind (const write_behind&) = delete;
+      write_behind& operator = (const write_behind&) = delete;
+
+      void
+      put (const std::filesystem::path&, std::vector<std::uint8_t>);
+
+      // Return the contents last put () for the file if they are not yet on
+      // disk and NULL otherwise.
+      //
+      std::shared_ptr<const std::vector<std::uint8_t>>
+      get (const std::filesystem::path&) const;
+
+      // Write all pending files right away (on the calling thread).
+      //
+      void
+      flush ();
+
+      // Total size of the data currently held, that is, not yet on disk.
+      //
+      std::size_t
+      bytes () const;
+
+      // Stop the background thread and flush. Files put () afterwards are
+      // only written by another flush () or shutdown ().
+      //
+      void
+      shutdown ();
+
+    private:
+      using clock = std::chrono::steady_clock;
+      using data_ptr = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+      struct entry
+      {
+        data_ptr data;
+        bool dirty = false;
+        clock::time_point due;
+      };
+
+      void
+      run (std::stop_token);
+
+      // Write the due (or all if force is true) dirty entries. Must be
+      // called with the lock held, which is released during the I/O.
+      //
+      void
+      write_pending (std::unique_lock<std::mutex>&, bool force);
+
+      static bool
+      write_file (const std::filesystem::path&,
+                  const std::vector<std::uint8_t>&);
+
+    private:
+      const std::chrono::milliseconds window_;
+
+      mutable std::mutex m_;
+      std::condition_variable_any cv_;
+      std::map<std::filesystem::path, entry> files_;
+      bool changed_ = false;
+      bool stopped_ = false;
+      std::size_t bytes_ = 0;
+
+      // Started on the first put () rather than during static
+      // initialization.
+      //
+      std::jthread thread_;
+    };
+  }
+}
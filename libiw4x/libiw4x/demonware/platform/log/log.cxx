@@ -1,8 +1,14 @@
 #include <libiw4x/demonware/platform/log/log.hxx>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdarg>
 #include <cstdio>
 #include <cassert>
+#include <format>
+#include <map>
+#include <mutex>
 
 #include <libiw4x/logger.hxx>
 
@@ -12,6 +18,171 @@ namespace iw4x
 {
   namespace demonware
   {
+    namespace
+    {
+      // Channel table.
+      //
+      // Open addressing with linear probing over a power-of-two number of
+      // slots. bdNet only logs to a few dozen distinct channels so we never
+      // expect to get anywhere near the capacity, but if we do, the overflow
+      // channels simply fall back to the default policy without counters.
+      //
+      constexpr size_t channel_slots (512);
+
+      struct channel_slot
+      {
+        // Hash of the (base_channel, channel) pair, 0 if the slot is free.
+        //
+        // The remaining fields are filled in before the key is published
+        // (release) and are only read after it is observed (acquire).
+        //
+        atomic<uint64_t> key {0};
+
+        // Note that we keep the pointers the engine handed us on first sight.
+        // They refer to string literals in the executable's data section and
+        // therefore outlive us.
+        //
+        const char* base_channel {nullptr};
+        const char* channel {nullptr};
+
+        atomic<bd_log_channel_mode> mode {bd_log_channel_mode::inherit};
+        atomic<uint64_t> hits {0};
+        atomic<uint64_t> forwarded {0};
+      };
+
+      array<channel_slot, channel_slots> channels;
+
+      // Serializes slot insertion and override updates. Neither is on the hot
+      // path: insertion happens once per channel and overrides are set by the
+      // operator.
+      //
+      mutex channels_m;
+
+      // Operator-supplied overrides keyed by (base_channel, channel). An empty
+      // channel component acts as a wildcard for the base channel.
+      //
+      map<string, bd_log_channel_mode, less<>> overrides;
+
+      string
+      override_key (string_view b, string_view c)
+      {
+        string r;
+        r.reserve (b.size () + c.size () + 1);
+        r.append (b);
+        r.push_back ('\0');
+        r.append (c);
+        return r;
+      }
+
+      uint64_t
+      channel_key (const char* b, const char* c)
+      {
+        // FNV-1a over both names with a separator in between so that, say,
+        // ("ab", "c") and ("a", "bc") do not collide.
+        //
+        uint64_t h (0xcbf29ce484222325ULL);
+
+        auto mix ([&h] (const char* p)
+        {
+          for (; *p != '\0'; ++p)
+          {
+            h ^= static_cast<unsigned char> (*p);
+            h *= 0x100000001b3ULL;
+          }
+        });
+
+        mix (b);
+        h ^= 0xff;
+        h *= 0x100000001b3ULL;
+        mix (c);
+
+        // Reserve 0 for free slots.
+        //
+        return h != 0 ? h : 1;
+      }
+
+      // Resolve the effective mode for a channel. Must be called with
+      // channels_m held.
+      //
+      bd_log_channel_mode
+      resolve_mode (string_view b, string_view c)
+      {
+        auto i (overrides.find (override_key (b, c)));
+
+        if (i == overrides.end ())
+          i = overrides.find (override_key (b, ""));
+
+        return i != overrides.end ()
+               ? i->second
+               : bd_log_channel_mode::inherit;
+      }
+
+      channel_slot*
+      find_channel (const char* b, const char* c)
+      {
+        const uint64_t k (channel_key (b, c));
+        const size_t m (channel_slots - 1);
+
+        // Fast path: probe without taking the lock. We stop at the first free
+        // slot since slots are never released.
+        //
+        for (size_t n (0), i (k & m); n != channel_slots; ++n, i = (i + 1) & m)
+        {
+          uint64_t sk (channels[i].key.load (memory_order_acquire));
+
+          if (sk == k)
+            return &channels[i];
+
+          if (sk == 0)
+            break;
+        }
+
+        // Slow path: first time we see this channel. Re-probe under the lock
+        // since someone else may have inserted it (or something else into our
+        // free slot) in the meantime.
+        //
+        lock_guard<mutex> l (channels_m);
+
+        for (size_t n (0), i (k & m); n != channel_slots; ++n, i = (i + 1) & m)
+        {
+          channel_slot& s (channels[i]);
+          uint64_t sk (s.key.load (memory_order_relaxed));
+
+          if (sk == k)
+            return &s;
+
+          if (sk == 0)
+          {
+            s.base_channel = b;
+            s.channel = c;
+            s.mode.store (resolve_mode (b, c), memory_order_relaxed);
+            s.key.store (k, memory_order_release);
+            return &s;
+          }
+        }
+
+        return nullptr;
+      }
+
+      bool
+      should_forward (const channel_slot* s)
+      {
+        switch (s != nullptr
+                ? s->mode.load (memory_order_relaxed)
+                : bd_log_channel_mode::inherit)
+        {
+          case bd_log_channel_mode::enabled:  return true;
+          case bd_log_channel_mode::disabled: return false;
+          case bd_log_channel_mode::inherit:  break;
+        }
+
+        if constexpr (log::min_level > log::level::trace_l3)
+          return false;
+        else
+          return log::detail::should_log_statement (log::level::trace_l3);
+      }
+    }
+
     void
     bd_log_message (int type,
                     const char* base_channel,
@@ -22,6 +193,25 @@ namespace iw4x
                     const char* fmt,
                     ...)
     {
+      auto c ([] (const char* p) {return p ? p : "";});
+
+      const char* bc (c (base_channel));
+      const char* ch (c (channel));
+
+      // Classify the channel before touching the argument list. Most of the
+      // time nobody is listening and we bail out here without formatting.
+      //
+      channel_slot* cs (find_channel (bc, ch));
+
+      if (cs != nullptr)
+        cs->hits.fetch_add (1, memory_order_relaxed);
+
+      if (!should_forward (cs))
+        return;
+
+      if (cs != nullptr)
+        cs->forwarded.fetch_add (1, memory_order_relaxed);
+
       va_list ap;
       va_start (ap, fmt);
 
@@ -56,10 +246,67 @@ namespace iw4x
         m = s;
       }
 
-      auto c ([] (const char* p) {return p ? p : "";});
-      log::trace_l3 << format ("[{} {}] {}", c (base_channel), c (channel), m);
+      // Channels the operator explicitly enabled are raised to info so that
+      // they are visible in builds where trace output is compiled out.
+      //
+      if (cs != nullptr &&
+          cs->mode.load (memory_order_relaxed) == bd_log_channel_mode::enabled)
+        log::info << format ("[{} {}] {}", bc, ch, m);
+      else
+        log::trace_l3 << format ("[{} {}] {}", bc, ch, m);
 
       va_end (ap);
     }
+
+    void
+    set_bd_log_channel_mode (string_view b,
+                             string_view c,
+                             bd_log_channel_mode m)
+    {
+      lock_guard<mutex> l (channels_m);
+
+      if (m == bd_log_channel_mode::inherit)
+        overrides.erase (override_key (b, c));
+      else
+        overrides[override_key (b, c)] = m;
+
+      // Re-resolve every channel we have already seen. Note that an override
+      // on the base channel may affect many slots.
+      //
+      for (channel_slot& s : channels)
+      {
+        if (s.key.load (memory_order_relaxed) == 0)
+          continue;
+
+        s.mode.store (resolve_mode (s.base_channel, s.channel),
+                      memory_order_relaxed);
+      }
+    }
+
+    vector<bd_log_channel_stats>
+    bd_log_channel_statistics ()
+    {
+      vector<bd_log_channel_stats> r;
+
+      for (const channel_slot& s : channels)
+      {
+        if (s.key.load (memory_order_acquire) == 0)
+          continue;
+
+        r.push_back (bd_log_channel_stats {
+          .base_channel = s.base_channel,
+          .channel      = s.channel,
+          .mode         = s.mode.load (memory_order_relaxed),
+          .hits         = s.hits.load (memory_order_relaxed),
+          .forwarded    = s.forwarded.load (memory_order_relaxed)});
+      }
+
+      ranges::sort (r, [] (const auto& x, const auto& y)
+      {
+        return x.hits > y.hits;
+      });
+
+      return r;
+    }
   }
 }
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
 namespace iw4x
 {
   namespace demonware
@@ -13,5 +18,46 @@ namespace iw4x
                     int line,
                     const char* fmt,
                     ...);
+
+    // Per-channel filtering for bdLogMessage forwarding.
+    //
+    // Every (base_channel, channel) pair the bdNet code logs to gets a slot in
+    // a fixed-size table the first time it is seen. The slot records whether
+    // messages on that channel are forwarded to our logger and how many times
+    // the channel was hit. The hook consults this slot before doing any
+    // formatting, so a filtered channel costs a hash and a probe.
+    //
+    // Unless overridden, a channel is forwarded only if trace_l3 output is
+    // actually enabled.
+    //
+    enum class bd_log_channel_mode : std::uint8_t
+    {
+      inherit, // Follow the logger's trace_l3 threshold.
+      enabled, // Always forward.
+      disabled // Never forward.
+    };
+
+    // Override the filter for the specified channel. An empty channel applies
+    // the override to every channel under base_channel that does not have a
+    // more specific one.
+    //
+    void
+    set_bd_log_channel_mode (std::string_view base_channel,
+                             std::string_view channel,
+                             bd_log_channel_mode);
+
+    struct bd_log_channel_stats
+    {
+      std::string         base_channel;
+      std::string         channel;
+      bd_log_channel_mode mode;
+      std::uint64_t       hits;
+      std::uint64_t       forwarded;
+    };
+
+    // Snapshot the per-channel counters, noisiest channel first.
+    //
+    std::vector<bd_log_channel_stats>
+    bd_log_channel_statistics ();
   }
 }
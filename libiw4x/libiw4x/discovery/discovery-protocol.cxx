@@ -0,0 +1,343 @@
+#include <libiw4x/discovery/discovery-protocol.hxx>
+
+#include <charconv>
+#include <cstring>
+#include <utility>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace discovery
+  {
+    namespace
+    {
+      constexpr string_view oob_header ("\xFF\xFF\xFF\xFF", 4);
+
+      // Upper bound on the size of a serversDelta header line: the header and
+      // command, three 64-bit numbers, two 32-bit ones, the separators, and
+      // the newline.
+      //
+      constexpr size_t max_delta_header (4 + 12 + 3 * 20 + 2 * 10 + 5 + 1);
+
+      // Extract the next space-delimited token.
+      //
+      string_view
+      token (string_view& p)
+      {
+        size_t n (p.find_first_of (" \n"));
+        string_view r (p.substr (0, n));
+
+        p.remove_prefix (n == string_view::npos ? p.size () : n);
+
+        if (!p.empty () && p[0] == ' ')
+          p.remove_prefix (1);
+
+        return r;
+      }
+
+      template <typename T>
+      bool
+      number (string_view& p, T& r)
+      {
+        string_view t (token (p));
+
+        if (t.empty ())
+          return false;
+
+        auto [e, ec] = from_chars (t.data (), t.data () + t.size (), r);
+        return ec == errc () && e == t.data () + t.size ();
+      }
+    }
+
+    optional<pair<string_view, string_view>>
+    split_command (string_view p)
+    {
+      if (p.size () <= oob_header.size () ||
+          p.substr (0, oob_header.size ()) != oob_header)
+        return nullopt;
+
+      p.remove_prefix (oob_header.size ());
+
+      size_t n (p.find_first_of (" \n"));
+      string_view c (p.substr (0, n));
+
+      if (c.empty ())
+        return nullopt;
+
+      p.remove_prefix (c.size ());
+
+      if (!p.empty () && p[0] == ' ')
+        p.remove_prefix (1);
+
+      return pair<string_view, string_view> (c, p);
+    }
+
+    uint64_t
+    server_key (const net::udp_endpoint& e)
+    {
+      uint64_t k (0);
+
+      for (size_t i (0); i != 4; ++i)
+        k |= uint64_t (e.address[i]) << (40 - 8 * i);
+
+      return k | e.port;
+    }
+
+    net::udp_endpoint
+    server_endpoint (uint64_t k)
+    {
+      net::udp_endpoint e {};
+
+      for (size_t i (0); i != 4; ++i)
+        e.address[i] = static_cast<uint8_t> (k >> (40 - 8 * i));
+
+      e.port = static_cast<uint16_t> (k);
+      return e;
+    }
+
+    string
+    format_endpoint (const net::udp_endpoint& e)
+    {
+      // The port is in network order.
+      //
+      unsigned int p ((e.port & 0xFF) << 8 | e.port >> 8);
+
+      char b[32];
+      auto* i (b);
+
+      for (size_t j (0); j != 4; ++j)
+      {
+        i = to_chars (i, b + sizeof (b), unsigned (e.address[j])).ptr;
+        *i++ = j != 3 ? '.' : ':';
+      }
+
+      i = to_chars (i, b + sizeof (b), p).ptr;
+
+      return string (b, i);
+    }
+
+    optional<net::udp_endpoint>
+    parse_endpoint (string_view s)
+    {
+      net::udp_endpoint e {};
+      const char* i (s.data ());
+      const char* end (s.data () + s.size ());
+
+      for (size_t j (0); j != 4; ++j)
+      {
+        unsigned int v;
+        auto [n, ec] = from_chars (i, end, v);
+
+        if (ec != errc () || n == i || v > 255 || n == end ||
+            *n != (j != 3 ? '.' : ':'))
+          return nullopt;
+
+        e.address[j] = static_cast<uint8_t> (v);
+        i = n + 1;
+      }
+
+      unsigned int p;
+      auto [n, ec] = from_chars (i, end, p);
+
+      if (ec != errc () || n != end || p == 0 || p > 65535)
+        return nullopt;
+
+      e.port = static_cast<uint16_t> ((p & 0xFF) << 8 | p >> 8);
+      return e;
+    }
+
+    bool
+    valid_info (string_view s)
+    {
+      if (s.empty () || s.size () > max_info || s[0] != '\\')
+        return false;
+
+      for (char c : s)
+      {
+        if (c < 0x20 || c > 0x7E)
+          return false;
+      }
+
+      return true;
+    }
+
+    string
+    format_heartbeat (string_view info)
+    {
+      string r;
+      r.reserve (oob_header.size () + heartbeat_command.size () +
+                 protocol.size () + info.size () + 2);
+
+      r += oob_header;
+      r += heartbeat_command;
+      r += ' ';
+      r += protocol;
+      r += '\n';
+      r += info;
+
+      return r;
+    }
+
+    optional<string_view>
+    parse_heartbeat (string_view p)
+    {
+      if (token (p) != protocol || p.empty () || p[0] != '\n')
+        return nullopt;
+
+      p.remove_prefix (1);
+
+      if (!valid_info (p))
+        return nullopt;
+
+      return p;
+    }
+
+    string
+    format_getservers (uint64_t epoch, uint64_t version)
+    {
+      string r (oob_header);
+
+      r += getservers_command;
+      r += ' ';
+      r += protocol;
+      r += ' ';
+      r += to_string (epoch);
+      r += ' ';
+      r += to_string (version);
+
+      return r;
+    }
+
+    bool
+    parse_getservers (string_view p, uint64_t& epoch, uint64_t& version)
+    {
+      return token (p) == protocol &&
+             number (p, epoch)     &&
+             number (p, version)   &&
+             p.empty ();
+    }
+
+    vector<string>
+    format_servers_delta (uint64_t epoch,
+                          uint64_t from,
+                          uint64_t to,
+                          span<const server_change> cs)
+    {
+      // First pack the records into chunks, then prefix each with its header
+      // once we know how many there are.
+      //
+      vector<string> chunks (1);
+
+      for (const server_change& c : cs)
+      {
+        string r (c.removed ? "-" : "+");
+        r += format_endpoint (c.endpoint);
+
+        if (!c.removed)
+          r += c.info;
+
+        r += '\n';
+
+        if (max_delta_header + r.size () > max_packet)
+          continue;
+
+        if (max_delta_header + chunks.back ().size () + r.size () > max_packet)
+        {
+          // Every part claims to bring the list up to the target version
+          // so we cannot send just some of the changes.
+          //
+          if (chunks.size () == max_parts)
+            return {};
+
+          chunks.emplace_back ();
+        }
+
+        chunks.back () += r;
+      }
+
+      vector<string> ps;
+      ps.reserve (chunks.size ());
+
+      for (size_t i (0); i != chunks.size (); ++i)
+      {
+        string p (oob_header);
+
+        p += servers_command;
+        p += ' ';
+        p += to_string (epoch);
+        p += ' ';
+        p += to_string (from);
+        p += ' ';
+        p += to_string (to);
+        p += ' ';
+        p += to_string (i);
+        p += ' ';
+        p += to_string (chunks.size ());
+        p += '\n';
+        p += chunks[i];
+
+        ps.push_back (move (p));
+      }
+
+      return ps;
+    }
+
+    bool
+    parse_servers_delta (string_view p,
+                         servers_delta_header& h,
+                         vector<server_change>& cs)
+    {
+      if (!number (p, h.epoch)              ||
+          !number (p, h.from)               ||
+          !number (p, h.to)                 ||
+          !number (p, h.part)               ||
+          !number (p, h.parts)              ||
+          h.parts == 0                      ||
+          h.parts > max_parts               ||
+          h.part >= h.parts                 ||
+          h.to < h.from                     ||
+          p.empty ()                        ||
+          p[0] != '\n')
+        return false;
+
+      p.remove_prefix (1);
+
+      while (!p.empty ())
+      {
+        size_t n (p.find ('\n'));
+
+        if (n == string_view::npos)
+          return false;
+
+        string_view r (p.substr (0, n));
+        p.remove_prefix (n + 1);
+
+        if (r.size () < 2 || (r[0] != '+' && r[0] != '-'))
+          return false;
+
+        bool removed (r[0] == '-');
+        r.remove_prefix (1);
+
+        size_t i (removed ? r.size () : r.find ('\\'));
+
+        if (i == string_view::npos)
+          return false;
+
+        optional<net::udp_endpoint> e (parse_endpoint (r.substr (0, i)));
+
+        if (!e)
+          return false;
+
+        string_view info (r.substr (i));
+
+        if (!removed && !valid_info (info))
+          return false;
+
+        cs.push_back (server_change {*e, removed, string (info)});
+      }
+
+      return true;
+    }
+  }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <libiw4x/net/udp-socket.hxx>
+
+namespace iw4x
+{
+  namespace discovery
+  {
+    // Server discovery protocol.
+    //
+    // All messages are connectionless packets, that is, they start with four
+    // 0xFF bytes followed by a command word:
+    //
+    // heartbeat IW4x\n<info>
+    //
+    //   Sent by a server to the master every heartbeat_interval and whenever
+    //   its info changes. The info is the usual \key\value... string. A
+    //   server that stops sending heartbeats is dropped by the master after
+    //   server_timeout.
+    //
+    // getserversDelta IW4x <epoch> <version>
+    //
+    //   Sent by a client to the master to ask for the changes to the server
+    //   list since the specified version. Version 0 asks for the whole list.
+    //
+    // serversDelta <epoch> <from> <to> <part> <parts>\n<records>
+    //
+    //   The master's answer, split into as many packets (parts) as it takes.
+    //   Each record is a line, either +<address>:<port><info> (a server was
+    //   added or its info changed) or -<address>:<port> (a server is gone).
+    //   A client that is not at version <from> ignores the answer and if
+    //   <from> is 0, it is the whole list, which replaces whatever the client
+    //   has. The epoch identifies a master's run: versions from different
+    //   runs are not comparable.
+    //
+    inline constexpr std::string_view protocol = "IW4x";
+
+    inline constexpr std::string_view heartbeat_command = "heartbeat";
+    inline constexpr std::string_view getservers_command = "getserversDelta";
+    inline constexpr std::string_view servers_command = "serversDelta";
+
+    inline constexpr std::uint16_t default_master_port = 20810;
+
+    inline constexpr std::chrono::seconds heartbeat_interval {60};
+    inline constexpr std::chrono::seconds server_timeout {180};
+
+    // Largest packet we send, which keeps clear of fragmentation and fits
+    // the OOB pipeline's queue.
+    //
+    inline constexpr std::size_t max_packet = 1400;
+
+    // Largest server info we accept.
+    //
+    inline constexpr std::size_t max_info = 1024;
+
+    inline constexpr std::uint32_t max_parts = 1024;
+
+    // Split a connectionless packet into the command word and the payload
+    // that follows it (less the separating space). Return nullopt if this is
+    // not a connectionless packet.
+    //
+    // The parse functions below take the payload, which is also what the OOB
+    // pipeline hands to its handlers.
+    //
+    std::optional<std::pair<std::string_view, std::string_view>>
+    split_command (std::string_view packet);
+
+    // Map an endpoint to a key suitable for hashing and back.
+    //
+    std::uint64_t
+    server_key (const net::udp_endpoint&);
+
+    net::udp_endpoint
+    server_endpoint (std::uint64_t key);
+
+    // Numeric <address>:<port>.
+    //
+    std::string
+    format_endpoint (const net::udp_endpoint&);
+
+    std::optional<net::udp_endpoint>
+    parse_endpoint (std::string_view);
+
+    struct server_change
+    {
+      net::udp_endpoint endpoint;
+      bool removed;
+      std::string info; // Empty if removed.
+    };
+
+    struct servers_delta_header
+    {
+      std::uint64_t epoch;
+      std::uint64_t from;
+      std::uint64_t to;
+      std::uint32_t part;  // 0-based.
+      std::uint32_t parts;
+    };
+
+    std::string
+    format_heartbeat (std::string_view info);
+
+    // Return the info or nullopt if this is not a valid heartbeat.
+    //
+    std::optional<std::string_view>
+    parse_heartbeat (std::string_view payload);
+
+    std::string
+    format_getservers (std::uint64_t epoch, std::uint64_t version);
+
+    bool
+    parse_getservers (std::string_view payload,
+                      std::uint64_t& epoch,
+                      std::uint64_t& version);
+
+    // Split the changes into as many packets as it takes. A change that does
+    // not fit into a packet on its own (which the info size limit prevents)
+    // is skipped. Return an empty list if the changes do not fit into
+    // max_parts packets, in which case the request should be failed.
+    //
+    std::vector<std::string>
+    format_servers_delta (std::uint64_t epoch,
+                          std::uint64_t from,
+                          std::uint64_t to,
+                          std::span<const server_change>);
+
+    // Parse a single part, appending its records to the changes. Return false
+    // if the part is malformed, in which case the changes are unspecified.
+    //
+    bool
+    parse_servers_delta (std::string_view payload,
+                         servers_delta_header&,
+                         std::vector<server_change>&);
+
+    // Return true if the string is an acceptable server info, that is, a
+    // \key\value... sequence of printable characters within the size limit.
+    //
+    bool
+    valid_info (std::string_view);
+  }
+}
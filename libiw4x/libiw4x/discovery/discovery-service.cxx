@@ -0,0 +1,100 @@
+#include <libiw4x/discovery/discovery-service.hxx>
+
+#include <cstring>
+#include <utility>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace discovery
+  {
+    discovery_service::
+    discovery_service (const net::udp_endpoint& m, send_function s)
+      : master_ (m), send_ (move (s))
+    {
+    }
+
+    void discovery_service::
+    set_info (string i)
+    {
+      if (i == info_)
+        return;
+
+      info_ = move (i);
+      info_valid_ = valid_info (info_);
+      info_changed_ = true;
+    }
+
+    void discovery_service::
+    enable_heartbeats (bool e)
+    {
+      if (e && !heartbeats_)
+      {
+        // Announce ourselves right away rather than a full interval after
+        // the previous run of heartbeats.
+        //
+        last_heartbeat_.reset ();
+      }
+
+      heartbeats_ = e;
+    }
+
+    void discovery_service::
+    tick (clock::time_point now)
+    {
+      if (!heartbeats_ || !info_valid_)
+        return;
+
+      if (last_heartbeat_)
+      {
+        clock::duration d (now - *last_heartbeat_);
+
+        if (d < (info_changed_ ? clock::duration (min_heartbeat_interval)
+                               : clock::duration (heartbeat_interval)))
+          return;
+      }
+
+      // Whether or not the send succeeds, wait for the next slot: retrying
+      // every tick would only add to whatever is wrong.
+      //
+      last_heartbeat_ = now;
+      info_changed_ = false;
+
+      ++stats_.heartbeats;
+      send (format_heartbeat (info_));
+    }
+
+    bool discovery_service::
+    refresh ()
+    {
+      ++stats_.refreshes;
+      return send (format_getservers (servers_.epoch (), servers_.version ()));
+    }
+
+    bool discovery_service::
+    handle (const net::udp_endpoint& from, string_view p)
+    {
+      // Anyone can send us a server list so only take it from the master.
+      //
+      if (memcmp (from.address, master_.address, sizeof (from.address)) != 0 ||
+          from.port != master_.port)
+      {
+        ++stats_.foreign;
+        return false;
+      }
+
+      return servers_.handle (p);
+    }
+
+    bool discovery_service::
+    send (const string& p)
+    {
+      if (send_ && send_ (master_, p.data (), p.size ()))
+        return true;
+
+      ++stats_.send_failures;
+      return false;
+    }
+  }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <libiw4x/net/udp-socket.hxx>
+
+#include <libiw4x/discovery/discovery-protocol.hxx>
+#include <libiw4x/discovery/server-list.hxx>
+
+namespace iw4x
+{
+  namespace discovery
+  {
+    struct discovery_stats
+    {
+      std::uint64_t heartbeats;    // Heartbeats sent.
+      std::uint64_t refreshes;     // Requests for changes sent.
+      std::uint64_t send_failures; // Either of the above that failed.
+      std::uint64_t foreign;       // Server lists from someone but the master.
+    };
+
+    // Both ends of server discovery against a single master.
+    //
+    // As a server, send heartbeats with the current info: every
+    // heartbeat_interval to stay listed and soon after the info changes (but
+    // no more often than min_heartbeat_interval) so that clients see, say, a
+    // map change without waiting a full interval.
+    //
+    // As a client, keep a server list (see server_list for details) and
+    // bring it up to date on refresh ().
+    //
+    // The service does no I/O of its own: packets are sent through the
+    // function passed on construction and the serversDelta packets received
+    // from the master are to be handed to handle (). Nor does it have a
+    // thread: heartbeats go out from tick (), which is expected to be called
+    // regularly (say, every frame).
+    //
+    class discovery_service
+    {
+    public:
+      using clock = std::chrono::steady_clock;
+
+      using send_function =
+        std::move_only_function<bool (const net::udp_endpoint&,
+                                      const char*,
+                                      std::size_t)>;
+
+      static constexpr std::chrono::seconds min_heartbeat_interval {5};
+
+      discovery_service (const net::udp_endpoint& master, send_function);
+
+      discovery_service (const discovery_service&) = delete;
+      discovery_service& operator = (const discovery_service&) = delete;
+
+      const net::udp_endpoint&
+      master () const {return master_;}
+
+      // Server.
+      //
+
+      // Set the info to advertise. An info that is not valid (see
+      // valid_info ()) stops the heartbeats until a valid one is set.
+      //
+      void
+      set_info (std::string);
+
+      // Start or stop sending heartbeats. Stopping does not tell the master:
+      // the server drops off the list once its entry times out.
+      //
+      void
+      enable_heartbeats (bool);
+
+      bool
+      heartbeats_enabled () const {return heartbeats_;}
+
+      // Send a heartbeat if one is due.
+      //
+      void
+      tick (clock::time_point = clock::now ());
+
+      // Client.
+      //
+
+      // Ask the master for the changes since our version of the list.
+      //
+      bool
+      refresh ();
+
+      // Handle a serversDelta payload received from the specified endpoint.
+      // Return true if it completed an update of the list.
+      //
+      bool
+      handle (const net::udp_endpoint& from, std::string_view payload);
+
+      const server_list&
+      servers () const {return servers_;}
+
+      discovery_stats
+      stats () const {return stats_;}
+
+    private:
+      bool
+      send (const std::string&);
+
+      net::udp_endpoint master_;
+      send_function send_;
+
+      std::string info_;
+      bool info_valid_ = false;
+      bool info_changed_ = false;
+      bool heartbeats_ = false;
+      std::optional<clock::time_point> last_heartbeat_;
+
+      server_list servers_;
+
+      discovery_stats stats_ {};
+    };
+  }
+}
@@ -0,0 +1,107 @@
+#include <libiw4x/discovery/server-list.hxx>
+
+#include <utility>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace discovery
+  {
+    bool server_list::
+    handle (string_view p)
+    {
+      servers_delta_header h;
+      vector<server_change> cs;
+
+      if (!parse_servers_delta (p, h, cs))
+      {
+        ++stats_.malformed;
+        return false;
+      }
+
+      // A delta relative to a version other than ours is of no use. Note that
+      // a full list (from 0) always applies.
+      //
+      if (h.from != 0 && (h.epoch != epoch_ || h.from != version_))
+      {
+        ++stats_.stale;
+        return false;
+      }
+
+      // Start collecting a new delta if this is part of a different one than
+      // what we have so far.
+      //
+      if (remaining_ == 0          ||
+          h.epoch != pending_.epoch ||
+          h.from  != pending_.from  ||
+          h.to    != pending_.to    ||
+          h.parts != pending_.parts)
+      {
+        pending_ = h;
+        parts_.assign (h.parts, {});
+        received_.assign (h.parts, false);
+        remaining_ = h.parts;
+      }
+
+      if (received_[h.part])
+        return false;
+
+      received_[h.part] = true;
+      parts_[h.part] = move (cs);
+
+      if (--remaining_ != 0)
+        return false;
+
+      apply (pending_.from == 0);
+      return true;
+    }
+
+    void server_list::
+    apply (bool full)
+    {
+      if (full)
+        servers_.clear ();
+
+      last_.clear ();
+
+      for (vector<server_change>& cs : parts_)
+      {
+        for (server_change& c : cs)
+        {
+          uint64_t k (server_key (c.endpoint));
+
+          if (c.removed)
+            servers_.erase (k);
+          else
+            servers_.insert_or_assign (k, server {c.endpoint, c.info});
+
+          last_.push_back (move (c));
+        }
+      }
+
+      parts_.clear ();
+      received_.clear ();
+
+      epoch_ = pending_.epoch;
+      version_ = pending_.to;
+
+      ++stats_.deltas;
+      stats_.changes += last_.size ();
+
+      if (full)
+        ++stats_.full;
+    }
+
+    void server_list::
+    clear ()
+    {
+      epoch_ = version_ = 0;
+      servers_.clear ();
+      last_.clear ();
+      parts_.clear ();
+      received_.clear ();
+      remaining_ = 0;
+    }
+  }
+}
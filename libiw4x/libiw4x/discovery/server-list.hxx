@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <libiw4x/discovery/discovery-protocol.hxx>
+
+namespace iw4x
+{
+  namespace discovery
+  {
+    struct server_list_stats
+    {
+      std::uint64_t deltas;    // Complete deltas applied.
+      std::uint64_t full;      // Of which full lists.
+      std::uint64_t changes;   // Records applied.
+      std::uint64_t stale;     // Parts ignored as not applicable.
+      std::uint64_t malformed; // Parts rejected by the parser.
+    };
+
+    // Client-side server list cache.
+    //
+    // The list is kept up to date by applying the master's deltas (see the
+    // protocol for details): after the initial full list, a refresh only
+    // transfers and touches the servers that changed. The changes applied
+    // last are kept so that, say, the browser can update just those rows.
+    //
+    // A delta may span several packets. These are collected until all have
+    // arrived and only then applied, so the list always corresponds to some
+    // version of the master's list. If a part is lost, the next refresh asks
+    // for the same delta again.
+    //
+    class server_list
+    {
+    public:
+      struct server
+      {
+        net::udp_endpoint endpoint;
+        std::string info;
+      };
+
+      server_list () = default;
+
+      // Handle a serversDelta payload. Return true if it completed a delta,
+      // which is then applied.
+      //
+      bool
+      handle (std::string_view payload);
+
+      // The epoch and version to ask the master for changes since.
+      //
+      std::uint64_t
+      epoch () const {return epoch_;}
+
+      std::uint64_t
+      version () const {return version_;}
+
+      const std::unordered_map<std::uint64_t, server>&
+      servers () const {return servers_;}
+
+      std::size_t
+      size () const {return servers_.size ();}
+
+      // Changes applied by the last complete delta. Note that after a full
+      // list this is everything, including the servers that did not change.
+      //
+      const std::vector<server_change>&
+      last_changes () const {return last_;}
+
+      // Forget everything, for example, because the master changed.
+      //
+      void
+      clear ();
+
+      server_list_stats
+      stats () const {return stats_;}
+
+    private:
+      void
+      apply (bool full);
+
+      std::uint64_t epoch_ = 0;
+      std::uint64_t version_ = 0;
+
+      std::unordered_map<std::uint64_t, server> servers_;
+      std::vector<server_change> last_;
+
+      // Delta being collected.
+      //
+      servers_delta_header pending_ {};
+      std::vector<std::vector<server_change>> parts_;
+      std::vector<bool> received_;
+      std::size_t remaining_ = 0;
+
+      server_list_stats stats_ {};
+    };
+  }
+}
@@ -0,0 +1,122 @@
+#include <libiw4x/discovery/server-registry.hxx>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace discovery
+  {
+    server_registry::
+    server_registry (uint64_t e, clock::duration t, size_t m)
+      : epoch_ (e), timeout_ (t), max_tombstones_ (m)
+    {
+    }
+
+    bool server_registry::
+    heartbeat (const net::udp_endpoint& e,
+               string_view info,
+               clock::time_point now)
+    {
+      if (!valid_info (info))
+        return false;
+
+      uint64_t k (server_key (e));
+
+      auto i (servers_.find (k));
+
+      if (i != servers_.end ())
+      {
+        server& s (i->second);
+        s.last = now;
+
+        if (s.info == info)
+          return false;
+
+        changed_.erase (s.version);
+
+        s.info = info;
+        s.version = ++version_;
+      }
+      else
+        i = servers_.emplace (k, server {string (info), ++version_, now}).first;
+
+      changed_.emplace (i->second.version, k);
+      return true;
+    }
+
+    void server_registry::
+    remove (unordered_map<uint64_t, server>::iterator i)
+    {
+      changed_.erase (i->second.version);
+      removed_.push_back (tombstone {i->first, ++version_});
+      servers_.erase (i);
+
+      // A client behind the oldest tombstone we let go of could miss the
+      // removal, so it will have to get the whole list.
+      //
+      if (removed_.size () > max_tombstones_)
+      {
+        horizon_ = removed_.front ().version;
+        removed_.pop_front ();
+      }
+    }
+
+    size_t server_registry::
+    expire (clock::time_point now)
+    {
+      // Note that this is a full scan but it only runs every few seconds,
+      // not per request.
+      //
+      size_t n (0);
+
+      for (auto i (servers_.begin ()); i != servers_.end (); )
+      {
+        auto j (i++);
+
+        if (now - j->second.last >= timeout_)
+        {
+          remove (j);
+          ++n;
+        }
+      }
+
+      return n;
+    }
+
+    uint64_t server_registry::
+    changes (uint64_t epoch, uint64_t since, vector<server_change>& cs) const
+    {
+      if (epoch != epoch_ || since == 0 || since < horizon_ || since > version_)
+      {
+        cs.reserve (cs.size () + servers_.size ());
+
+        for (const auto& [k, s] : servers_)
+          cs.push_back (server_change {server_endpoint (k), false, s.info});
+
+        return 0;
+      }
+
+      // Removals of servers that came back since are superseded by the
+      // server's current entry below.
+      //
+      for (auto i (removed_.rbegin ());
+           i != removed_.rend () && i->version > since;
+           ++i)
+      {
+        auto j (servers_.find (i->key));
+
+        if (j == servers_.end () || j->second.version < i->version)
+          cs.push_back (server_change {server_endpoint (i->key), true, {}});
+      }
+
+      for (auto i (changed_.upper_bound (since)); i != changed_.end (); ++i)
+      {
+        const server& s (servers_.at (i->second));
+        cs.push_back (
+          server_change {server_endpoint (i->second), false, s.info});
+      }
+
+      return since;
+    }
+  }
+}
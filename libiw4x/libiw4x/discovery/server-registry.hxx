@@ -0,0 +1,115 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <libiw4x/discovery/discovery-protocol.hxx>
+
+namespace iw4x
+{
+  namespace discovery
+  {
+    // Master-side list of servers.
+    //
+    // Every change (a server added, its info changed, or a server timing out)
+    // bumps the list version and the changed server is (re)filed under the
+    // new version. So the changes since some version are simply what is filed
+    // past it, which is what a refreshing client gets: the cost of answering
+    // it is proportional to what changed rather than to the size of the list.
+    //
+    // Removals are remembered (as tombstones) for a while so that clients can
+    // be told about them. A client that is further behind than that gets the
+    // whole list instead.
+    //
+    class server_registry
+    {
+    public:
+      using clock = std::chrono::steady_clock;
+
+      // The epoch identifies this registry to clients (see the protocol for
+      // details) and is normally something random or the start time.
+      //
+      explicit
+      server_registry (std::uint64_t epoch,
+                       clock::duration timeout = server_timeout,
+                       std::size_t max_tombstones = 4096);
+
+      server_registry (const server_registry&) = delete;
+      server_registry& operator = (const server_registry&) = delete;
+
+      // Record a heartbeat. Return true if it changed the list.
+      //
+      bool
+      heartbeat (const net::udp_endpoint&,
+                 std::string_view info,
+                 clock::time_point = clock::now ());
+
+      // Drop the servers that have not sent a heartbeat within the timeout.
+      // Return the number dropped.
+      //
+      std::size_t
+      expire (clock::time_point = clock::now ());
+
+      // Append the changes since the specified version to the list and
+      // return the version they are relative to: either the one specified or
+      // 0 if the client gets the whole list (because it asked for it, it is
+      // from another epoch, or it is too far behind).
+      //
+      std::uint64_t
+      changes (std::uint64_t epoch,
+               std::uint64_t since,
+               std::vector<server_change>&) const;
+
+      std::uint64_t
+      epoch () const {return epoch_;}
+
+      std::uint64_t
+      version () const {return version_;}
+
+      std::size_t
+      size () const {return servers_.size ();}
+
+    private:
+      struct server
+      {
+        std::string info;
+        std::uint64_t version;
+        clock::time_point last;
+      };
+
+      struct tombstone
+      {
+        std::uint64_t key;
+        std::uint64_t version;
+      };
+
+      void
+      remove (std::unordered_map<std::uint64_t, server>::iterator);
+
+      std::uint64_t epoch_;
+      clock::duration timeout_;
+      std::size_t max_tombstones_;
+
+      std::uint64_t version_ = 0;
+
+      std::unordered_map<std::uint64_t, server> servers_;
+
+      // Servers by the version of their last change.
+      //
+      std::map<std::uint64_t, std::uint64_t> changed_;
+
+      // Removals in the version order and the oldest version they (still)
+      // fully cover.
+      //
+      std::deque<tombstone> removed_;
+      std::uint64_t horizon_ = 0;
+    };
+  }
+}
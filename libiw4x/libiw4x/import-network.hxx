@@ -0,0 +1,51 @@
+#pragma once
+
+// Engine networking types.
+//
+// These are split out of import.hxx since, unlike the rest of it, they don't
+// depend on the Windows headers. This allows the parts of the library that
+// only deal with network packets (such as the OOB pipeline) to be built for
+// host tools.
+//
+
+namespace iw4x
+{
+  // 100
+  //
+  enum network_address_type
+  {
+    NETWORK_ADDRESS_BOT = 0x0,
+    NETWORK_ADDRESS_BAD = 0x1,
+    NETWORK_ADDRESS_LOOPBACK = 0x2,
+    NETWORK_ADDRESS_BROADCAST = 0x3,
+    NETWORK_ADDRESS_IP = 0x4,
+    NETWORK_ADDRESS_IPX = 0x5,
+    NETWORK_ADDRESS_BROADCAST_IPX = 0x6,
+  };
+
+  // 1315
+  //
+  struct network_address
+  {
+    network_address_type type;
+    char ip[4];
+    unsigned short port;
+    char ipx[10];
+  };
+
+  // 1474
+  //
+  struct message
+  {
+    int overflowed;
+    int read_only;
+    char* data;
+    char* split_data;
+    int maximum_size;
+    int current_size;
+    int split_size;
+    int read_count;
+    int bit;
+    int last_entity_reference;
+  };
+}
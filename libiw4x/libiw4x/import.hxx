@@ -30,6 +30,8 @@
 
 #include <cstdint>
 
+#include <libiw4x/import-network.hxx>
+
 namespace iw4x
 {
   struct expression_entry;
@@ -368,19 +370,6 @@ namespace iw4x
     IMPACT_TYPE_COUNT = 0xB,
   };
 
-  // 100
-  //
-  enum network_address_type
-  {
-    NETWORK_ADDRESS_BOT = 0x0,
-    NETWORK_ADDRESS_BAD = 0x1,
-    NETWORK_ADDRESS_LOOPBACK = 0x2,
-    NETWORK_ADDRESS_BROADCAST = 0x3,
-    NETWORK_ADDRESS_IP = 0x4,
-    NETWORK_ADDRESS_IPX = 0x5,
-    NETWORK_ADDRESS_BROADCAST_IPX = 0x6,
-  };
-
   // 102
   //
   enum weapon_type
@@ -4704,16 +4693,6 @@ namespace iw4x
     int flags;
   };
 
-  // 1315
-  //
-  struct network_address
-  {
-    network_address_type type;
-    char ip[4];
-    unsigned short port;
-    char ipx[10];
-  };
-
   // 1362
   //
   struct xnetwork_key_identifier
@@ -4737,22 +4716,6 @@ namespace iw4x
     xnetwork_key key_exchange_key;
   };
 
-  // 1474
-  //
-  struct message
-  {
-    int overflowed;
-    int read_only;
-    char* data;
-    char* split_data;
-    int maximum_size;
-    int current_size;
-    int split_size;
-    int read_count;
-    int bit;
-    int last_entity_reference;
-  };
-
   // 1591
   //
   struct ui_local_variable
@@ -5244,4 +5207,9 @@ namespace iw4x
   inline bool*                           areDvarsSorted         = reinterpret_cast<bool*>                  (0x14673D270);
   inline int*                            dvarCount              = reinterpret_cast<int*>                   (0x1466D3268);
   inline dvar**                          sortedDvars            = reinterpret_cast<dvar**>                 (0x1466D3270);
+
+  // Set to 1 by Com_Init (at 0x1401FB0E0) immediately after registering the
+  // "motd" dvar, which is the last observable action of Com_Init.
+  //
+  inline int32_t*                        com_init_complete      = reinterpret_cast<int32_t*>               (0x141C34D6C);
 }
@@ -13,6 +13,7 @@
 #include <libiw4x/mod/oob/oob-pipeline.hxx>
 
 #include <libiw4x/mod/mod-demonware.hxx>
+#include <libiw4x/mod/mod-discovery.hxx>
 #include <libiw4x/mod/mod-network.hxx>
 #include <libiw4x/mod/mod-oob.hxx>
 #include <libiw4x/mod/mod-party.hxx>
@@ -247,6 +248,7 @@ namespace iw4x
         mod::party_module ();
         mod::oob_module ();
         mod::network_module ();
+        mod::discovery_module ();
         mod::menu_module ();
         mod::window_module ();
 
@@ -16,15 +16,9 @@ using namespace std;
 
 namespace iw4x
 {
-  namespace discovery
-  {
-    class discovery_service;
-  }
-
   namespace mod
   {
-    discovery::discovery_service*
-    active_discovery_service ();
+    dvar* sv_lan_only_dvar (nullptr);
 
     namespace
     {
@@ -177,18 +171,6 @@ namespace iw4x
       inline Dvar_RegisterEnum_t Dvar_RegisterEnum (
         reinterpret_cast<Dvar_RegisterEnum_t> (0x140287FC0));
 
-      // Initialization-complete flag.
-      //
-      // Set to 1 by Com_Init (at 0x1401FB0E0) immediately after registering
-      // the "motd" dvar, which is the last observable action of Com_Init.
-      //
-      auto& init_complete (*reinterpret_cast<int32_t*> (0x141C34D6C));
-
-      // cached after registration so the heartbeat helper can read it without
-      // doing a string lookup on every tick.
-      //
-      dvar* sv_lan_only_dvar (nullptr);
-
       // Enqueue a command with a trailing newline so Cbuf_AddText treats it as
       // a complete command token.
       //
@@ -584,14 +566,14 @@ namespace iw4x
       detour (subsystem_pump, dedicated_subsystem_pump);
 
       // Schedule the startup sequence to fire once Com_Init has finished. The
-      // predicate polls init_complete (0x141C34D6C) which Com_Init sets to 1 as
-      // its very last action.
+      // predicate polls com_init_complete which Com_Init sets to 1 as its
+      // very last action.
       //
       scheduler::post (com_frame_domain,
                        post_init,
                        repeat_until_predicate {[]
       {
-        return init_complete != 0;
+        return *com_init_complete != 0;
       }});
     }
   }
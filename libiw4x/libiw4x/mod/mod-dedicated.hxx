@@ -15,5 +15,11 @@ namespace iw4x
       static bool
       is_dedicated ();
     };
+
+    // The sv_lanOnly dvar, cached after registration so that the discovery
+    // module can read it without doing a string lookup on every frame. NULL
+    // if this is not a dedicated server.
+    //
+    extern dvar* sv_lan_only_dvar;
   }
 }
@@ -1,8 +1,17 @@
 #include <libiw4x/mod/mod-demonware.hxx>
 
+#include <string_view>
+#include <vector>
+
 #include <libiw4x/logger.hxx>
 #include <libiw4x/detour.hxx>
 #include <libiw4x/import.hxx>
+#include <libiw4x/scheduler.hxx>
+
+#include <libiw4x/mod/mod-network.hxx>
+
+#include <libiw4x/net/recv-demux.hxx>
+#include <libiw4x/net/udp-socket.hxx>
 
 #include <libiw4x/demonware/lobby/auth-service.hxx>
 #include <libiw4x/demonware/lobby/lobby-service.hxx>
@@ -188,17 +197,105 @@ namespace iw4x
         return false;
       }
 
-      // eek at the first byte of every pending datagram before deciding
-      //   whether to consume it.  STUN packets top two bits
-      //   of the first byte are always 00) belong to bdNet and are passed
-      //   through to the original receiveFrom so NAT traversal continues
-      //   to work.  All other packets (OOB 0xFF… and Netchan game traffic)
-      //   are left in the kernel socket buffer by returning -2 (bd_wouldblock)
-      //   without consuming them.  NET_GetPacket then reads them directly
-      //   via recvfrom(), processes them in the same frame, and feeds them
-      //   to SV_PacketEvent / CL_PacketEvent with correct sequencing.
+      // The socket is shared between bdNet and the engine (see adopt_dw_s()
+      // in mod-network.cxx): STUN packets (the top two bits of the first byte
+      // are always 00) belong to bdNet so NAT traversal keeps working while
+      // all other packets (OOB 0xFF... and netchan game traffic) are for
+      // NET_GetPacket.
       //
+      // Both sides receive with recvfrom() so we hook it and drain the socket
+      // into a demultiplexer, with a single receive per datagram, and serve
+      // each side from its own ring (see net/recv-demux.hxx for details).
       //
+      net::recv_demux demux;
+
+      using recvfrom_t = int (WSAAPI*) (SOCKET s, char* buf, int len,
+                                        int flags, sockaddr* from,
+                                        int* from_len);
+      recvfrom_t ws_recvfrom;
+
+      // Set while the demultiplexer itself receives, so that those calls go
+      // to the real recvfrom().
+      //
+      thread_local bool demux_receiving (false);
+
+      // Set while bdNet receives on the shared socket.
+      //
+      thread_local SOCKET stun_socket (INVALID_SOCKET);
+
+      // Return the shared socket if it has been adopted by the engine and
+      // matches the specified one, and INVALID_SOCKET otherwise.
+      //
+      SOCKET
+      shared_socket (SOCKET s)
+      {
+        if (*ip_socket == 0 || s != static_cast<SOCKET> (*ip_socket))
+          return INVALID_SOCKET;
+
+        // Discard anything left over from the previous socket.
+        //
+        static SOCKET bound (INVALID_SOCKET);
+
+        if (s != bound)
+        {
+          demux.clear ();
+          bound = s;
+        }
+
+        return s;
+      }
+
+      int WSAAPI
+      receive_from (SOCKET s, char* b, int n, int f, sockaddr* a, int* al)
+      {
+        if (demux_receiving || f != 0 || shared_socket (s) == INVALID_SOCKET)
+          return ws_recvfrom (s, b, n, f, a, al);
+
+        net::datagram_class c (s == stun_socket
+                               ? net::datagram_class::stun
+                               : net::datagram_class::game);
+
+        net::udp_socket u (
+          static_cast<net::udp_socket::native_handle_type> (s));
+        net::udp_endpoint e {};
+
+        demux_receiving = true;
+        net::udp_receive_result r (
+          demux.receive (u, c, b, n > 0 ? static_cast<size_t> (n) : 0, e));
+        demux_receiving = false;
+
+        if (r.error != net::udp_error::none)
+        {
+          WSASetLastError (WSAEWOULDBLOCK);
+          return SOCKET_ERROR;
+        }
+
+        if (a != nullptr && al != nullptr &&
+            *al >= static_cast<int> (sizeof (sockaddr_in)))
+        {
+          sockaddr_in sa {};
+          sa.sin_family = AF_INET;
+          memcpy (&sa.sin_addr, e.address, 4);
+          sa.sin_port = e.port;
+
+          memcpy (a, &sa, sizeof (sa));
+          *al = sizeof (sa);
+        }
+
+        network_stats ().received (
+          e, b, min (r.size, static_cast<size_t> (n)));
+
+        // Same as recvfrom(), the buffer is filled and the rest is lost.
+        //
+        if (r.size > static_cast<size_t> (n))
+        {
+          WSASetLastError (WSAEMSGSIZE);
+          return SOCKET_ERROR;
+        }
+
+        return static_cast<int> (r.size);
+      }
+
       using bdSocketReceiveFrom_t =
         int (__thiscall*) (void* self, void* out_addr,
                            void* out_buf, int buf_size);
@@ -206,6 +303,10 @@ namespace iw4x
       bdSocketReceiveFrom_t bdSocketReceiveFrom =
         reinterpret_cast<bdSocketReceiveFrom_t> (0x140371fc0);
 
+      // Only let bdNet receive when there is a STUN packet pending for it,
+      // returning -2 (bd_wouldblock) otherwise. The real receiveFrom then
+      // gets it from the demultiplexer through our recvfrom() hook.
+      //
       int __thiscall
       socket_receive_from (void* self, void* out_addr,
                                  void* out_buf, int buf_size)
@@ -218,34 +319,64 @@ namespace iw4x
         if (fd == -1)
           return -2;
 
-        // Peek at the first byte without consuming the datagram.
+        SOCKET s (static_cast<SOCKET> (static_cast<uint32_t> (fd)));
+
+        // Until the engine adopts the socket, bdNet is the only one reading
+        // it.
         //
-        unsigned char first_byte = 0;
-        int peeked (recv (static_cast<SOCKET> (static_cast<uint32_t> (fd)),
-                          reinterpret_cast<char*> (&first_byte),
-                          1,
-                          MSG_PEEK));
+        if (shared_socket (s) == INVALID_SOCKET)
+          return bdSocketReceiveFrom (self, out_addr, out_buf, buf_size);
 
-        if (peeked <= 0)
-        {
-          if (peeked == -1 && WSAGetLastError() == WSAEMSGSIZE)
-            ;
-          else
-            return -2;
-        }
+        net::udp_socket u (
+          static_cast<net::udp_socket::native_handle_type> (s));
+
+        demux_receiving = true;
+        bool p (demux.pending (u, net::datagram_class::stun));
+        demux_receiving = false;
+
+        if (!p)
+          return -2;
+
+        stun_socket = s;
+        int r (bdSocketReceiveFrom (self, out_addr, out_buf, buf_size));
+        stun_socket = INVALID_SOCKET;
+
+        return r;
+      }
 
-        // STUN packets have their top two bits == 00 (RFC 5389). Pass
-        // them to bdNet so the NAT traversal / IP discovery subsystem
-        // keeps working.
+      // Fallback for when recvfrom() cannot be hooked: peek at the first byte
+      // and only let bdNet receive STUN packets, leaving everything else in
+      // the socket buffer for NET_GetPacket. This costs an extra receive per
+      // datagram but keeps NAT traversal working.
+      //
+      int __thiscall
+      socket_peek_receive_from (void* self, void* out_addr,
+                                void* out_buf, int buf_size)
+      {
+        // Socket fd is stored at bdSocket + 0x08.
         //
-        if ((first_byte & 0xC0) == 0x00)
-          return bdSocketReceiveFrom (self, out_addr,
-                                                out_buf, buf_size);
+        auto fd (*reinterpret_cast<int32_t*> (
+          static_cast<char*> (self) + 0x08));
+
+        if (fd == -1)
+          return -2;
 
-        // Game packet (OOB 0xFF… or Netchan): leave it in the socket
-        // buffer. NET_GetPacket will consume it via recvfrom() in the
-        // same frame and feed it to the engine with correct sequencing.
+        // Peek at the first byte without consuming the datagram. A datagram
+        // larger than our byte still fills it in but fails with WSAEMSGSIZE.
         //
+        unsigned char b (0);
+        int n (recv (static_cast<SOCKET> (static_cast<uint32_t> (fd)),
+                     reinterpret_cast<char*> (&b),
+                     1,
+                     MSG_PEEK));
+
+        if (n == 0 ||
+            (n == SOCKET_ERROR && WSAGetLastError () != WSAEMSGSIZE))
+          return -2;
+
+        if ((b & 0xC0) == 0x00)
+          return bdSocketReceiveFrom (self, out_addr, out_buf, buf_size);
+
         return -2;
       }
 
@@ -362,6 +493,139 @@ namespace iw4x
 
         Live_Frame (controller);
       }
+
+      // The engine quits by way of exit (), which ends in ExitProcess (). This
+      // is our last chance to do I/O with the process still intact: by the
+      // time our static destructors run (DLL_PROCESS_DETACH), our threads are
+      // gone and the loader lock is held.
+      //
+      using ExitProcess_t = void (WINAPI*) (UINT);
+      ExitProcess_t exit_process;
+
+      void WINAPI
+      exit_process_hook (UINT c)
+      {
+        demonware::storage::shutdown ();
+        exit_process (c);
+      }
+
+      const char*
+      mode_name (bd_log_channel_mode m)
+      {
+        switch (m)
+        {
+        case bd_log_channel_mode::inherit:  return "inherit";
+        case bd_log_channel_mode::enabled:  return "enabled";
+        case bd_log_channel_mode::disabled: return "disabled";
+        }
+
+        return "unknown";
+      }
+
+      // bd_log_stats
+      //
+      // Print the bdLogMessage channels seen so far, noisiest first.
+      //
+      void __fastcall
+      bd_log_stats_f ()
+      {
+        vector<bd_log_channel_stats> cs (bd_log_channel_statistics ());
+
+        if (cs.empty ())
+        {
+          log::info << "no bdLogMessage channels seen";
+          return;
+        }
+
+        for (const bd_log_channel_stats& c : cs)
+          log::info << c.base_channel << '/' << c.channel << ": " << c.hits
+                    << " hits, " << c.forwarded << " forwarded ("
+                    << mode_name (c.mode) << ')';
+      }
+
+      // dw_task_stats
+      //
+      // Print the remote task dispatch counters, busiest service first.
+      //
+      void __fastcall
+      dw_task_stats_f ()
+      {
+        vector<remote_task_stats> ss (remote_task_manager::statistics ());
+
+        if (ss.empty ())
+        {
+          log::info << "no remote tasks dispatched";
+          return;
+        }
+
+        for (const remote_task_stats& s : ss)
+        {
+          uint64_t avg (s.total_ns / s.calls / 1000);
+
+          if (s.handled)
+            log::info << "service " << unsigned (s.service_id) << '/'
+                      << unsigned (s.sub_function_id) << ": " << s.calls
+                      << " calls, " << avg << "us avg, "
+                      << s.max_ns / 1000 << "us max";
+          else
+            log::info << "service " << unsigned (s.service_id)
+                      << " (unhandled): " << s.calls << " calls";
+        }
+      }
+
+      // bd_log_channel <base> [<channel>] inherit|enabled|disabled
+      //
+      // Override the bdLogMessage filter for a channel or, without the
+      // channel, for every channel under the base.
+      //
+      void __fastcall
+      bd_log_channel_f ()
+      {
+        int i (cmd_args->nesting);
+        int n (cmd_args->argument_count[i]);
+        const char** v (cmd_args->argument_vector[i]);
+
+        if (n != 3 && n != 4)
+        {
+          log::info << "usage: bd_log_channel <base> [<channel>] "
+                    << "inherit|enabled|disabled";
+          return;
+        }
+
+        string_view b (v[1]);
+        string_view c (n == 4 ? v[2] : "");
+        string_view m (v[n - 1]);
+
+        bd_log_channel_mode r;
+
+        if      (m == "inherit")  r = bd_log_channel_mode::inherit;
+        else if (m == "enabled")  r = bd_log_channel_mode::enabled;
+        else if (m == "disabled") r = bd_log_channel_mode::disabled;
+        else
+        {
+          log::error << "invalid bdLogMessage channel mode '" << m << "'";
+          return;
+        }
+
+        set_bd_log_channel_mode (b, c, r);
+
+        log::info << "bdLogMessage channel " << b << '/'
+                  << (c.empty () ? "*" : c) << " set to " << m;
+      }
+
+      void
+      register_commands ()
+      {
+        static command_function_s stats_cmd;
+        static command_function_s channel_cmd;
+        static command_function_s tasks_cmd;
+
+        Cmd_AddCommandInternal ("bd_log_stats", bd_log_stats_f, &stats_cmd);
+        Cmd_AddCommandInternal ("bd_log_channel",
+                                bd_log_channel_f,
+                                &channel_cmd);
+        Cmd_AddCommandInternal ("dw_task_stats", dw_task_stats_f, &tasks_cmd);
+      }
     }
 
     demonware_module::
@@ -396,7 +660,53 @@ namespace iw4x
       detour (ClientConnect, &client_connect);
       detour (Live_Frame, live_frame);
       detour (bdSocketRouterConnect, socket_router_connect);
-      detour (bdSocketReceiveFrom, socket_receive_from);
+
+      // The demultiplexer needs both bdNet's receive (to only let it in when
+      // there is something for it) and recvfrom() (to hand out the
+      // datagrams). Without the latter fall back to peeking so that bdNet
+      // at least does not take the engine's packets.
+      //
+      ws_recvfrom = reinterpret_cast<recvfrom_t> (
+        GetProcAddress (GetModuleHandleA ("ws2_32.dll"), "recvfrom"));
+
+      if (ws_recvfrom != nullptr)
+      {
+        detour (bdSocketReceiveFrom, socket_receive_from);
+        detour (ws_recvfrom, &receive_from);
+      }
+      else
+      {
+        log::error << "unable to resolve recvfrom, not demultiplexing the "
+                   << "shared socket";
+
+        detour (bdSocketReceiveFrom, socket_peek_receive_from);
+      }
+
+      exit_process = reinterpret_cast<ExitProcess_t> (
+        GetProcAddress (GetModuleHandleA ("kernel32.dll"), "ExitProcess"));
+
+      if (exit_process != nullptr)
+        detour (exit_process, &exit_process_hook);
+
+      // The console commands can only be added once the engine's command
+      // system is up.
+      //
+      scheduler::post (com_frame_domain,
+                       []
+      {
+        if (*com_init_complete != 0)
+          register_commands ();
+      },
+      repeat_until_predicate {[]
+      {
+        return *com_init_complete != 0;
+      }});
+    }
+
+    net::recv_demux_stats
+    demonware_receive_stats ()
+    {
+      return demux.stats ();
     }
   }
 }
@@ -2,6 +2,8 @@
 
 #include <libiw4x/import.hxx>
 
+#include <libiw4x/net/recv-demux.hxx>
+
 namespace iw4x
 {
   namespace mod
@@ -11,5 +13,11 @@ namespace iw4x
     public:
       demonware_module ();
     };
+
+    // Statistics of the shared socket's receive demultiplexer (see the
+    // net_stats console command).
+    //
+    net::recv_demux_stats
+    demonware_receive_stats ();
   }
 }
@@ -0,0 +1,335 @@
+#include <libiw4x/mod/mod-discovery.hxx>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <libiw4x/logger.hxx>
+#include <libiw4x/scheduler.hxx>
+
+#include <libiw4x/mod/mod-dedicated.hxx>
+#include <libiw4x/mod/mod-network.hxx>
+#include <libiw4x/mod/mod-oob.hxx>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace
+    {
+      unique_ptr<discovery::discovery_service> service;
+
+      // The master to use, as <address>[:<port>]. Note that the address has
+      // to be numeric.
+      //
+      optional<net::udp_endpoint>
+      master_endpoint ()
+      {
+        const char* v (getenv ("IW4X_MASTER"));
+
+        if (v == nullptr || *v == '\0')
+          return nullopt;
+
+        string s (v);
+
+        if (s.find (':') == string::npos)
+          s += ':' + to_string (discovery::default_master_port);
+
+        optional<net::udp_endpoint> r (discovery::parse_endpoint (s));
+
+        if (!r)
+          log::error << "invalid IW4X_MASTER value '" << v << "'";
+
+        return r;
+      }
+
+      // Cached the first time update_server () finds it registered, the same
+      // way as sv_lan_only_dvar, so that we don't do a string lookup on every
+      // frame.
+      //
+      const dvar* sv_running_dvar (nullptr);
+
+      bool
+      dvar_enabled (const dvar* d)
+      {
+        return d != nullptr && d->current.enabled;
+      }
+
+      // Build the info string from the server info dvars, the same ones the
+      // engine puts into its getinfo/getstatus responses.
+      //
+      // Note that a backslash would break the \key\value structure so we
+      // drop any that a value happens to contain.
+      //
+      string
+      serverinfo ()
+      {
+        string r;
+
+        auto append ([&r] (const char* s)
+        {
+          r += '\\';
+
+          for (; *s != '\0'; ++s)
+          {
+            if (*s != '\\')
+              r += *s;
+          }
+        });
+
+        for (int i (0), n (*dvarCount); i < n; ++i)
+        {
+          dvar& d (dvar_pool[i]);
+
+          if ((d.flags & DVAR_SERVERINFO) == 0 || d.name == nullptr)
+            continue;
+
+          const char* v (Dvar_DisplayableValue (&d));
+
+          append (d.name);
+          append (v != nullptr ? v : "");
+        }
+
+        return r;
+      }
+
+      // Keep the advertised info and the heartbeats in line with the server
+      // state.
+      //
+      // A server is advertised while it is running, unless it is LAN-only.
+      // The info string is only rebuilt when the server info dvars change,
+      // which the fingerprint tells us cheaply.
+      //
+      void
+      update_server ()
+      {
+        static uint64_t fingerprint (0);
+
+        if (sv_running_dvar == nullptr)
+          sv_running_dvar = Dvar_FindVar ("sv_running");
+
+        bool run (dvar_enabled (sv_running_dvar) &&
+                  !dvar_enabled (sv_lan_only_dvar));
+
+        if (run != service->heartbeats_enabled ())
+        {
+          log::info << (run ? "starting" : "stopping")
+                    << " master server heartbeats";
+
+          service->enable_heartbeats (run);
+        }
+
+        if (!run)
+          return;
+
+        uint64_t f (serverinfo_fingerprint ());
+
+        if (f != fingerprint)
+        {
+          fingerprint = f;
+
+          string i (serverinfo ());
+
+          if (!discovery::valid_info (i))
+            log::warning << "server info is not advertisable ("
+                         << i.size () << " bytes)";
+
+          service->set_info (move (i));
+        }
+
+        service->tick ();
+      }
+
+      // servers_refresh
+      //
+      // Bring the server list up to date with the master.
+      //
+      void __fastcall
+      servers_refresh_f ()
+      {
+        const discovery::server_list& l (service->servers ());
+
+        log::info << "requesting server list changes since version "
+                  << l.version () << " (" << l.size () << " servers)";
+
+        if (!service->refresh ())
+          log::error << "unable to send server list request";
+      }
+
+      // Results of the servers_ping run in progress.
+      //
+      struct ping_run
+      {
+        size_t outstanding = 0;
+        size_t replied = 0;
+        chrono::microseconds min {chrono::microseconds::max ()};
+        chrono::microseconds max {0};
+        chrono::microseconds sum {0};
+        chrono::steady_clock::time_point start;
+      };
+
+      ping_run pings;
+
+      void
+      ping_result (const oob::oob_ping_result& r)
+      {
+        if (pings.outstanding == 0)
+          return;
+
+        if (r.replied)
+        {
+          ++pings.replied;
+          pings.min = std::min (pings.min, r.rtt);
+          pings.max = std::max (pings.max, r.rtt);
+          pings.sum += r.rtt;
+        }
+
+        if (--pings.outstanding != 0)
+          return;
+
+        auto ms ([] (chrono::microseconds d) {return d.count () / 1000.0;});
+
+        log::info << "pinged servers in "
+                  << ms (chrono::duration_cast<chrono::microseconds> (
+                           chrono::steady_clock::now () - pings.start))
+                  << " ms: " << pings.replied << " replied";
+
+        if (pings.replied != 0)
+          log::info << "rtt min/avg/max "
+                    << ms (pings.min) << "/"
+                    << ms (pings.sum / pings.replied) << "/"
+                    << ms (pings.max) << " ms";
+      }
+
+      // servers_ping
+      //
+      // Ping every server in the list (all at once, paced by the pinger).
+      //
+      void __fastcall
+      servers_ping_f ()
+      {
+        if (pings.outstanding != 0)
+        {
+          log::warning << pings.outstanding << " server pings still pending";
+          return;
+        }
+
+        pings = ping_run ();
+        pings.start = chrono::steady_clock::now ();
+
+        for (const auto& [k, s] : service->servers ().servers ())
+        {
+          network_address a {};
+          a.type = NETWORK_ADDRESS_IP;
+          memcpy (a.ip, s.endpoint.address, 4);
+          a.port = s.endpoint.port;
+
+          if (pinger ().ping (a, server_browser_ping))
+            ++pings.outstanding;
+        }
+
+        log::info << "pinging " << pings.outstanding << " servers";
+      }
+
+      void
+      register_commands ()
+      {
+        static command_function_s refresh_cmd;
+        static command_function_s ping_cmd;
+
+        Cmd_AddCommandInternal ("servers_refresh",
+                                servers_refresh_f,
+                                &refresh_cmd);
+
+        Cmd_AddCommandInternal ("servers_ping", servers_ping_f, &ping_cmd);
+      }
+    }
+
+    discovery::discovery_service*
+    active_discovery_service ()
+    {
+      return service.get ();
+    }
+
+    void
+    discovery_servers (const network_address& a, string_view p)
+    {
+      if (!service)
+        return;
+
+      if (!service->handle (endpoint (a), p))
+        return;
+
+      const discovery::server_list& l (service->servers ());
+      size_t removed (0);
+
+      for (const discovery::server_change& c : l.last_changes ())
+      {
+        if (c.removed)
+          ++removed;
+      }
+
+      log::info << "server list at version " << l.version () << ": "
+                << l.size () << " servers, "
+                << l.last_changes ().size () - removed << " updated, "
+                << removed << " removed";
+    }
+
+    discovery_module::
+    discovery_module ()
+    {
+      optional<net::udp_endpoint> m (master_endpoint ());
+
+      if (!m)
+      {
+        log::info << "no master server configured, discovery disabled";
+        return;
+      }
+
+      log::info << "using master server " << discovery::format_endpoint (*m);
+
+      service = make_unique<discovery::discovery_service> (
+        *m,
+        [] (const net::udp_endpoint& e, const char* d, size_t n)
+      {
+        network_address a {};
+        a.type = NETWORK_ADDRESS_IP;
+        memcpy (a.ip, e.address, 4);
+        a.port = e.port;
+
+        return send_packet (a, d, n);
+      });
+
+      pinger ().on_result (server_browser_ping, ping_result);
+
+      // The dvars only exist and the console commands can only be added
+      // once the engine is initialized.
+      //
+      scheduler::post (com_frame_domain,
+                       []
+      {
+        if (*com_init_complete != 0)
+          register_commands ();
+      },
+      repeat_until_predicate {[]
+      {
+        return *com_init_complete != 0;
+      }});
+
+      scheduler::post (com_frame_domain,
+                       []
+      {
+        if (*com_init_complete != 0)
+          update_server ();
+      }, repeat_every_tick);
+    }
+  }
+}
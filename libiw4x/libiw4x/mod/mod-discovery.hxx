@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string_view>
+
+#include <libiw4x/import.hxx>
+
+#include <libiw4x/discovery/discovery-service.hxx>
+
+namespace iw4x
+{
+  namespace mod
+  {
+    class discovery_module
+    {
+    public:
+      discovery_module ();
+    };
+
+    // The discovery service or NULL if no master is configured (see
+    // IW4X_MASTER in mod-discovery.cxx).
+    //
+    discovery::discovery_service*
+    active_discovery_service ();
+
+    // Handle a server list (part) received over the OOB pipeline.
+    //
+    void
+    discovery_servers (const network_address&, std::string_view payload);
+  }
+}
@@ -1,10 +1,29 @@
 #include <libiw4x/mod/mod-network.hxx>
 
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include <libiw4x/detour.hxx>
 #include <libiw4x/logger.hxx>
 #include <libiw4x/scheduler.hxx>
 
+#include <libiw4x/net/send-queue.hxx>
+#include <libiw4x/net/udp-socket.hxx>
+
+#include <libiw4x/mod/mod-demonware.hxx>
 #include <libiw4x/mod/mod-oob.hxx>
+#include <libiw4x/mod/oob/oob-commands.hxx>
+#include <libiw4x/mod/oob/oob-connect-cookie.hxx>
+#include <libiw4x/mod/oob/oob-query-cache.hxx>
+#include <libiw4x/mod/oob/oob-tokenizer.hxx>
 
 using namespace std;
 
@@ -105,34 +124,124 @@ namespace iw4x
       }
     }
 
-    // Extract the first whitespace-delimited token after the 4-byte OOB header
-    // (0xFF 0xFF 0xFF 0xFF).
+    // Server browser query responses (see oob_query_cache for details).
+    //
+    static oob::oob_query_cache query_cache;
+
+    // Fingerprint of the server info dvars, that is, what the engine puts
+    // into the query responses.
     //
-    // @wroyca: We'll want to use oob:: instead.
+    // The list of server info dvars is cached and only rebuilt when a dvar
+    // is registered, so all this costs per frame is hashing a dozen or so
+    // values. Note that we hash the string contents rather than pointers
+    // since the engine may reuse the storage.
     //
-    string
-    grep_oob (const char* d, int s)
+    uint64_t
+    serverinfo_fingerprint ()
     {
-      if (s <= 4)
-        return {};
+      static vector<const dvar*> ds;
+      static int n (-1);
+
+      if (*dvarCount != n)
+      {
+        n = *dvarCount;
+        ds.clear ();
 
-      const char* b (d + 4);
-      const char* e (d + s);
+        for (int i (0); i < n; ++i)
+        {
+          if (dvar_pool[i].flags & DVAR_SERVERINFO)
+            ds.push_back (&dvar_pool[i]);
+        }
+      }
 
-      // Skip any leading whitespace.
+      // FNV-1a.
       //
-      while (b < e && (*b == ' ' || *b == '\t' || *b == '\r'))
-        ++b;
+      uint64_t h (0xcbf29ce484222325);
 
-      const char* t (b);
+      auto mix ([&h] (const void* p, size_t z)
+      {
+        const unsigned char* b (static_cast<const unsigned char*> (p));
+
+        for (size_t i (0); i != z; ++i)
+          h = (h ^ b[i]) * 0x100000001b3;
+      });
 
-      // Find the end of the token.
+      for (const dvar* d : ds)
+      {
+        if (d->type == DVAR_TYPE_STRING)
+        {
+          if (const char* v = d->current.string)
+            mix (v, strlen (v) + 1);
+        }
+        else
+          mix (&d->current, sizeof (vec4_t));
+      }
+
+      return h;
+    }
+
+    bool
+    sys_send_packet (int, const char*, const network_address*);
+
+    // Connect challenge cookies (see oob_connect_cookies for details).
+    //
+    static oob::oob_connect_cookies cookies;
+
+    static void
+    send_cookie (const network_address& a)
+    {
+      char b[4 + 14 + oob::oob_connect_cookies::cookie_size];
+      memcpy (b, "\xFF\xFF\xFF\xFF" "connectCookie ", 18);
+      oob::oob_connect_cookies::format (b + 18, cookies.issue (a));
+
+      sys_send_packet (static_cast<int> (sizeof (b)), b, &a);
+    }
+
+    // Verify the cookie of a "cookie <cookie> connect ..." packet and, if
+    // valid, turn it back into the connect the client's engine sent by
+    // stripping the prefix in place. Return false if the connect should be
+    // dropped.
+    //
+    static bool
+    accept_cookie (const network_address& a, message& m, string_view c)
+    {
+      char* b (m.data + 4);
+      char* e (m.data + m.current_size);
+
+      auto skip ([e] (char* p)
+      {
+        while (p != e && (*p == ' ' || *p == '\t'))
+          ++p;
+        return p;
+      });
+
+      // The cookie follows the command word.
       //
-      while (t < e && *t != ' ' && *t != '\t' && *t != '\r' && *t != '\n' &&
-             *t != '\0')
-        ++t;
+      size_t o (static_cast<size_t> (c.data () + c.size () - m.data));
+      char* p (skip (m.data + o));
+      char* pe (p);
+
+      while (pe != e && *pe != ' ' && *pe != '\t')
+        ++pe;
+
+      optional<uint64_t> v (
+        oob::oob_connect_cookies::parse (
+          string_view (p, static_cast<size_t> (pe - p))));
+
+      if (!v || !cookies.verify (a, *v))
+        return false;
+
+      char* r (skip (pe));
+
+      memmove (b, r, static_cast<size_t> (e - r));
+      m.current_size -= static_cast<int> (r - b);
 
-      return string (b, t);
+      // Whatever the cookie came with, it had better be a connect.
+      //
+      return oob::classify_command (
+               oob::command_token (m.data,
+                                   static_cast<size_t> (m.current_size))) ==
+             oob::oob_command::connect;
     }
 
     void
@@ -153,29 +262,91 @@ namespace iw4x
 
         if (o)
         {
-          string c (grep_oob (m->data, m->current_size));
+          string_view c (
+            oob::command_token (m->data,
+                                static_cast<size_t> (m->current_size)));
+
+          // Dispatch to our global OOB pipeline.
+          //
+          // If the packet was consumed, or dropped (say, because its source is
+          // over its rate limit), we return early to prevent the engine from
+          // logging a spurious unknown command. Note that this happens before
+          // the 'connect' handling below so that a connect flood does not
+          // get to touch the transport pointers.
+          //
+          if (oob_dispatch (a, m))
+          {
+            log::trace_l1 << "dispatched and consumed oob command '" << c
+                          << "'";
+            return;
+          }
+
+          oob::oob_command k (oob::classify_command (c));
+
+          // Only let a connect through once its source has shown that it can
+          // receive at its address: answer a plain connect with a cookie and
+          // pass on the connect that comes back with it. Either way, a
+          // connect from a spoofed source ends here, before the engine or
+          // the code below sets anything up for it.
+          //
+          if (k == oob::oob_command::connect)
+          {
+            log::trace_l1 << "answering 'connect' with a challenge cookie";
+            send_cookie (*a);
+            return;
+          }
+
+          if (k == oob::oob_command::cookie)
+          {
+            if (!accept_cookie (*a, *m, c))
+            {
+              log::debug << "invalid or expired connect cookie, reissuing";
+              send_cookie (*a);
+              return;
+            }
+
+            k = oob::oob_command::connect;
+          }
 
           // Before the engine gets its hands on a 'connect' command, we need to
           // make sure we clean up those stale DW transport pointers.
           //
-          if (c == "connect")
+          // A connect also (most likely) changes the client list so drop the
+          // cached query responses.
+          //
+          if (k == oob::oob_command::connect)
           {
             log::debug << "intercepted 'connect' oob command, cleaning up "
                           "transport pointers";
             setup_dums ();
+            query_cache.invalidate ();
           }
 
-          // Dispatch to our global OOB pipeline.
-          //
-          // If the disposition dictates that the packet was consumed, we return
-          // early to prevent the engine from logging a spurious unknown
-          // command.
+          // Answer server browser queries from the cache if we can. If not,
+          // let the engine answer and keep a copy of its response.
           //
-          if (oob_dispatch (a, m))
+          if (k == oob::oob_command::getinfo ||
+              k == oob::oob_command::getstatus)
           {
-            log::trace_l1 << "dispatched and consumed oob command '" << c
-                          << "'";
-            return;
+            oob::oob_args args (
+              string_view (m->data + 4,
+                           static_cast<size_t> (m->current_size - 4)));
+
+            static array<char, oob::oob_query_cache::max_response> r;
+
+            if (size_t n = query_cache.respond (k, args[1], r))
+            {
+              log::trace_l2 << "answered '" << c << "' from cache";
+              sys_send_packet (static_cast<int> (n), r.data (), a);
+              return;
+            }
+
+            if (query_cache.capture_begin (k, args[1]))
+            {
+              SV_ConnectionlessPacket (a, m);
+              query_cache.capture_end ();
+              return;
+            }
           }
         }
       }
@@ -183,17 +354,85 @@ namespace iw4x
       SV_ConnectionlessPacket (a, m);
     }
 
+    // Outgoing IP packets, sent in one batch at the end of each frame where
+    // the socket supports batch sends and right away otherwise (see
+    // send_queue for details).
+    //
+    static net::send_queue sends;
+
+    static net::udp_socket
+    dw_socket ()
+    {
+      return net::udp_socket (
+        static_cast<net::udp_socket::native_handle_type> (bd_s));
+    }
+
+    // The client side of the connect cookies: the last connect we sent and
+    // the cookie its server answered it with, if any.
+    //
+    struct pending_connect
+    {
+      network_address address;
+      string packet;
+      optional<uint64_t> cookie;
+    };
+
+    static pending_connect connecting;
+
+    static inline bool
+    same_endpoint (const network_address& x, const network_address& y)
+    {
+      return memcmp (x.ip, y.ip, sizeof (x.ip)) == 0 && x.port == y.port;
+    }
+
+    // If the packet is a connect, remember it and, if we have its server's
+    // cookie, return the packet with the cookie prefix added.
+    //
+    static optional<string>
+    cookie_connect (const network_address& a, const char* d, int l)
+    {
+      if (l <= 4                                 ||
+          memcmp (d, "\xFF\xFF\xFF\xFF", 4) != 0 ||
+          oob::classify_command (
+            oob::command_token (d, static_cast<size_t> (l))) !=
+          oob::oob_command::connect)
+        return nullopt;
+
+      if (!same_endpoint (a, connecting.address))
+        connecting.cookie.reset ();
+
+      connecting.address = a;
+      connecting.packet.assign (d, static_cast<size_t> (l));
+
+      if (!connecting.cookie)
+        return nullopt;
+
+      char c[oob::oob_connect_cookies::cookie_size];
+      oob::oob_connect_cookies::format (c, *connecting.cookie);
+
+      string r ("\xFF\xFF\xFF\xFF" "cookie ");
+      r.append (c, sizeof (c));
+      r += ' ';
+      r.append (d + 4, static_cast<size_t> (l - 4));
+
+      return r;
+    }
+
     // Bypass the engine's DW bdConnection path for IP sends.
     //
     // Normally, NET_OutOfBandPrint routes IP packets through bdConnectionStore,
-    // which ends up adding DW framing. We intercept this here and use a plain
-    // sendto() on the raw socket so the actual OOB traffic reaches the peer
-    // undisturbed.
+    // which ends up adding DW framing. We intercept this here and queue the
+    // packet for the raw socket instead so the actual OOB traffic reaches the
+    // peer undisturbed. The queue is flushed at the end of the frame (see the
+    // constructor below).
     //
 
     bool
     sys_send_packet (int l, const char* d, const network_address* a)
     {
+      if (query_cache.capturing () && l > 0)
+        query_cache.capture (d, static_cast<size_t> (l));
+
       // The engine tags addresses from NET_GetPacket as BROADCAST (3) and keeps
       // them that way during the challenge/response phase. We need to intercept
       // both IP and BROADCAST so they go through our sendto path rather than
@@ -213,41 +452,221 @@ namespace iw4x
         return Sys_SendPacket (l, d, a);
       }
 
-      SOCKET s (bd_s);
-
-      if (s == INVALID_SOCKET || s == 0)
+      if (bd_s == INVALID_SOCKET || bd_s == 0)
       {
         log::warning
           << "dropping outgoing oob packet: invalid demonware socket";
         return false;
       }
 
-      sockaddr_in sa {};
-      sa.sin_family = AF_INET;
+      // Present the server's cookie with our connects.
+      //
+      optional<string> cp (cookie_connect (*a, d, l));
 
-      memcpy (&sa.sin_addr, a->ip, 4);
+      if (cp)
+      {
+        d = cp->data ();
+        l = static_cast<int> (cp->size ());
+      }
 
-      sa.sin_port = a->port;
+      net::udp_endpoint e {};
+      memcpy (e.address, a->ip, 4);
+      e.port = a->port;
 
-      log::trace_l3 << "sending raw oob packet (" << l
+      log::trace_l3 << "queueing raw oob packet (" << l
                     << " bytes) bypassing dw framing";
 
-      int r (sendto (s,
-                     static_cast<const char*> (d),
-                     l,
-                     0,
-                     reinterpret_cast<sockaddr*> (&sa),
-                     sizeof (sa)));
+      net::udp_socket s (dw_socket ());
 
-      if (r == SOCKET_ERROR)
+      if (l < 0 || !sends.enqueue (s, e, d, static_cast<size_t> (l)))
       {
-        log::error << "sendto failed for custom oob packet";
+        log::error << "unable to queue oob packet (" << l << " bytes)";
+        network_stats ().send_failed (e);
         return false;
       }
 
+      network_stats ().sent (e, d, static_cast<size_t> (l));
       return true;
     }
 
+    bool
+    send_packet (const network_address& a, const char* d, size_t n)
+    {
+      return sys_send_packet (static_cast<int> (n), d, &a);
+    }
+
+    void
+    connect_cookie (const network_address& a, string_view c)
+    {
+      optional<uint64_t> v (oob::oob_connect_cookies::parse (c));
+
+      if (!v || connecting.packet.empty () ||
+          !same_endpoint (a, connecting.address))
+      {
+        log::debug << "ignoring unsolicited connect cookie";
+        return;
+      }
+
+      // Resend right away rather than wait for the engine's next attempt.
+      // But only if the cookie is new: a server that keeps rejecting it
+      // would otherwise have us bounce connects back and forth.
+      //
+      if (connecting.cookie == v)
+        return;
+
+      connecting.cookie = v;
+
+      log::debug << "resending connect with challenge cookie";
+
+      string p (connecting.packet);
+      sys_send_packet (static_cast<int> (p.size ()), p.data (), &a);
+    }
+
+    net::peer_stats&
+    network_stats ()
+    {
+      static net::peer_stats s;
+      return s;
+    }
+
+    namespace
+    {
+      // Probe every recently active peer for its RTT once a second.
+      //
+      // The probes go through the shared pinger, which paces them along with
+      // everything else it sends and matches the pongs. Note that the peer
+      // stats only count a reply to an outstanding probe.
+      //
+      void
+      probe_peers ()
+      {
+        using namespace chrono;
+
+        static steady_clock::time_point next;
+
+        steady_clock::time_point now (steady_clock::now ());
+
+        if (now < next)
+          return;
+
+        next = now + seconds (1);
+
+        net::peer_stats& ps (network_stats ());
+
+        for (const net::peer_stats_entry& p : ps.peers (seconds (5), now))
+        {
+          network_address a {};
+          a.type = NETWORK_ADDRESS_IP;
+          memcpy (a.ip, p.endpoint.address, 4);
+          a.port = p.endpoint.port;
+
+          if (pinger ().ping (a, peer_probe_ping))
+            ps.probe_sent (p.endpoint);
+        }
+      }
+
+      // Write each line of the output to the log since that is where our
+      // console output ends up.
+      //
+      void
+      log_lines (const string& s)
+      {
+        for (size_t b (0), e; b < s.size (); b = e + 1)
+        {
+          e = s.find ('\n', b);
+
+          if (e == string::npos)
+            e = s.size ();
+
+          log::info << string_view (s).substr (b, e - b);
+        }
+      }
+
+      // net_stats
+      //
+      // Print the per-peer traffic statistics.
+      //
+      void __fastcall
+      net_stats_f ()
+      {
+        ostringstream os;
+        network_stats ().print (os);
+
+        net::send_queue_stats q (sends.stats ());
+
+        os << "send queue: " << q.sent << " sent in " << q.batches
+           << " batches, " << q.failures << " failures, " << q.would_block
+           << " would block, " << q.dropped << " dropped\n";
+
+        net::recv_demux_stats r (demonware_receive_stats ());
+
+        os << "receive demux: " << r.received << " received in " << r.calls
+           << " calls, " << r.stun << " stun, " << r.game << " game, "
+           << r.oversized << " oversized, " << r.dropped << " dropped, "
+           << r.high_water << " high water\n";
+
+        oob::oob_pinger_stats p (pinger ().stats ());
+
+        os << "pinger: " << p.sent << " sent, " << p.replies << " replies, "
+           << p.timeouts << " timeouts, " << p.unmatched << " unmatched, rtt "
+           << p.rtt_min.count () / 1000.0 << "/"
+           << p.rtt_avg.count () / 1000.0 << "/"
+           << p.rtt_max.count () / 1000.0 << " ms, jitter "
+           << p.jitter.count () / 1000.0 << " ms\n";
+
+        oob::oob_query_stats c (query_cache.stats ());
+
+        os << "query cache: " << c.hits << " hits, " << c.misses
+           << " misses, " << c.captures << " captures, " << c.invalidations
+           << " invalidations\n";
+
+        oob::oob_cookie_stats k (cookies.stats ());
+
+        os << "connect cookies: " << k.issued << " issued, " << k.verified
+           << " verified, " << k.rejected << " rejected\n";
+
+        log_lines (os.str ());
+      }
+
+      // net_stats_dump [<file>]
+      //
+      // Write the per-peer traffic statistics as JSON, to net_stats.json in
+      // the current directory by default.
+      //
+      void __fastcall
+      net_stats_dump_f ()
+      {
+        int i (cmd_args->nesting);
+
+        const char* p (cmd_args->argument_count[i] > 1
+                       ? cmd_args->argument_vector[i][1]
+                       : "net_stats.json");
+
+        ofstream ofs (p);
+
+        if (ofs)
+          network_stats ().write_json (ofs);
+
+        if (!ofs)
+        {
+          log::error << "unable to write network statistics to " << p;
+          return;
+        }
+
+        log::info << "wrote network statistics to " << p;
+      }
+
+      void
+      register_commands ()
+      {
+        static command_function_s stats_cmd;
+        static command_function_s dump_cmd;
+
+        Cmd_AddCommandInternal ("net_stats", net_stats_f, &stats_cmd);
+        Cmd_AddCommandInternal ("net_stats_dump", net_stats_dump_f, &dump_cmd);
+      }
+    }
+
     network_module::network_module ()
     {
       log::info << "initializing network module";
@@ -255,10 +674,43 @@ namespace iw4x
       detour (SV_ConnectionlessPacket,  sv_connectionless_packet);
       detour (Sys_SendPacket,           sys_send_packet);
 
+      sends.on_drop ([] (const net::udp_datagram& d)
+      {
+        network_stats ().send_failed (d.to);
+      });
+
+      pinger ().on_result (peer_probe_ping, [] (const oob::oob_ping_result& r)
+      {
+        if (r.replied)
+          network_stats ().probe_reply (endpoint (r.address), r.rtt);
+      });
+
+      // The console commands can only be added once the engine's command
+      // system is up.
+      //
       scheduler::post (com_frame_domain,
                        []
       {
+        if (*com_init_complete != 0)
+          register_commands ();
+      },
+      repeat_until_predicate {[]
+      {
+        return *com_init_complete != 0;
+      }});
+
+      scheduler::post (com_frame_domain,
+                       []
+      {
+        // Flush before (re)adopting so that this frame's packets go out on
+        // the socket they were meant for.
+        //
+        net::udp_socket s (dw_socket ());
+        sends.flush (s);
+
         adopt_dw_s ();
+        query_cache.frame (serverinfo_fingerprint ());
+        probe_peers ();
       }, repeat_every_tick);
     }
   }
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
 #include <libiw4x/import.hxx>
 
+#include <libiw4x/net/peer-stats.hxx>
+#include <libiw4x/net/udp-socket.hxx>
+
 namespace iw4x
 {
   namespace mod
@@ -11,5 +18,37 @@ namespace iw4x
     public:
       network_module ();
     };
+
+    // Send a packet to a remote peer the same way the engine's own packets
+    // are sent, that is, queued for the adopted socket.
+    //
+    bool
+    send_packet (const network_address&, const char* data, std::size_t size);
+
+    // Handle a server's answer to our connect (see oob_connect_cookies).
+    //
+    void
+    connect_cookie (const network_address&, std::string_view cookie);
+
+    // Fingerprint of the server info dvars. It changes whenever what the
+    // server advertises does.
+    //
+    std::uint64_t
+    serverinfo_fingerprint ();
+
+    // Per-peer traffic statistics (see the net_stats console command).
+    //
+    net::peer_stats&
+    network_stats ();
+
+    inline net::udp_endpoint
+    endpoint (const network_address& a)
+    {
+      net::udp_endpoint e {};
+      for (std::size_t i (0); i != 4; ++i)
+        e.address[i] = static_cast<unsigned char> (a.ip[i]);
+      e.port = a.port;
+      return e;
+    }
   }
 }
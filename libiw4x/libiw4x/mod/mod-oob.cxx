@@ -1,15 +1,24 @@
 #include <libiw4x/mod/mod-oob.hxx>
 
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 #include <libiw4x/logger.hxx>
 #include <libiw4x/scheduler.hxx>
+#include <libiw4x/mod/mod-discovery.hxx>
+#include <libiw4x/mod/mod-network.hxx>
+#include <libiw4x/mod/oob/oob-capture.hxx>
 #include <libiw4x/mod/oob/oob-pipeline.hxx>
 
 using namespace std;
@@ -20,11 +29,36 @@ namespace iw4x
   {
     oob::oob_pipeline* active_pipeline (nullptr);
 
+    namespace
+    {
+      // Packet capture (see IW4X_OOB_CAPTURE below).
+      //
+      oob::oob_capture_writer capture;
+      atomic<bool> capturing (false);
+      chrono::steady_clock::time_point capture_start;
+    }
+
     extern "C"
     {
       bool
       oob_dispatch (const network_address* a, const message* m)
       {
+        // Note that we record the packet before the pipeline sees it so that
+        // whatever it ends up rejecting (say, a flood) is captured too.
+        //
+        if (capturing.load (memory_order_acquire) &&
+            m->data != nullptr && m->current_size > 0)
+        {
+          auto t (chrono::steady_clock::now () - capture_start);
+
+          capture.write (
+            static_cast<uint64_t> (
+              chrono::duration_cast<chrono::microseconds> (t).count ()),
+            *a,
+            m->data,
+            static_cast<size_t> (m->current_size));
+        }
+
         const oob::oob_disposition d (active_pipeline->process (*a, *m));
         return d != oob::oob_disposition::forward_to_engine;
       }
@@ -33,6 +67,18 @@ namespace iw4x
       oob_dispatch_stub ();
     }
 
+    oob::oob_pinger&
+    pinger ()
+    {
+      static oob::oob_pinger p (
+        [] (const network_address& a, const char* d, size_t n)
+      {
+        return send_packet (a, d, n);
+      });
+
+      return p;
+    }
+
     oob_module::
     oob_module ()
     {
@@ -41,6 +87,73 @@ namespace iw4x
 
       active_pipeline = &oob_pipeline;
 
+      // Answer pings by echoing the first argument back in a pong. This is
+      // what the other side uses to measure its RTT to us (see oob_pinger).
+      //
+      oob_dispatcher.on_ping ([] (const oob::oob_ping_message& m)
+      {
+        string_view t (m.args[0]);
+
+        if (t.empty () || t.size () > oob::oob_pinger::max_token)
+          return;
+
+        char b[48];
+        int n (snprintf (b, sizeof (b), "\xFF\xFF\xFF\xFFpong %.*s",
+                         static_cast<int> (t.size ()), t.data ()));
+
+        send_packet (m.source.address, b, static_cast<size_t> (n));
+      });
+
+      // The pong to one of our pings echoes its token.
+      //
+      oob_dispatcher.on_pong ([] (const oob::oob_pong_message& m)
+      {
+        pinger ().pong (m.source.address, m.args[0]);
+      });
+
+      // Server list (parts) from the master.
+      //
+      oob_dispatcher.on_servers ([] (const oob::oob_servers_message& m)
+      {
+        discovery_servers (m.source.address, m.payload);
+      });
+
+      // A server's challenge cookie in answer to our connect.
+      //
+      oob_dispatcher.on_connect_cookie (
+        [] (const oob::oob_connect_cookie_message& m)
+      {
+        connect_cookie (m.source.address, m.args[0]);
+      });
+
+      // Dispatch the queued messages at the end of every frame. Tick the
+      // pinger after so that this frame's pongs are in before it times out
+      // any pings.
+      //
+      scheduler::post (com_frame_domain,
+                       []
+      {
+        active_pipeline->tick ();
+        pinger ().tick ();
+      }, repeat_every_tick);
+
+      // Capture connectionless packets for offline replay (see the oob-replay
+      // tool) if requested.
+      //
+      if (const char* p = getenv ("IW4X_OOB_CAPTURE");
+          p != nullptr && *p != '\0')
+      {
+        if (capture.open (p))
+        {
+          capture_start = chrono::steady_clock::now ();
+          capturing.store (true, memory_order_release);
+
+          log::info << "capturing oob packets to " << p;
+        }
+        else
+          log::warning << "unable to open oob capture " << p;
+      }
+
       // Install the OOB packet interception loop.
       //
       // Note that we bypass our standard detour utility for this hook. The
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstdint>
+
 #include <libiw4x/import.hxx>
 
+#include <libiw4x/mod/oob/oob-pinger.hxx>
+
 namespace iw4x
 {
   namespace mod
@@ -18,5 +22,15 @@ namespace iw4x
       explicit
       oob_module ();
     };
+
+    // Pinger shared by everything that measures RTTs, ticked every frame.
+    //
+    oob::oob_pinger&
+    pinger ();
+
+    // Result tags of the pinger's users (see oob_pinger::on_result ()).
+    //
+    inline constexpr std::uint32_t peer_probe_ping = 1;
+    inline constexpr std::uint32_t server_browser_ping = 2;
   }
 }
@@ -0,0 +1,97 @@
+#include <libiw4x/mod/oob/oob-capture.hxx>
+
+#include <cstring>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      namespace
+      {
+        constexpr char magic[8] = {'I', 'W', '4', 'X', 'O', 'O', 'B', '\0'};
+        constexpr uint32_t version (1);
+
+        // Fixed part of a record.
+        //
+        constexpr size_t record_header_size (18);
+
+        // Records are flushed in batches since, unlike DemonWare tasks, a
+        // busy server receives thousands of these per second. So a crash may
+        // lose the last few.
+        //
+        constexpr size_t flush_interval (64);
+      }
+
+      // oob_capture_writer
+      //
+
+      oob_capture_writer::
+      oob_capture_writer ()
+        : file_ (flush_interval)
+      {
+      }
+
+      bool oob_capture_writer::
+      open (const filesystem::path& p)
+      {
+        return file_.open (p, magic, version);
+      }
+
+      void oob_capture_writer::
+      write (uint64_t t, const network_address& a, const char* d, size_t n)
+      {
+        // The size has to fit the record and there is no such thing as a
+        // 64KB UDP packet anyway.
+        //
+        if (d == nullptr || n > 0xFFFF)
+          return;
+
+        file_.write (record_header_size + n, [&] (char* p)
+        {
+          store_le (p, t);
+          p[8] = static_cast<char> (a.type);
+          p[9] = 0;
+          store_le (p + 10, static_cast<uint16_t> (n));
+          memcpy (p + 12, a.ip, 4);
+          memcpy (p + 16, &a.port, 2);
+
+          if (n != 0)
+            memcpy (p + record_header_size, d, n);
+        });
+      }
+
+      // oob_capture_reader
+      //
+
+      bool oob_capture_reader::
+      open (const filesystem::path& p)
+      {
+        return file_.open (p, magic, version);
+      }
+
+      bool oob_capture_reader::
+      read (oob_capture_record& r)
+      {
+        char h[record_header_size];
+
+        if (!file_.read_header (h, sizeof (h)))
+          return false;
+
+        r.time = load_le<uint64_t> (h);
+        r.address = network_address {};
+        r.address.type = static_cast<network_address_type> (
+          static_cast<unsigned char> (h[8]));
+        memcpy (r.address.ip, h + 12, 4);
+        memcpy (&r.address.port, h + 16, 2);
+
+        r.data.resize (load_le<uint16_t> (h + 10));
+
+        return file_.read (r.data.data (), r.data.size ());
+      }
+    }
+  }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <libiw4x/import-network.hxx>
+#include <libiw4x/record-file.hxx>
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      // Connectionless packet capture.
+      //
+      // A capture is a sequence of records, each holding a packet as it
+      // arrived at oob_dispatch () together with its source address and the
+      // time it arrived. It is written by the OOB module in the capture mode
+      // (see IW4X_OOB_CAPTURE) and read back by the oob-replay tool. It is a
+      // record file (see record-file.hxx) with the following records:
+      //
+      //   magic:  "IW4XOOB\0"
+      //   record: uint64(time) uint8(address type) uint8(0) uint16(size)
+      //           ip[4] port[2]
+      //           packet bytes
+      //
+      // The time is in microseconds since the capture was started. All
+      // integers are little-endian except for the address and port which are
+      // stored as is, that is, in network order.
+      //
+      struct oob_capture_record
+      {
+        std::uint64_t time = 0;
+        network_address address {};
+        std::vector<char> data;
+      };
+
+      class oob_capture_writer
+      {
+      public:
+        oob_capture_writer ();
+
+        // Create (or truncate) the capture file and write the header.
+        //
+        bool
+        open (const std::filesystem::path&);
+
+        bool
+        is_open () const {return file_.is_open ();}
+
+        // Append a record. Safe to call from multiple threads.
+        //
+        void
+        write (std::uint64_t time,
+               const network_address&,
+               const char* data,
+               std::size_t size);
+
+      private:
+        record_file_writer file_;
+      };
+
+      class oob_capture_reader
+      {
+      public:
+        // Open the capture and verify the header.
+        //
+        bool
+        open (const std::filesystem::path&);
+
+        // Read the next record. Return false at the end of the capture or if
+        // the record is truncated, in which case error () is true.
+        //
+        bool
+        read (oob_capture_record&);
+
+        bool
+        error () const {return file_.error ();}
+
+      private:
+        record_file_reader file_;
+      };
+    }
+  }
+}
@@ -0,0 +1,230 @@
+#include <libiw4x/mod/oob/oob-commands.hxx>
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      namespace
+      {
+        struct command_name
+        {
+          string_view name;
+          oob_command command;
+        };
+
+        // The known commands. This is the only place that needs updating
+        // when adding one: the lookup table below is generated from it at
+        // compile time. Like the engine, we match them ignoring case.
+        //
+        constexpr command_name commands[] = {
+          {"ping",          oob_command::ping},
+          {"pong",          oob_command::pong},
+          {"connect",       oob_command::connect},
+          {"getinfo",       oob_command::getinfo},
+          {"getstatus",     oob_command::getstatus},
+          {"serversDelta",  oob_command::servers_delta},
+          {"cookie",        oob_command::cookie},
+          {"connectCookie", oob_command::connect_cookie}};
+
+        // Longest command we can represent. Each command is stored as two
+        // little-endian words, zero-padded.
+        //
+        constexpr size_t max_length (16);
+
+        constexpr unsigned int table_bits (5);
+        constexpr size_t table_size (size_t (1) << table_bits);
+
+        // Keep the table at most half full so a perfect multiplier is easy
+        // to find.
+        //
+        static_assert (size (commands) <= table_size / 2);
+
+        // The runtime path loads the words with memcpy (), which only
+        // matches the compile-time layout on a little-endian host.
+        //
+        static_assert (endian::native == endian::little);
+
+        // Load up to 8 characters starting at offset o as a word.
+        //
+        constexpr uint64_t
+        load_word (string_view s, size_t o)
+        {
+          if (o >= s.size ())
+            return 0;
+
+          size_t n (min (s.size () - o, size_t (8)));
+          uint64_t r (0);
+
+          if consteval
+          {
+            for (size_t i (0); i != n; ++i)
+              r |= uint64_t (static_cast<unsigned char> (s[o + i])) << (8 * i);
+          }
+          else
+          {
+            memcpy (&r, s.data () + o, n);
+          }
+
+          return r;
+        }
+
+        // Convert the upper-case ASCII letters in a word to lower case, all
+        // eight at once: the high bit of the two sums is set in the bytes
+        // that are at least 'A' and past 'Z', respectively, and bytes with
+        // the high bit already set are left alone.
+        //
+        constexpr uint64_t
+        fold_case (uint64_t w)
+        {
+          constexpr uint64_t h (0x8080808080808080);
+
+          uint64_t l (w & ~h);
+          uint64_t a (l + 0x3F3F3F3F3F3F3F3F); // 0x80 - 'A'
+          uint64_t z (l + 0x2525252525252525); // 0x80 - 'Z' - 1
+
+          return w | ((a & ~z & ~w & h) >> 2);
+        }
+
+        constexpr size_t
+        slot (uint64_t w0, uint64_t w1, size_t n, uint64_t seed)
+        {
+          uint64_t k (w0 ^ rotl (w1, 29) ^ n);
+          return static_cast<size_t> ((k * seed) >> (64 - table_bits));
+        }
+
+        constexpr bool
+        perfect (uint64_t seed)
+        {
+          array<bool, table_size> used {};
+
+          for (const command_name& c : commands)
+          {
+            size_t i (slot (fold_case (load_word (c.name, 0)),
+                            fold_case (load_word (c.name, 8)),
+                            c.name.size (),
+                            seed));
+            if (used[i])
+              return false;
+
+            used[i] = true;
+          }
+
+          return true;
+        }
+
+        // Find a multiplier that maps every command to its own slot by
+        // trying odd constants until one works.
+        //
+        constexpr uint64_t
+        find_seed ()
+        {
+          uint64_t s (0x9E3779B97F4A7C15);
+
+          for (size_t i (0); i != 4096; ++i, s += 0x6A09E667F3BCC908)
+          {
+            if (perfect (s))
+              return s;
+          }
+
+          return 0;
+        }
+
+        constexpr uint64_t seed (find_seed ());
+
+        static_assert (seed != 0,
+                       "no perfect hash for the oob commands, "
+                       "increase table_bits");
+
+        struct table_entry
+        {
+          uint64_t w0;
+          uint64_t w1;
+          size_t length; // 0 for an empty slot.
+          oob_command command;
+        };
+
+        constexpr array<table_entry, table_size> table ([]
+        {
+          array<table_entry, table_size> t {};
+
+          for (const command_name& c : commands)
+          {
+            uint64_t w0 (fold_case (load_word (c.name, 0)));
+            uint64_t w1 (fold_case (load_word (c.name, 8)));
+
+            t[slot (w0, w1, c.name.size (), seed)] =
+              table_entry {w0, w1, c.name.size (), c.command};
+          }
+
+          return t;
+        } ());
+
+        constexpr bool
+        valid_names ()
+        {
+          for (const command_name& c : commands)
+          {
+            if (c.name.empty () || c.name.size () > max_length)
+              return false;
+          }
+
+          return true;
+        }
+
+        static_assert (valid_names ());
+
+        constexpr bool
+        whitespace (char c)
+        {
+          return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        }
+      }
+
+      string_view
+      command_token (const char* d, size_t s)
+      {
+        if (d == nullptr || s <= 4)
+          return {};
+
+        const char* b (d + 4);
+        const char* e (d + s);
+
+        while (b != e && whitespace (*b))
+          ++b;
+
+        const char* t (b);
+
+        while (t != e && !whitespace (*t) && *t != '\0')
+          ++t;
+
+        return string_view (b, static_cast<size_t> (t - b));
+      }
+
+      oob_command
+      classify_command (string_view s)
+      {
+        size_t n (s.size ());
+
+        if (n == 0 || n > max_length)
+          return oob_command::unknown;
+
+        uint64_t w0 (fold_case (load_word (s, 0)));
+        uint64_t w1 (fold_case (load_word (s, 8)));
+
+        const table_entry& e (table[slot (w0, w1, n, seed)]);
+
+        return e.length == n && e.w0 == w0 && e.w1 == w1
+               ? e.command
+               : oob_command::unknown;
+      }
+    }
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      // Connectionless commands we know about.
+      //
+      // This covers both the commands handled by our pipeline and the engine
+      // commands we need to recognize on the way to SV_ConnectionlessPacket.
+      // The actual command strings live in the table in oob-commands.cxx.
+      //
+      enum class oob_command : std::uint8_t
+      {
+        unknown,
+        ping,
+        pong,
+        connect,
+        getinfo,
+        getstatus,
+        servers_delta,
+        cookie,
+        connect_cookie
+      };
+
+      // Return the command word that follows the OOB header, that is, the
+      // first token delimited by whitespace or null. Leading whitespace is
+      // skipped. Return an empty view if there is no such token.
+      //
+      // Note that the view refers to the packet data.
+      //
+      std::string_view
+      command_token (const char* data, std::size_t size);
+
+      // Classify a command word, ignoring ASCII case the same as the engine
+      // does (so "CONNECT" is a connect).
+      //
+      // The lookup is a perfect hash over the known commands that is
+      // generated at compile time: anything that does not match is rejected
+      // after a length check and a word compare, without allocating and
+      // without looking at more than the first 16 characters.
+      //
+      oob_command
+      classify_command (std::string_view);
+    }
+  }
+}
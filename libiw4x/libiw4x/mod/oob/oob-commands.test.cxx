@@ -0,0 +1,167 @@
+// Tests for command_token () and classify_command ().
+//
+// The engine matches connectionless commands ignoring case so, for example,
+// "CONNECT" must classify as a connect or it would bypass everything we do
+// for connects. Besides the obvious cases, every character of every command
+// is replaced with every byte value and the result checked against a plain
+// ASCII case-insensitive compare.
+//
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <libiw4x/mod/oob/oob-commands.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace iw4x::mod::oob;
+
+namespace
+{
+  struct command_name
+  {
+    string_view name;
+    oob_command command;
+  };
+
+  const command_name commands[] = {
+    {"ping",          oob_command::ping},
+    {"pong",          oob_command::pong},
+    {"connect",       oob_command::connect},
+    {"getinfo",       oob_command::getinfo},
+    {"getstatus",     oob_command::getstatus},
+    {"serversDelta",  oob_command::servers_delta},
+    {"cookie",        oob_command::cookie},
+    {"connectCookie", oob_command::connect_cookie}};
+
+  char
+  lower (char c)
+  {
+    return c >= 'A' && c <= 'Z' ? static_cast<char> (c - 'A' + 'a') : c;
+  }
+
+  char
+  upper (char c)
+  {
+    return c >= 'a' && c <= 'z' ? static_cast<char> (c - 'a' + 'A') : c;
+  }
+
+  bool
+  iequal (string_view x, string_view y)
+  {
+    if (x.size () != y.size ())
+      return false;
+
+    for (size_t i (0); i != x.size (); ++i)
+    {
+      if (lower (x[i]) != lower (y[i]))
+        return false;
+    }
+
+    return true;
+  }
+
+  void
+  test_case ()
+  {
+    assert (classify_command ("CONNECT") == oob_command::connect);
+    assert (classify_command ("Connect") == oob_command::connect);
+    assert (classify_command ("connect") == oob_command::connect);
+    assert (classify_command ("CONNECTCOOKIE") == oob_command::connect_cookie);
+    assert (classify_command ("serversdelta") == oob_command::servers_delta);
+    assert (classify_command ("GetStatus") == oob_command::getstatus);
+
+    for (const command_name& c : commands)
+    {
+      string l, u, m;
+
+      for (size_t i (0); i != c.name.size (); ++i)
+      {
+        l += lower (c.name[i]);
+        u += upper (c.name[i]);
+        m += i % 2 == 0 ? upper (c.name[i]) : lower (c.name[i]);
+      }
+
+      assert (classify_command (c.name) == c.command);
+      assert (classify_command (l) == c.command);
+      assert (classify_command (u) == c.command);
+      assert (classify_command (m) == c.command);
+    }
+  }
+
+  void
+  test_substitution ()
+  {
+    for (const command_name& c : commands)
+    {
+      for (size_t i (0); i != c.name.size (); ++i)
+      {
+        for (unsigned int b (0); b != 256; ++b)
+        {
+          string s (c.name);
+          s[i] = static_cast<char> (b);
+
+          oob_command e (oob_command::unknown);
+
+          for (const command_name& x : commands)
+          {
+            if (iequal (s, x.name))
+              e = x.command;
+          }
+
+          assert (classify_command (s) == e);
+        }
+      }
+    }
+  }
+
+  void
+  test_unknown ()
+  {
+    for (string_view s : {"", "c", "conn", "connec", "connectt", "xconnect",
+                          "connect ", "pingpong", "connectCookieX",
+                          "serversDelta1234567"})
+      assert (classify_command (s) == oob_command::unknown);
+
+    assert (classify_command (string_view ("CONNECT\0", 8)) ==
+            oob_command::unknown);
+
+    // Not that far from the letters in ASCII.
+    //
+    assert (classify_command ("CONNECT\x7f") == oob_command::unknown);
+    assert (classify_command ("c@nnect") == oob_command::unknown);
+    assert (classify_command ("connec\xd4") == oob_command::unknown);
+  }
+
+  void
+  test_token ()
+  {
+    auto token ([] (string_view p)
+    {
+      return command_token (p.data (), p.size ());
+    });
+
+    assert (token ("\xFF\xFF\xFF\xFF" "connect \"\\name\\x\"") == "connect");
+    assert (token ("\xFF\xFF\xFF\xFF" "  \tCONNECT\n") == "CONNECT");
+    assert (token (string_view ("\xFF\xFF\xFF\xFF" "ping\0pong", 13)) ==
+            "ping");
+    assert (token ("\xFF\xFF\xFF\xFF" "getinfo") == "getinfo");
+    assert (token ("\xFF\xFF\xFF\xFF" "   ").empty ());
+    assert (token ("\xFF\xFF\xFF\xFF").empty ());
+    assert (command_token (nullptr, 10).empty ());
+
+    assert (classify_command (token ("\xFF\xFF\xFF\xFF" "CONNECT \"\"")) ==
+            oob_command::connect);
+  }
+}
+
+int
+main ()
+{
+  test_case ();
+  test_substitution ();
+  test_unknown ();
+  test_token ();
+}
@@ -0,0 +1,155 @@
+#include <libiw4x/mod/oob/oob-connect-cookie.hxx>
+
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <random>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      namespace
+      {
+        inline void
+        sip_round (uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3)
+        {
+          v0 += v1; v1 = rotl (v1, 13); v1 ^= v0; v0 = rotl (v0, 32);
+          v2 += v3; v3 = rotl (v3, 16); v3 ^= v2;
+          v0 += v3; v3 = rotl (v3, 21); v3 ^= v0;
+          v2 += v1; v1 = rotl (v1, 17); v1 ^= v2; v2 = rotl (v2, 32);
+        }
+
+        // SipHash-2-4 of a message of less than 8 bytes, which is all we
+        // need for an IPv4 address and port. Such a message is just the
+        // final block: the bytes with the length in the top one.
+        //
+        uint64_t
+        siphash (const array<uint64_t, 2>& k, uint64_t m, size_t n)
+        {
+          uint64_t v0 (k[0] ^ 0x736f6d6570736575);
+          uint64_t v1 (k[1] ^ 0x646f72616e646f6d);
+          uint64_t v2 (k[0] ^ 0x6c7967656e657261);
+          uint64_t v3 (k[1] ^ 0x7465646279746573);
+
+          uint64_t b (m | uint64_t (n) << 56);
+
+          v3 ^= b;
+          sip_round (v0, v1, v2, v3);
+          sip_round (v0, v1, v2, v3);
+          v0 ^= b;
+
+          v2 ^= 0xFF;
+
+          for (size_t i (0); i != 4; ++i)
+            sip_round (v0, v1, v2, v3);
+
+          return v0 ^ v1 ^ v2 ^ v3;
+        }
+
+        array<uint64_t, 2>
+        random_key ()
+        {
+          random_device rd;
+          array<uint64_t, 2> k;
+
+          for (uint64_t& w : k)
+            w = uint64_t (rd ()) << 32 | rd ();
+
+          return k;
+        }
+      }
+
+      oob_connect_cookies::
+      oob_connect_cookies ()
+        : current_ (random_key ()),
+          previous_ (random_key ()),
+          rotated_ (clock::now ())
+      {
+      }
+
+      uint64_t oob_connect_cookies::
+      mac (const array<uint64_t, 2>& k, const network_address& a)
+      {
+        // Address and port, little-endian, the same as SipHash reads its
+        // input.
+        //
+        uint64_t m (0);
+
+        for (size_t i (0); i != 4; ++i)
+          m |= uint64_t (static_cast<unsigned char> (a.ip[i])) << (8 * i);
+
+        m |= uint64_t (a.port) << 32;
+
+        return siphash (k, m, 6);
+      }
+
+      void oob_connect_cookies::
+      rotate (clock::time_point now)
+      {
+        if (now - rotated_ < rotation)
+          return;
+
+        // If we have been idle for more than a period, the previous secret
+        // is stale too.
+        //
+        previous_ = now - rotated_ < 2 * rotation ? current_ : random_key ();
+        current_ = random_key ();
+        rotated_ = now;
+      }
+
+      uint64_t oob_connect_cookies::
+      issue (const network_address& a, clock::time_point now)
+      {
+        rotate (now);
+
+        ++stats_.issued;
+        return mac (current_, a);
+      }
+
+      bool oob_connect_cookies::
+      verify (const network_address& a, uint64_t c, clock::time_point now)
+      {
+        rotate (now);
+
+        if (c == mac (current_, a) || c == mac (previous_, a))
+        {
+          ++stats_.verified;
+          return true;
+        }
+
+        ++stats_.rejected;
+        return false;
+      }
+
+      void oob_connect_cookies::
+      format (char* o, uint64_t c)
+      {
+        static const char digits[] = "0123456789abcdef";
+
+        for (size_t i (0); i != cookie_size; ++i)
+          o[i] = digits[c >> (60 - 4 * i) & 0xF];
+      }
+
+      optional<uint64_t> oob_connect_cookies::
+      parse (string_view s)
+      {
+        uint64_t r;
+
+        if (s.size () != cookie_size)
+          return nullopt;
+
+        auto [p, ec] = from_chars (s.data (), s.data () + s.size (), r, 16);
+
+        if (ec != errc () || p != s.data () + s.size ())
+          return nullopt;
+
+        return r;
+      }
+    }
+  }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include <libiw4x/import-network.hxx>
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      struct oob_cookie_stats
+      {
+        std::uint64_t issued;   // Cookies handed out.
+        std::uint64_t verified; // Connects that presented a valid cookie.
+        std::uint64_t rejected; // Connects with a wrong or expired one.
+      };
+
+      // Stateless challenge cookies for the connect handshake.
+      //
+      // A connect makes the engine set up per-client state so we don't let
+      // one through unless its source has proven that it can receive at the
+      // address it claims, which a spoofed source can't. The handshake goes
+      // like this:
+      //
+      // client: connect ...
+      // server: connectCookie <cookie>
+      // client: cookie <cookie> connect ...
+      //
+      // The server drops the first connect after answering it and passes the
+      // second one, less the cookie prefix, on to the engine. On the client
+      // side this is done transparently for the engine's connect packets (see
+      // mod-network.cxx).
+      //
+      // Like SYN cookies, nothing is remembered between the two: the cookie
+      // is a MAC of the source address and port under a secret that only the
+      // server knows, so verifying it is recomputing it. A connect flood from
+      // spoofed sources costs one MAC per packet and the answers go to the
+      // spoofed addresses.
+      //
+      // The secret is replaced every rotation period and the previous one is
+      // still accepted, so a cookie stays valid for at least that long.
+      //
+      // The MAC is SipHash-2-4, which is a keyed PRF made for short inputs
+      // like these. It is cheaper than an HMAC over a general-purpose hash
+      // and doesn't need a crypto library.
+      //
+      // Note that this is not thread-safe: connects are handled on the
+      // engine's main thread.
+      //
+      class oob_connect_cookies
+      {
+      public:
+        using clock = std::chrono::steady_clock;
+
+        static constexpr std::chrono::seconds rotation {30};
+
+        // Cookies are 16 hex digits.
+        //
+        static constexpr std::size_t cookie_size = 16;
+
+        oob_connect_cookies ();
+
+        oob_connect_cookies (const oob_connect_cookies&) = delete;
+        oob_connect_cookies& operator = (const oob_connect_cookies&) = delete;
+
+        std::uint64_t
+        issue (const network_address&, clock::time_point = clock::now ());
+
+        bool
+        verify (const network_address&,
+                std::uint64_t cookie,
+                clock::time_point = clock::now ());
+
+        oob_cookie_stats
+        stats () const {return stats_;}
+
+        static void
+        format (char* out, std::uint64_t cookie);
+
+        static std::optional<std::uint64_t>
+        parse (std::string_view);
+
+        // Keyed hash of a source address, exposed for testing.
+        //
+        static std::uint64_t
+        mac (const std::array<std::uint64_t, 2>& key, const network_address&);
+
+      private:
+        void
+        rotate (clock::time_point);
+
+        std::array<std::uint64_t, 2> current_;
+        std::array<std::uint64_t, 2> previous_;
+        clock::time_point rotated_;
+
+        oob_cookie_stats stats_ {};
+      };
+    }
+  }
+}
@@ -0,0 +1,198 @@
+// Tests for oob_connect_cookies.
+//
+// The MAC is checked against the SipHash-2-4 reference vector for a 6-byte
+// message, which happens to be exactly an address and port. The rest goes
+// through issue () and verify () with simulated time to check what is
+// accepted across secret rotations.
+//
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include <libiw4x/mod/oob/oob-connect-cookie.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace std::chrono;
+using namespace iw4x;
+using namespace iw4x::mod::oob;
+
+namespace
+{
+  using clock_type = oob_connect_cookies::clock;
+
+  constexpr seconds rotation (oob_connect_cookies::rotation);
+
+  network_address
+  address (unsigned char last, uint16_t port)
+  {
+    network_address a {};
+    a.type = NETWORK_ADDRESS_IP;
+    a.ip[0] = 10;
+    a.ip[3] = static_cast<char> (last);
+    a.port = port;
+    return a;
+  }
+
+  void
+  test_mac ()
+  {
+    // Key 00..0f and message 00..05 (the address 0.1.2.3 and the port bytes
+    // 04 05) from the SipHash paper.
+    //
+    const array<uint64_t, 2> k {0x0706050403020100, 0x0f0e0d0c0b0a0908};
+
+    network_address a {};
+    for (size_t i (0); i != 4; ++i)
+      a.ip[i] = static_cast<char> (i);
+    a.port = 0x0504;
+
+    uint64_t m (oob_connect_cookies::mac (k, a));
+    assert (m == 0xcbc9466e58fee3ce);
+
+    // Only the address and port go in.
+    //
+    network_address b (a);
+    b.type = NETWORK_ADDRESS_BROADCAST;
+    assert (oob_connect_cookies::mac (k, b) == m);
+
+    b = a;
+    b.port = 0x0505;
+    assert (oob_connect_cookies::mac (k, b) != m);
+
+    b = a;
+    b.ip[3] = 4;
+    assert (oob_connect_cookies::mac (k, b) != m);
+
+    array<uint64_t, 2> j (k);
+    j[1] ^= 1;
+    assert (oob_connect_cookies::mac (j, a) != m);
+  }
+
+  void
+  test_verify ()
+  {
+    oob_connect_cookies cs;
+    clock_type::time_point t (clock_type::now ());
+
+    network_address a (address (1, 28960));
+    uint64_t c (cs.issue (a, t));
+
+    assert (cs.verify (a, c, t));
+    assert (cs.verify (a, c, t + seconds (1)));
+    assert (!cs.verify (a, c + 1, t));
+
+    // Nothing is remembered so the same cookie can be presented again.
+    //
+    assert (cs.verify (a, c, t + seconds (2)));
+
+    // Reissuing within the period gives the same cookie.
+    //
+    assert (cs.issue (a, t + seconds (3)) == c);
+
+    // A different source does not get to use it.
+    //
+    assert (!cs.verify (address (2, 28960), c, t));
+
+    oob_cookie_stats s (cs.stats ());
+    assert (s.issued == 2 && s.verified == 3 && s.rejected == 2);
+  }
+
+  // The cookie is bound to the port the connect came from: a NAT that picks
+  // a new mapping between the connects has to go through the handshake again.
+  //
+  void
+  test_port ()
+  {
+    oob_connect_cookies cs;
+    clock_type::time_point t (clock_type::now ());
+
+    network_address a (address (1, 28960));
+    uint64_t c (cs.issue (a, t));
+
+    network_address b (a);
+    b.port = 28961;
+
+    assert (!cs.verify (b, c, t));
+    assert (cs.issue (b, t) != c);
+    assert (cs.verify (a, c, t));
+  }
+
+  // After a rotation the cookie is still accepted under the previous secret
+  // and after the second one it has expired.
+  //
+  void
+  test_rotation ()
+  {
+    oob_connect_cookies cs;
+    clock_type::time_point t (clock_type::now ());
+
+    network_address a (address (1, 28960));
+    uint64_t c (cs.issue (a, t));
+
+    t += rotation;
+    assert (cs.verify (a, c, t));
+
+    uint64_t d (cs.issue (a, t));
+    assert (d != c);
+
+    t += rotation;
+    assert (!cs.verify (a, c, t));
+    assert (cs.verify (a, d, t));
+
+    t += rotation;
+    assert (!cs.verify (a, d, t));
+
+    // Idle for longer than two periods: the previous secret is fresh rather
+    // than the one the cookie was issued under.
+    //
+    uint64_t e (cs.issue (a, t));
+
+    t += 2 * rotation + seconds (1);
+    assert (!cs.verify (a, e, t));
+  }
+
+  void
+  test_format ()
+  {
+    char b[oob_connect_cookies::cookie_size];
+
+    for (uint64_t c : {uint64_t (0),
+                       uint64_t (1),
+                       uint64_t (0xcbc9466e58fee3ce),
+                       uint64_t (0xffffffffffffffff)})
+    {
+      oob_connect_cookies::format (b, c);
+
+      optional<uint64_t> r (
+        oob_connect_cookies::parse (string_view (b, sizeof (b))));
+
+      assert (r && *r == c);
+    }
+
+    oob_connect_cookies::format (b, 0x0123456789abcdef);
+    assert (string_view (b, sizeof (b)) == "0123456789abcdef");
+
+    assert (oob_connect_cookies::parse ("0123456789ABCDEF") ==
+            uint64_t (0x0123456789abcdef));
+
+    for (string_view s : {"", "0", "0123456789abcde", "0123456789abcdef0",
+                          "0123456789abcdeg", "-123456789abcdef",
+                          "0x23456789abcdef", " 123456789abcdef"})
+      assert (!oob_connect_cookies::parse (s));
+  }
+}
+
+int
+main ()
+{
+  test_mac ();
+  test_verify ();
+  test_port ();
+  test_rotation ();
+  test_format ();
+}
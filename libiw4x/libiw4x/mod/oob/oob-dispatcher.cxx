@@ -24,6 +24,21 @@ namespace iw4x
         pong_handler_ = move (h);
       }
 
+      void oob_dispatcher::
+      on_servers (move_only_function<void (const oob_servers_message&)> h)
+      {
+        log::trace_l1 << "registering oob servers handler";
+        servers_handler_ = move (h);
+      }
+
+      void oob_dispatcher::
+      on_connect_cookie (
+        move_only_function<void (const oob_connect_cookie_message&)> h)
+      {
+        log::trace_l1 << "registering oob connect cookie handler";
+        connect_cookie_handler_ = move (h);
+      }
+
       void oob_dispatcher::
       dispatch (const oob_message& m)
       {
@@ -66,6 +81,30 @@ namespace iw4x
             else
               log::debug << "unhandled oob pong message dropped";
           }
+
+          void
+          operator () (const oob_servers_message& m) const
+          {
+            if (self.servers_handler_)
+            {
+              log::trace_l1 << "handling oob servers message";
+              self.servers_handler_ (m);
+            }
+            else
+              log::debug << "unhandled oob servers message dropped";
+          }
+
+          void
+          operator () (const oob_connect_cookie_message& m) const
+          {
+            if (self.connect_cookie_handler_)
+            {
+              log::trace_l1 << "handling oob connect cookie message";
+              self.connect_cookie_handler_ (m);
+            }
+            else
+              log::debug << "unhandled oob connect cookie message dropped";
+          }
         };
 
         // Dispatch the message variant against our current state.
@@ -30,6 +30,19 @@ namespace iw4x
         on_pong (
           std::move_only_function<void (const oob_pong_message&)> handler);
 
+        // Register a handler for server list messages.
+        //
+        void
+        on_servers (
+          std::move_only_function<void (const oob_servers_message&)> handler);
+
+        // Register a handler for connect cookie messages.
+        //
+        void
+        on_connect_cookie (
+          std::move_only_function<void (const oob_connect_cookie_message&)>
+            handler);
+
         // Dispatch a generic OOB message.
         //
         void
@@ -38,6 +51,10 @@ namespace iw4x
       private:
         std::move_only_function<void (const oob_ping_message&)> ping_handler_;
         std::move_only_function<void (const oob_pong_message&)> pong_handler_;
+        std::move_only_function<void (const oob_servers_message&)>
+          servers_handler_;
+        std::move_only_function<void (const oob_connect_cookie_message&)>
+          connect_cookie_handler_;
       };
     }
   }
@@ -1,10 +1,11 @@
 #include <libiw4x/mod/oob/oob-envelope.hxx>
 
 #include <string_view>
-#include <unordered_map>
 
 #include <libiw4x/logger.hxx>
 
+#include <libiw4x/mod/oob/oob-commands.hxx>
+
 using namespace std;
 
 namespace iw4x
@@ -15,19 +16,23 @@ namespace iw4x
     {
       namespace
       {
-        // Central registry mapping OOB command strings to typed message ids. We
+        // Map the commands handled by the pipeline to typed message ids. We
         // do this at the edge so the rest of the pipeline only deals with
         // integers, not strings.
         //
-        const unordered_map<string_view, oob_message_id> cmds ({
-          {"ping", oob_message_id::ping},
-          {"pong", oob_message_id::pong},
-        });
-
-        // The maximum command length we are willing to parse. If the first
-        // token is longer than this, it's bogus and we reject it immediately.
-        //
-        constexpr size_t max_cmd (32);
+        optional<oob_message_id>
+        message_id (oob_command c)
+        {
+          switch (c)
+          {
+          case oob_command::ping:          return oob_message_id::ping;
+          case oob_command::pong:          return oob_message_id::pong;
+          case oob_command::servers_delta: return oob_message_id::servers_delta;
+          case oob_command::connect_cookie:
+            return oob_message_id::connect_cookie;
+          default:                         return nullopt;
+          }
+        }
 
         // The four-byte OOB header. Every valid out-of-band packet must start
         // with four of these. https://www.jfedor.org/quake3/
@@ -66,36 +71,32 @@ namespace iw4x
         // Find the command word. It's the first token right after the header
         // and is delimited by whitespace or null.
         //
-        const char* p (m.data + 4);
         const char* e (m.data + m.current_size);
+        const string_view c (
+          command_token (m.data, static_cast<size_t> (m.current_size)));
 
-        const char* const s (p);
-
-        while (p < e && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\0')
-          ++p;
-
-        const size_t n (static_cast<size_t> (p - s));
-
-        if (n == 0 || n > max_cmd)
+        if (c.empty ())
         {
-          log::debug << "malformed oob command length: " << n;
+          log::debug << "malformed oob packet without command";
           return nullopt;
         }
 
-        // Try to identify the command. If it's unknown we just return nullopt.
+        // Try to identify the command. If it's unknown (or not one of ours)
+        // we just return nullopt.
         //
         // Note that this is not an error, that is, the engine might know what
         // to do with it so the pipeline will forward it.
         //
-        const string_view c (s, n);
-        const auto i (cmds.find (c));
+        const optional<oob_message_id> id (message_id (classify_command (c)));
 
-        if (i == cmds.end ())
+        if (!id)
         {
           log::trace_l2 << "forwarding unknown oob command to engine: " << c;
           return nullopt;
         }
 
+        const char* p (c.data () + c.size ());
+
         // Eat any whitespace separating the command from its payload.
         //
         while (p < e && (*p == ' ' || *p == '\t'))
@@ -108,7 +109,7 @@ namespace iw4x
 
         log::trace_l2 << "parsed oob envelope for command: " << c;
 
-        return oob_envelope (oob_source_endpoint (a), i->second, r);
+        return oob_envelope (oob_source_endpoint (a), *id, r);
       }
     }
   }
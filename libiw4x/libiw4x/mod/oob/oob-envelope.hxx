@@ -4,7 +4,7 @@
 
 #include <libiw4x/mod/oob/oob-types.hxx>
 
-#include <libiw4x/import.hxx>
+#include <libiw4x/import-network.hxx>
 
 namespace iw4x
 {
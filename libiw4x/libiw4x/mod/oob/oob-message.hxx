@@ -1,7 +1,9 @@
 #pragma once
 
+#include <string_view>
 #include <variant>
 
+#include <libiw4x/mod/oob/oob-tokenizer.hxx>
 #include <libiw4x/mod/oob/oob-types.hxx>
 
 namespace iw4x
@@ -10,10 +12,35 @@ namespace iw4x
   {
     namespace oob
     {
-      struct oob_ping_message { oob_source_endpoint source; };
-      struct oob_pong_message { oob_source_endpoint source; };
+      // Note that the arguments are views into the queued packet and are
+      // only valid for the duration of the handler call. Copy whatever needs
+      // to outlive it.
+      //
+      struct oob_ping_message { oob_source_endpoint source; oob_args args; };
+      struct oob_pong_message { oob_source_endpoint source; oob_args args; };
 
-      using oob_message = std::variant<oob_ping_message, oob_pong_message>;
+      // A server list (part) from the master. The payload is everything after
+      // the command word, records and all, since it is not a simple argument
+      // list (see discovery-protocol.hxx for the format).
+      //
+      struct oob_servers_message
+      {
+        oob_source_endpoint source;
+        std::string_view payload;
+      };
+
+      // A server's answer to our connect (see oob_connect_cookies).
+      //
+      struct oob_connect_cookie_message
+      {
+        oob_source_endpoint source;
+        oob_args args;
+      };
+
+      using oob_message = std::variant<oob_ping_message,
+                                       oob_pong_message,
+                                       oob_servers_message,
+                                       oob_connect_cookie_message>;
     }
   }
 }
@@ -1,6 +1,7 @@
 #include <libiw4x/mod/oob/oob-parser.hxx>
 
 #include <cassert>
+#include <string_view>
 #include <unordered_map>
 
 #include <libiw4x/logger.hxx>
@@ -20,18 +21,42 @@ namespace iw4x
         // We pass the decoded envelope to each of these so they can produce a
         // typed message.
 
+        // View the payload as characters for the tokenizer.
+        //
+        inline string_view
+        payload_text (const oob_envelope& e)
+        {
+          return string_view (reinterpret_cast<const char*> (e.payload.data ()),
+                              e.payload.size ());
+        }
+
         optional<oob_message>
         parse_ping (const oob_envelope& e)
         {
           log::trace_l3 << "parsing ping message payload";
-          return oob_ping_message (e.source);
+          return oob_ping_message (e.source, oob_args (payload_text (e)));
         }
 
         optional<oob_message>
         parse_pong (const oob_envelope& e)
         {
           log::trace_l3 << "parsing pong message payload";
-          return oob_pong_message (e.source);
+          return oob_pong_message (e.source, oob_args (payload_text (e)));
+        }
+
+        optional<oob_message>
+        parse_servers (const oob_envelope& e)
+        {
+          log::trace_l3 << "parsing servers message payload";
+          return oob_servers_message (e.source, payload_text (e));
+        }
+
+        optional<oob_message>
+        parse_connect_cookie (const oob_envelope& e)
+        {
+          log::trace_l3 << "parsing connect cookie message payload";
+          return oob_connect_cookie_message (e.source,
+                                             oob_args (payload_text (e)));
         }
 
         // Map message ids to their parse functions. Note that every registered
@@ -40,8 +65,10 @@ namespace iw4x
         using pfn = optional<oob_message> (*) (const oob_envelope&);
 
         const unordered_map<oob_message_id, pfn> tab {
-          {oob_message_id::ping, parse_ping},
-          {oob_message_id::pong, parse_pong}};
+          {oob_message_id::ping,           parse_ping},
+          {oob_message_id::pong,           parse_pong},
+          {oob_message_id::servers_delta,  parse_servers},
+          {oob_message_id::connect_cookie, parse_connect_cookie}};
       }
 
       optional<oob_message>
@@ -0,0 +1,333 @@
+#include <libiw4x/mod/oob/oob-pinger.hxx>
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+#include <libiw4x/logger.hxx>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      namespace
+      {
+        constexpr unsigned int table_bits (static_cast<unsigned int> (
+          countr_zero (2 * oob_pinger::max_outstanding)));
+
+        inline size_t
+        home (uint32_t seq)
+        {
+          // Fibonacci hashing. Sequence numbers are consecutive so even the
+          // identity would do, but this keeps us honest if that changes.
+          //
+          return static_cast<size_t> ((seq * 0x9E3779B1u) >> (32 - table_bits));
+        }
+
+        // Compare only the IP and port: the engine may report the same peer
+        // with a different address type (say, IP vs broadcast) than the one
+        // we pinged.
+        //
+        inline bool
+        same_address (const network_address& x, const network_address& y)
+        {
+          return memcmp (x.ip, y.ip, sizeof (x.ip)) == 0 && x.port == y.port;
+        }
+      }
+
+      oob_pinger::
+      oob_pinger (send_function s,
+                  uint32_t r,
+                  uint32_t b,
+                  clock::duration t)
+        : send_ (move (s)),
+          rate_ (max (r, uint32_t (1))),
+          burst_ (max (b, uint32_t (1))),
+          timeout_ (t)
+      {
+        static_assert (has_single_bit (table_size));
+      }
+
+      void oob_pinger::
+      on_result (uint32_t tag, result_handler h)
+      {
+        for (auto& p : handlers_)
+        {
+          if (p.first == tag)
+          {
+            p.second = move (h);
+            return;
+          }
+        }
+
+        handlers_.emplace_back (tag, move (h));
+      }
+
+      bool oob_pinger::
+      ping (const network_address& a, uint32_t tag)
+      {
+        if (backlog_.size () == max_backlog)
+        {
+          ++stats_.overflows;
+          return false;
+        }
+
+        backlog_.push_back (queued {a, tag});
+        ++stats_.queued;
+        return true;
+      }
+
+      int64_t oob_pinger::
+      timestamp (clock::time_point t)
+      {
+        return duration_cast<chrono::microseconds> (
+          t.time_since_epoch ()).count ();
+      }
+
+      size_t oob_pinger::
+      find (uint32_t seq) const
+      {
+        for (size_t i (home (seq));; i = (i + 1) & (table_size - 1))
+        {
+          const entry& e (table_[i]);
+
+          if (e.seq == seq)
+            return i;
+
+          if (e.seq == 0)
+            return table_size;
+        }
+      }
+
+      void oob_pinger::
+      erase (size_t i)
+      {
+        // Backward shift deletion: move the entries that follow in the same
+        // cluster into the hole if that brings them closer to home, so that
+        // lookups never have to step over deleted slots.
+        //
+        for (size_t j (i);;)
+        {
+          j = (j + 1) & (table_size - 1);
+
+          if (table_[j].seq == 0)
+            break;
+
+          size_t h (home (table_[j].seq));
+
+          // Move j into i unless its home is cyclically in (i, j].
+          //
+          if (i <= j ? (h <= i || h > j) : (h <= i && h > j))
+          {
+            table_[i] = table_[j];
+            i = j;
+          }
+        }
+
+        table_[i].seq = 0;
+        --outstanding_;
+      }
+
+      void oob_pinger::
+      report (const entry& e, bool replied, chrono::microseconds rtt)
+      {
+        for (auto& p : handlers_)
+        {
+          if (p.first == e.tag)
+          {
+            if (p.second)
+              p.second (oob_ping_result {e.address, e.tag, replied, rtt});
+
+            return;
+          }
+        }
+      }
+
+      void oob_pinger::
+      sample (chrono::microseconds rtt)
+      {
+        int64_t r (rtt.count ());
+
+        if (stats_.replies == 1 || rtt < stats_.rtt_min)
+          stats_.rtt_min = rtt;
+
+        if (rtt > stats_.rtt_max)
+          stats_.rtt_max = rtt;
+
+        rtt_sum_ += static_cast<uint64_t> (r);
+
+        // J += (|D| - J) / 16
+        //
+        if (rtt_last_ >= 0)
+          jitter_ += (fabs (double (r - rtt_last_)) - jitter_) / 16;
+
+        rtt_last_ = r;
+      }
+
+      void oob_pinger::
+      tick (clock::time_point now)
+      {
+        int64_t n (timestamp (now));
+
+        // Expire first so the slots are free for this tick's pings.
+        //
+        int64_t t (duration_cast<chrono::microseconds> (timeout_).count ());
+
+        while (!sent_.empty () && n - sent_.front ().second >= t)
+        {
+          uint32_t seq (sent_.front ().first);
+          sent_.pop_front ();
+
+          size_t i (find (seq));
+
+          if (i == table_size)
+            continue; // Answered.
+
+          entry e (table_[i]);
+          erase (i);
+
+          ++stats_.timeouts;
+          report (e, false, chrono::microseconds::zero ());
+        }
+
+        if (backlog_.empty ())
+        {
+          // Don't let the allowance build up while idle: the next batch
+          // should start at the steady rate, not with a burst.
+          //
+          allowance_ = 0;
+          refilled_ = now;
+          return;
+        }
+
+        // Refill the allowance at the configured rate.
+        //
+        if (refilled_ != clock::time_point ())
+        {
+          uint64_t e (static_cast<uint64_t> (
+            max (duration_cast<chrono::microseconds> (now - refilled_).count (),
+                 int64_t (0))));
+
+          allowance_ = min (allowance_ + e * rate_ / 1000,
+                            uint64_t (burst_) * 1000);
+        }
+        else
+          allowance_ = 1000;
+
+        refilled_ = now;
+
+        while (!backlog_.empty () &&
+               allowance_ >= 1000 &&
+               outstanding_ != max_outstanding)
+        {
+          queued q (backlog_.front ());
+          backlog_.pop_front ();
+          allowance_ -= 1000;
+
+          // Skip 0 which marks an empty slot.
+          //
+          if (++seq_ == 0)
+            ++seq_;
+
+          char b[4 + 5 + max_token];
+          memcpy (b, "\xFF\xFF\xFF\xFFping ", 9);
+          size_t z (9 + format_token (b + 9, seq_, n));
+
+          if (!send_ (q.address, b, z))
+          {
+            ++stats_.send_failures;
+            report (entry {seq_, q.tag, n, q.address},
+                    false,
+                    chrono::microseconds::zero ());
+            continue;
+          }
+
+          ++stats_.sent;
+
+          size_t i (home (seq_));
+          while (table_[i].seq != 0)
+            i = (i + 1) & (table_size - 1);
+
+          table_[i] = entry {seq_, q.tag, n, q.address};
+          ++outstanding_;
+
+          sent_.emplace_back (seq_, n);
+        }
+      }
+
+      bool oob_pinger::
+      pong (const network_address& a, string_view token, clock::time_point now)
+      {
+        uint32_t seq;
+        int64_t sent;
+
+        size_t i (parse_token (token, seq, sent) ? find (seq) : table_size);
+
+        if (i == table_size        ||
+            table_[i].sent != sent ||
+            !same_address (table_[i].address, a))
+        {
+          log::trace_l2 << "unmatched oob pong";
+          ++stats_.unmatched;
+          return false;
+        }
+
+        entry e (table_[i]);
+        erase (i);
+
+        chrono::microseconds rtt (max (timestamp (now) - sent, int64_t (0)));
+
+        ++stats_.replies;
+        sample (rtt);
+
+        report (e, true, rtt);
+        return true;
+      }
+
+      oob_pinger_stats oob_pinger::
+      stats () const
+      {
+        oob_pinger_stats r (stats_);
+
+        if (r.replies != 0)
+          r.rtt_avg = chrono::microseconds (
+            static_cast<int64_t> (rtt_sum_ / r.replies));
+
+        r.jitter = chrono::microseconds (static_cast<int64_t> (jitter_));
+        return r;
+      }
+
+      size_t oob_pinger::
+      format_token (char* o, uint32_t seq, int64_t sent)
+      {
+        char* e (o + max_token);
+        char* p (to_chars (o, e, seq).ptr);
+        *p++ = '.';
+        p = to_chars (p, e, sent).ptr;
+        return static_cast<size_t> (p - o);
+      }
+
+      bool oob_pinger::
+      parse_token (string_view s, uint32_t& seq, int64_t& sent)
+      {
+        const char* b (s.data ());
+        const char* e (s.data () + s.size ());
+
+        auto r (from_chars (b, e, seq));
+
+        if (r.ec != errc () || r.ptr == e || *r.ptr != '.')
+          return false;
+
+        r = from_chars (r.ptr + 1, e, sent);
+        return r.ec == errc () && r.ptr == e && seq != 0;
+      }
+    }
+  }
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <libiw4x/import-network.hxx>
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      struct oob_ping_result
+      {
+        network_address address;
+        std::uint32_t tag;             // As passed to ping ().
+        bool replied;                  // False if the ping timed out.
+        std::chrono::microseconds rtt; // 0 if timed out.
+      };
+
+      struct oob_pinger_stats
+      {
+        std::uint64_t queued;        // Pings accepted by ping ().
+        std::uint64_t sent;          // Pings handed to the send function.
+        std::uint64_t replies;       // Pongs matched to a ping.
+        std::uint64_t timeouts;      // Pings that went unanswered.
+        std::uint64_t unmatched;     // Pongs we did not expect.
+        std::uint64_t send_failures; // Pings the send function refused.
+        std::uint64_t overflows;     // Pings refused with the backlog full.
+
+        // Over all the replies. The jitter is the smoothed difference
+        // between consecutive RTT samples (as in RFC 3550).
+        //
+        std::chrono::microseconds rtt_min;
+        std::chrono::microseconds rtt_max;
+        std::chrono::microseconds rtt_avg;
+        std::chrono::microseconds jitter;
+      };
+
+      // Pinger for many hosts at once, for example, the whole server list.
+      //
+      // Pings are queued by ping () and sent by tick () at a steady rate
+      // rather than all at once, which would overflow the socket buffers on
+      // either end (and look like a flood to the rate limiters of the hosts
+      // behind the same address). They don't wait for each other though, so
+      // a few hundred hosts take a couple of seconds rather than a couple of
+      // hundred round trips.
+      //
+      // Each ping carries a token that is echoed back in the pong (see the
+      // ping handler in mod-oob.cxx): a sequence number and the time it was
+      // sent. Outstanding pings are kept in an open-addressing table keyed by
+      // the sequence number so matching a pong is a hash and a probe or two.
+      // The pong must come from the address pinged and echo the time exactly,
+      // so a stray or spoofed pong is counted and ignored. The RTT is
+      // measured from the echoed time, which is our own monotonic clock.
+      //
+      // A ping that is not answered within the timeout is reported as such by
+      // tick (). Since the timeout is the same for all, the pings expire in
+      // the order they were sent and only the oldest need to be looked at.
+      //
+      // Results are reported to the handler registered for the tag the ping
+      // was queued with so several users (say, the server browser and the
+      // peer RTT probes) can share the pinger.
+      //
+      // Note that this is not thread-safe: the pongs are dispatched from the
+      // pipeline's tick () which, the same as ours, runs on the frame.
+      //
+      class oob_pinger
+      {
+      public:
+        using clock = std::chrono::steady_clock;
+
+        using send_function =
+          std::move_only_function<bool (const network_address&,
+                                        const char*,
+                                        std::size_t)>;
+
+        using result_handler =
+          std::move_only_function<void (const oob_ping_result&)>;
+
+        // Outstanding pings. The table is twice this size to keep the probe
+        // sequences short.
+        //
+        static constexpr std::size_t max_outstanding = 512;
+
+        // Pings waiting to be sent.
+        //
+        static constexpr std::size_t max_backlog = 4096;
+
+        // Longest token we produce: two numbers and a separator.
+        //
+        static constexpr std::size_t max_token = 32;
+
+        // The default rate sends a ping every frame or two and at most a
+        // handful per frame.
+        //
+        explicit
+        oob_pinger (send_function,
+                    std::uint32_t rate = 250,
+                    std::uint32_t burst = 8,
+                    clock::duration timeout = std::chrono::seconds (1));
+
+        oob_pinger (const oob_pinger&) = delete;
+        oob_pinger& operator = (const oob_pinger&) = delete;
+
+        void
+        on_result (std::uint32_t tag, result_handler);
+
+        // Queue a ping. Return false if the backlog is full.
+        //
+        bool
+        ping (const network_address&, std::uint32_t tag = 0);
+
+        // Send the pings that are due and report the ones that timed out.
+        //
+        void
+        tick (clock::time_point = clock::now ());
+
+        // Handle the token echoed in a pong. Return true if it answered one
+        // of our pings.
+        //
+        bool
+        pong (const network_address&,
+              std::string_view token,
+              clock::time_point = clock::now ());
+
+        // Pings queued or outstanding.
+        //
+        std::size_t
+        pending () const {return backlog_.size () + outstanding_;}
+
+        oob_pinger_stats
+        stats () const;
+
+        // Format and parse a token.
+        //
+        static std::size_t
+        format_token (char* out, std::uint32_t seq, std::int64_t sent);
+
+        static bool
+        parse_token (std::string_view, std::uint32_t& seq, std::int64_t& sent);
+
+      private:
+        static constexpr std::size_t table_size = 2 * max_outstanding;
+
+        struct entry
+        {
+          std::uint32_t seq; // 0 for an empty slot.
+          std::uint32_t tag;
+          std::int64_t sent; // Microseconds of the clock.
+          network_address address;
+        };
+
+        struct queued
+        {
+          network_address address;
+          std::uint32_t tag;
+        };
+
+        static std::int64_t
+        timestamp (clock::time_point);
+
+        std::size_t
+        find (std::uint32_t seq) const;
+
+        void
+        erase (std::size_t slot);
+
+        void
+        report (const entry&, bool replied, std::chrono::microseconds);
+
+        void
+        sample (std::chrono::microseconds);
+
+        send_function send_;
+        std::uint32_t rate_;
+        std::uint32_t burst_;
+        clock::duration timeout_;
+
+        std::vector<std::pair<std::uint32_t, result_handler>> handlers_;
+
+        std::deque<queued> backlog_;
+
+        // Send allowance in thousandths of a ping and when it was last
+        // refilled.
+        //
+        std::uint64_t allowance_ = 0;
+        clock::time_point refilled_ {};
+
+        std::uint32_t seq_ = 0;
+
+        std::array<entry, table_size> table_ {};
+        std::size_t outstanding_ = 0;
+
+        // Sequence numbers and times of the outstanding pings in the send
+        // order. Answered pings are left for tick () to skip.
+        //
+        std::deque<std::pair<std::uint32_t, std::int64_t>> sent_;
+
+        oob_pinger_stats stats_ {};
+        std::uint64_t rtt_sum_ = 0;
+        std::int64_t rtt_last_ = -1;
+        double jitter_ = 0;
+      };
+    }
+  }
+}
@@ -0,0 +1,195 @@
+// Tests for oob_pinger.
+//
+// The pings are captured by the send function instead of going out and the
+// pongs are fed back by hand with the token they carried, so we can answer
+// from a different address, with a stale time, or not at all. The clock is
+// simulated by passing the time to tick () and pong ().
+//
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libiw4x/mod/oob/oob-pinger.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace std::chrono;
+using namespace iw4x;
+using namespace iw4x::mod::oob;
+
+namespace
+{
+  struct sent_ping
+  {
+    network_address address;
+    string token;
+  };
+
+  vector<sent_ping> sent;
+  vector<oob_ping_result> results;
+
+  network_address
+  address (unsigned char last, uint16_t port)
+  {
+    network_address a {};
+    a.type = NETWORK_ADDRESS_IP;
+    a.ip[0] = 10;
+    a.ip[3] = last;
+    a.port = port;
+    return a;
+  }
+
+  struct fixture
+  {
+    oob_pinger pinger;
+    oob_pinger::clock::time_point now {seconds (100)};
+
+    fixture ()
+      : pinger ([] (const network_address& a, const char* d, size_t n)
+                {
+                  string_view p (d, n);
+                  assert (p.starts_with ("\xFF\xFF\xFF\xFFping "));
+
+                  sent.push_back (sent_ping {a, string (p.substr (9))});
+                  return true;
+                },
+                1000,
+                100)
+    {
+      sent.clear ();
+      results.clear ();
+
+      pinger.on_result (0, [] (const oob_ping_result& r)
+      {
+        results.push_back (r);
+      });
+    }
+
+    void
+    advance (milliseconds d)
+    {
+      now += d;
+      pinger.tick (now);
+    }
+  };
+
+  void
+  test_reply ()
+  {
+    fixture f;
+    network_address a (address (1, 28960));
+
+    assert (f.pinger.ping (a));
+    f.advance (milliseconds (0));
+
+    assert (sent.size () == 1);
+    assert (f.pinger.pending () == 1);
+
+    f.now += milliseconds (42);
+    assert (f.pinger.pong (a, sent[0].token, f.now));
+
+    assert (results.size () == 1);
+    assert (results[0].replied);
+    assert (results[0].rtt == milliseconds (42));
+    assert (f.pinger.pending () == 0);
+
+    // The same pong again is a duplicate.
+    //
+    assert (!f.pinger.pong (a, sent[0].token, f.now));
+
+    oob_pinger_stats s (f.pinger.stats ());
+    assert (s.sent == 1 && s.replies == 1 && s.unmatched == 1);
+  }
+
+  // The engine may hand us the pong with a different address type than the
+  // one we pinged (say, broadcast or loopback). Only the IP and port matter.
+  //
+  void
+  test_address_type ()
+  {
+    fixture f;
+    network_address a (address (2, 28960));
+
+    assert (f.pinger.ping (a));
+    f.advance (milliseconds (0));
+    assert (sent.size () == 1);
+
+    network_address b (a);
+    b.type = NETWORK_ADDRESS_BROADCAST;
+
+    assert (f.pinger.pong (b, sent[0].token, f.now));
+    assert (results.size () == 1 && results[0].replied);
+    assert (f.pinger.stats ().unmatched == 0);
+  }
+
+  // A pong from anywhere else or with a time other than the one we sent is
+  // ignored and the ping eventually times out.
+  //
+  void
+  test_unmatched ()
+  {
+    fixture f;
+    network_address a (address (3, 28960));
+
+    assert (f.pinger.ping (a));
+    f.advance (milliseconds (0));
+    assert (sent.size () == 1);
+
+    uint32_t seq;
+    int64_t t;
+    assert (oob_pinger::parse_token (sent[0].token, seq, t));
+
+    char b[oob_pinger::max_token];
+    string stale (b, oob_pinger::format_token (b, seq, t + 1));
+
+    assert (!f.pinger.pong (address (3, 28961), sent[0].token, f.now));
+    assert (!f.pinger.pong (address (4, 28960), sent[0].token, f.now));
+    assert (!f.pinger.pong (a, stale, f.now));
+    assert (!f.pinger.pong (a, "garbage", f.now));
+
+    assert (results.empty ());
+    assert (f.pinger.stats ().unmatched == 4);
+
+    f.advance (seconds (1));
+
+    assert (results.size () == 1 && !results[0].replied);
+    assert (f.pinger.stats ().timeouts == 1);
+    assert (f.pinger.pending () == 0);
+
+    // Too late.
+    //
+    assert (!f.pinger.pong (a, sent[0].token, f.now));
+  }
+
+  void
+  test_token ()
+  {
+    char b[oob_pinger::max_token];
+
+    size_t n (oob_pinger::format_token (b, 4294967295u, 9223372036854775807));
+    assert (n <= sizeof (b));
+
+    uint32_t seq;
+    int64_t t;
+    assert (oob_pinger::parse_token (string_view (b, n), seq, t));
+    assert (seq == 4294967295u && t == 9223372036854775807);
+
+    for (string_view s : {"", ".", "1", "1.", ".1", "0.1", "1.2x", "x1.2",
+                          "1..2", "4294967296.1"})
+      assert (!oob_pinger::parse_token (s, seq, t));
+  }
+}
+
+int
+main ()
+{
+  test_reply ();
+  test_address_type ();
+  test_unmatched ();
+  test_token ();
+}
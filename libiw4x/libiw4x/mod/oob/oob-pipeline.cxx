@@ -1,7 +1,11 @@
 #include <libiw4x/mod/oob/oob-pipeline.hxx>
 
+#include <cstring>
+#include <string_view>
+
 #include <libiw4x/logger.hxx>
 
+#include <libiw4x/mod/oob/oob-commands.hxx>
 #include <libiw4x/mod/oob/oob-envelope.hxx>
 #include <libiw4x/mod/oob/oob-parser.hxx>
 
@@ -22,7 +26,20 @@ namespace iw4x
       oob_disposition oob_pipeline::
       process (const network_address& a, const message& m)
       {
-        // First, see if this is even an OOB message we care about. If not, let
+        // Rate limit before doing any real work. Classifying the command is
+        // just a token scan and a table probe so it's cheap enough to do for
+        // every packet, including the ones a flood consists of.
+        //
+        if (m.data != nullptr && m.current_size > 0)
+        {
+          string_view c (
+            command_token (m.data, static_cast<size_t> (m.current_size)));
+
+          if (!limiter_.allow (a, classify_command (c)))
+            return oob_disposition::rejected;
+        }
+
+        // Next, see if this is even an OOB message we care about. If not, let
         // the engine deal with it.
         //
         const auto e (parse_envelope (a, m));
@@ -33,25 +50,46 @@ namespace iw4x
           return oob_disposition::forward_to_engine;
         }
 
-        // Now try to extract the actual payload. If it's malformed, we just
-        // drop it. There is no point in propagating garbage through the system.
+        // The typed messages refer to the payload in place but the engine
+        // reuses the packet buffer long before the next tick. So we copy the
+        // payload into the queue slot and parse it from there when it is
+        // dispatched. Anything that does not fit is not something we sent.
         //
-        const auto p (parse_message (*e));
+        const size_t n (e->payload.size ());
 
-        if (!p)
+        if (n > max_payload)
         {
-          log::debug << "rejected malformed oob message payload";
+          log::debug << "rejected oversized oob message payload";
           return oob_disposition::rejected;
         }
 
         // Queue it up. We do this to avoid tying up the network thread and to
         // process all messages in a predictable batch during the next tick.
         //
+        // Note that if the queue is full, the message is still consumed: it
+        // is ours, the engine would not know what to do with it either.
+        //
+        auto fill ([&e, n] (queued_packet& q)
+        {
+          q.source = e->source;
+          q.id = e->id;
+          q.size = static_cast<uint16_t> (n);
+          memcpy (q.payload.data (), e->payload.data (), n);
+        });
+
+        if (!pending_.emplace (fill))
         {
-          const lock_guard<mutex> l (mutex_);
-          pending_.push_back (*p);
+          // Only log the first drop in a burst so that a flood does not turn
+          // into a logging storm on top.
+          //
+          if (dropped_.fetch_add (1, memory_order_relaxed) % 1024 == 0)
+            log::warning << "oob queue full, dropping messages";
+
+          return oob_disposition::consumed;
         }
 
+        queued_.fetch_add (1, memory_order_relaxed);
+
         log::trace_l2 << "queued oob message for dispatch";
         return oob_disposition::consumed;
       }
@@ -59,18 +97,58 @@ namespace iw4x
       void oob_pipeline::
       tick ()
       {
-        vector<oob_message> b;
+        // Only dispatch what was there when we started so that a steady
+        // stream of messages cannot keep us here forever. Whatever arrives in
+        // the meantime waits for the next tick.
+        //
+        size_t n (pending_.size ());
+
+        if (n == 0)
+          return;
+
+        log::trace_l2 << "dispatching batch of " << n << " messages";
 
+        size_t i (0);
+        uint64_t d (0);
+
+        // Parse each message from its queue slot so that the views it carries
+        // stay valid while the handler runs.
+        //
+        auto dispatch ([this, &d] (queued_packet& q)
         {
-          const lock_guard<mutex> l (mutex_);
-          b.swap (pending_);
-        }
+          const oob_envelope e (
+            q.source, q.id, oob_raw_payload (q.payload.data (), q.size));
 
-        if (!b.empty ())
-          log::trace_l2 << "dispatching batch of " << b.size () << " messages";
+          if (const auto m = parse_message (e))
+          {
+            dispatcher_.dispatch (*m);
+            ++d;
+          }
+          else
+          {
+            log::debug << "rejected malformed oob message payload";
+            rejected_.fetch_add (1, memory_order_relaxed);
+          }
+        });
 
-        for (const oob_message& m : b)
-          dispatcher_.dispatch (m);
+        while (i != n && pending_.consume (dispatch))
+          ++i;
+
+        dispatched_.fetch_add (d, memory_order_relaxed);
+
+        if (i > high_water_.load (memory_order_relaxed))
+          high_water_.store (i, memory_order_relaxed);
+      }
+
+      oob_pipeline_stats oob_pipeline::
+      stats () const
+      {
+        return oob_pipeline_stats {
+          .queued     = queued_.load (memory_order_relaxed),
+          .dropped    = dropped_.load (memory_order_relaxed),
+          .dispatched = dispatched_.load (memory_order_relaxed),
+          .rejected   = rejected_.load (memory_order_relaxed),
+          .high_water = high_water_.load (memory_order_relaxed)};
       }
     }
   }
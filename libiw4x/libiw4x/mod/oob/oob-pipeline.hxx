@@ -1,11 +1,17 @@
 #pragma once
 
-#include <mutex>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 
 #include <libiw4x/mod/oob/oob-dispatcher.hxx>
+#include <libiw4x/mod/oob/oob-envelope.hxx>
+#include <libiw4x/mod/oob/oob-queue.hxx>
+#include <libiw4x/mod/oob/oob-rate-limit.hxx>
 #include <libiw4x/mod/oob/oob-types.hxx>
 
-#include <libiw4x/import.hxx>
+#include <libiw4x/import-network.hxx>
 
 namespace iw4x
 {
@@ -13,6 +19,26 @@ namespace iw4x
   {
     namespace oob
     {
+      struct oob_pipeline_stats
+      {
+        std::uint64_t queued;     // Messages accepted by process ().
+        std::uint64_t dropped;    // Messages dropped with the queue full.
+        std::uint64_t dispatched; // Messages handed to the dispatcher.
+        std::uint64_t rejected;   // Messages with a malformed payload.
+        std::size_t   high_water; // Largest batch seen by tick ().
+      };
+
+      // Note that process () is called on the network path while tick () is
+      // called from the frame. Messages are handed over through a bounded
+      // lock-free queue so a flood of OOB traffic neither contends on a lock
+      // nor allocates. If the frame falls behind by more than the queue
+      // capacity, the newest messages are dropped (and counted).
+      //
+      // Before anything else, process () charges the packet against its
+      // source's rate limit and rejects it if the source is over budget.
+      // This covers both our commands and the engine's since everything
+      // connectionless passes through here first.
+      //
       class oob_pipeline
       {
       public:
@@ -28,10 +54,41 @@ namespace iw4x
         void
         tick ();
 
+        oob_pipeline_stats
+        stats () const;
+
+        oob_rate_limiter&
+        limiter () {return limiter_;}
+
+        static constexpr std::size_t queue_capacity = 1024;
+
+        // Largest payload we queue. This is well above anything our own
+        // commands carry but still keeps the queue storage bounded.
+        //
+        static constexpr std::size_t max_payload = 1400;
+
       private:
+        // A message waiting for dispatch. Note that the payload is copied
+        // into the slot since the packet it came in is gone by the time the
+        // frame gets to it.
+        //
+        struct queued_packet
+        {
+          oob_source_endpoint source;
+          oob_message_id id;
+          std::uint16_t size;
+          std::array<std::byte, max_payload> payload;
+        };
+
         oob_dispatcher& dispatcher_;
-        std::mutex mutex_;
-        std::vector<oob_message> pending_;
+        oob_rate_limiter limiter_;
+        mpsc_queue<queued_packet, queue_capacity> pending_;
+
+        std::atomic<std::uint64_t> queued_ {0};
+        std::atomic<std::uint64_t> dropped_ {0};
+        std::atomic<std::uint64_t> dispatched_ {0};
+        std::atomic<std::uint64_t> rejected_ {0};
+        std::atomic<std::size_t> high_water_ {0};
       };
     }
   }
@@ -0,0 +1,203 @@
+#include <libiw4x/mod/oob/oob-query-cache.hxx>
+
+#include <cstring>
+
+#include <libiw4x/logger.hxx>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      namespace
+      {
+        constexpr string_view challenge_key ("\\challenge\\");
+
+        // The engine drops an info string value that contains any of these
+        // (or control characters) so we would not find it in the response.
+        //
+        bool
+        valid_challenge (string_view s)
+        {
+          if (s.empty () || s.size () > oob_query_cache::max_challenge)
+            return false;
+
+          for (char c : s)
+          {
+            if (static_cast<unsigned char> (c) <= ' ' ||
+                c == '\\' || c == '"' || c == ';' || c == '%')
+              return false;
+          }
+
+          return true;
+        }
+      }
+
+      oob_query_cache::entry* oob_query_cache::
+      find (oob_command c)
+      {
+        switch (c)
+        {
+        case oob_command::getinfo:   return &info_;
+        case oob_command::getstatus: return &status_;
+        default:                     return nullptr;
+        }
+      }
+
+      size_t oob_query_cache::
+      respond (oob_command c,
+               string_view ch,
+               span<char> out,
+               clock::time_point now)
+      {
+        const entry* e (find (c));
+
+        if (e == nullptr || !e->valid || now - e->time > max_age ||
+            !valid_challenge (ch))
+        {
+          ++stats_.misses;
+          return 0;
+        }
+
+        size_t t (e->size - e->rest);
+        size_t n (e->split + ch.size () + t);
+
+        if (n > out.size ())
+        {
+          ++stats_.misses;
+          return 0;
+        }
+
+        char* p (out.data ());
+
+        memcpy (p, e->data.data (), e->split);
+        memcpy (p + e->split, ch.data (), ch.size ());
+        memcpy (p + e->split + ch.size (), e->data.data () + e->rest, t);
+
+        ++stats_.hits;
+        return n;
+      }
+
+      bool oob_query_cache::
+      capture_begin (oob_command c, string_view ch, clock::time_point now)
+      {
+        entry* e (find (c));
+
+        if (e == nullptr || !valid_challenge (ch))
+          return false;
+
+        // Only ask the engine once per frame, whether or not that worked.
+        //
+        if (e->frame == frame_ + 1)
+          return false;
+
+        e->frame = frame_ + 1;
+
+        capture_ = e;
+        capture_reply_ = c == oob_command::getinfo
+                         ? "infoResponse"
+                         : "statusResponse";
+
+        memcpy (capture_challenge_.data (), ch.data (), ch.size ());
+        capture_challenge_size_ = ch.size ();
+        capture_time_ = now;
+
+        return true;
+      }
+
+      void oob_query_cache::
+      capture (const char* d, size_t n)
+      {
+        if (capture_ == nullptr)
+          return;
+
+        // See if this is the response: the OOB header followed by the reply
+        // command on a line of its own.
+        //
+        size_t h (4 + capture_reply_.size ());
+
+        if (n <= h ||
+            memcmp (d, "\xff\xff\xff\xff", 4) != 0 ||
+            string_view (d + 4, capture_reply_.size ()) != capture_reply_ ||
+            d[h] != '\n')
+          return;
+
+        entry& e (*capture_);
+        capture_ = nullptr;
+
+        if (n > max_response)
+        {
+          log::debug << capture_reply_ << " too large to cache (" << n
+                     << " bytes)";
+          return;
+        }
+
+        // Find where the engine put the challenge. The value ends at the
+        // next key, the end of the line, or the end of the packet.
+        //
+        string_view s (d, n);
+        string_view ch (capture_challenge_.data (), capture_challenge_size_);
+
+        for (size_t p (s.find (challenge_key, h));
+             p != string_view::npos;
+             p = s.find (challenge_key, p + 1))
+        {
+          size_t b (p + challenge_key.size ());
+          size_t x (b + ch.size ());
+
+          if (s.compare (b, ch.size (), ch) != 0)
+            continue;
+
+          if (x != n && s[x] != '\\' && s[x] != '\n' && s[x] != '\0')
+            continue;
+
+          memcpy (e.data.data (), d, n);
+          e.split = b;
+          e.rest = x;
+          e.size = n;
+          e.time = capture_time_;
+          e.valid = true;
+
+          ++stats_.captures;
+
+          log::trace_l2 << "cached " << capture_reply_ << " (" << n
+                        << " bytes)";
+          return;
+        }
+
+        log::debug << "no challenge in " << capture_reply_ << ", not caching";
+      }
+
+      void oob_query_cache::
+      capture_end ()
+      {
+        capture_ = nullptr;
+      }
+
+      void oob_query_cache::
+      frame (uint64_t f)
+      {
+        ++frame_;
+
+        if (f != fingerprint_)
+        {
+          fingerprint_ = f;
+          invalidate ();
+        }
+      }
+
+      void oob_query_cache::
+      invalidate ()
+      {
+        if (info_.valid || status_.valid)
+          ++stats_.invalidations;
+
+        info_.valid = false;
+        status_.valid = false;
+      }
+    }
+  }
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+#include <libiw4x/mod/oob/oob-commands.hxx>
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      struct oob_query_stats
+      {
+        std::uint64_t hits;          // Queries answered from the cache.
+        std::uint64_t misses;        // Queries left to the engine.
+        std::uint64_t captures;      // Engine responses cached.
+        std::uint64_t invalidations; // Times the cached responses were dropped.
+      };
+
+      // Prebuilt responses to the server browser queries (getinfo and
+      // getstatus).
+      //
+      // The engine rebuilds the response from dvars and client state on every
+      // query even though it hardly changes between frames. So instead we let
+      // the engine answer a query once, capture the packet it sends, and
+      // answer the following queries with a copy of it with the requester's
+      // challenge spliced in.
+      //
+      // We don't know enough about the engine's client state to tell when it
+      // changes, so the cached responses are dropped when the server info
+      // dvars change (see frame ()), when the caller invalidates them (for
+      // example, on a connect), and in any case once they are older than
+      // max_age. Also, the engine is asked at most once per frame for each
+      // query type: a response that is regenerated during a frame stays for
+      // the rest of it.
+      //
+      // Note that this is not thread-safe: the queries, the engine's sends,
+      // and the frame all run on the engine's main thread.
+      //
+      class oob_query_cache
+      {
+      public:
+        using clock = std::chrono::steady_clock;
+
+        static constexpr std::chrono::milliseconds max_age {1000};
+
+        // Largest response we cache. A status response with a full server
+        // comes to about 2KB.
+        //
+        static constexpr std::size_t max_response = 4096;
+
+        // Largest challenge we splice in. Anything longer (or containing
+        // characters the engine would refuse in an info string) is left to
+        // the engine.
+        //
+        static constexpr std::size_t max_challenge = 64;
+
+        oob_query_cache () = default;
+
+        oob_query_cache (const oob_query_cache&) = delete;
+        oob_query_cache& operator = (const oob_query_cache&) = delete;
+
+        // Assemble the response to a query into the buffer. Return its size
+        // or 0 if there is no usable cached response, in which case the
+        // query should go to the engine.
+        //
+        std::size_t
+        respond (oob_command,
+                 std::string_view challenge,
+                 std::span<char> out,
+                 clock::time_point = clock::now ());
+
+        // Capture the engine's response to a query that we could not answer.
+        // Call begin () before handing the query to the engine, capture ()
+        // with every packet sent until then, and end () once the engine
+        // returns. Return false from begin () if the response shouldn't be
+        // captured (in which case there is no need to call the rest).
+        //
+        bool
+        capture_begin (oob_command,
+                       std::string_view challenge,
+                       clock::time_point = clock::now ());
+
+        void
+        capture (const char* data, std::size_t size);
+
+        void
+        capture_end ();
+
+        bool
+        capturing () const {return capture_ != nullptr;}
+
+        // Start a new frame. The fingerprint identifies the state the
+        // responses depend on and if it differs from the last one, the
+        // cached responses are dropped.
+        //
+        void
+        frame (std::uint64_t fingerprint);
+
+        void
+        invalidate ();
+
+        oob_query_stats
+        stats () const {return stats_;}
+
+      private:
+        struct entry
+        {
+          bool valid = false;
+          clock::time_point time;
+          std::uint64_t frame = 0; // Frame it was (last) built in plus 1.
+
+          // The response is data[0, split) + challenge + data[rest, size).
+          //
+          std::size_t split = 0;
+          std::size_t rest = 0;
+          std::size_t size = 0;
+          std::array<char, max_response> data;
+        };
+
+        entry*
+        find (oob_command);
+
+        entry info_;
+        entry status_;
+
+        // Capture in progress.
+        //
+        entry* capture_ = nullptr;
+        std::string_view capture_reply_;
+        std::array<char, max_challenge> capture_challenge_;
+        std::size_t capture_challenge_size_ = 0;
+        clock::time_point capture_time_;
+
+        std::uint64_t frame_ = 0;
+        std::uint64_t fingerprint_ = 0;
+
+        oob_query_stats stats_ {};
+      };
+    }
+  }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      // Bounded lock-free multi-producer, single-consumer queue.
+      //
+      // This is the classic ring of sequenced slots: each slot carries a
+      // sequence number that tells whether it is free for the producer at a
+      // given position or holds a value for the consumer. Producers claim a
+      // position with a single CAS on the tail, the consumer owns the head
+      // outright. Storage is fixed at N slots (a power of two) and nothing
+      // is ever allocated after construction.
+      //
+      // When the queue is full, push () fails and the value is dropped. That
+      // is, the overflow policy is drop-newest: dropping the oldest instead
+      // would have producers race the consumer for the head. Note that T is
+      // expected to be cheap to copy and default-constructible.
+      //
+      template <typename T, std::size_t N>
+      class mpsc_queue
+      {
+        static_assert (N != 0 && (N & (N - 1)) == 0,
+                       "capacity must be a power of two");
+
+      public:
+        mpsc_queue ()
+        {
+          for (std::size_t i (0); i != N; ++i)
+            slots_[i].seq.store (i, std::memory_order_relaxed);
+        }
+
+        mpsc_queue (const mpsc_queue&) = delete;
+        mpsc_queue& operator = (const mpsc_queue&) = delete;
+
+        // Enqueue a value. Return false if the queue is full. Safe to call
+        // from multiple threads.
+        //
+        bool
+        push (const T& v)
+        {
+          return emplace ([&v] (T& s) {s = v;});
+        }
+
+        // Enqueue a value by having f (T&) fill in the claimed slot. This
+        // saves a copy for large values that are only partially used. Note
+        // that f () must not throw and the slot holds whatever was left in it
+        // by the last pop.
+        //
+        template <typename F>
+        bool
+        emplace (F&& f)
+        {
+          std::size_t p (tail_.load (std::memory_order_relaxed));
+
+          for (;;)
+          {
+            slot& s (slots_[p & mask]);
+            std::size_t q (s.seq.load (std::memory_order_acquire));
+            auto d (static_cast<std::ptrdiff_t> (q - p));
+
+            if (d == 0)
+            {
+              if (tail_.compare_exchange_weak (p, p + 1,
+                                               std::memory_order_relaxed))
+              {
+                f (s.value);
+                s.seq.store (p + 1, std::memory_order_release);
+                return true;
+              }
+            }
+            else if (d < 0)
+              return false; // Full.
+            else
+              p = tail_.load (std::memory_order_relaxed);
+          }
+        }
+
+        // Dequeue a value. Return false if the queue is empty. Must only be
+        // called from the consumer thread.
+        //
+        bool
+        pop (T& v)
+        {
+          return consume ([&v] (T& s) {v = std::move (s);});
+        }
+
+        // Dequeue a value by calling f (T&) on it in place. The slot is only
+        // released to the producers once f () returns, so references into
+        // the value stay valid for the duration of the call. If f () throws,
+        // the value is still consumed. Must only be called from the consumer
+        // thread.
+        //
+        template <typename F>
+        bool
+        consume (F&& f)
+        {
+          slot& s (slots_[head_ & mask]);
+
+          if (s.seq.load (std::memory_order_acquire) != head_ + 1)
+            return false;
+
+          struct release
+          {
+            mpsc_queue& q;
+            slot& s;
+
+            ~release ()
+            {
+              s.seq.store (q.head_ + N, std::memory_order_release);
+              ++q.head_;
+            }
+          } r {*this, s};
+
+          f (s.value);
+          return true;
+        }
+
+        static constexpr std::size_t
+        capacity () {return N;}
+
+        // Approximate number of queued values (exact when called from the
+        // consumer with no concurrent producers).
+        //
+        std::size_t
+        size () const
+        {
+          std::size_t t (tail_.load (std::memory_order_relaxed));
+          return t - head_;
+        }
+
+      private:
+        static constexpr std::size_t mask = N - 1;
+
+        struct slot
+        {
+          std::atomic<std::size_t> seq;
+          T value {};
+        };
+
+        // Keep the producer and consumer positions on separate cache lines
+        // so they don't bounce between cores.
+        //
+        alignas (64) std::atomic<std::size_t> tail_ {0};
+        alignas (64) std::size_t head_ {0};
+        alignas (64) std::array<slot, N> slots_;
+      };
+    }
+  }
+}
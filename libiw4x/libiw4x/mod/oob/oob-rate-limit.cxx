@@ -0,0 +1,232 @@
+#include <libiw4x/mod/oob/oob-rate-limit.hxx>
+
+#include <algorithm>
+
+#include <libiw4x/logger.hxx>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      namespace
+      {
+        // Default per-source budgets. A client pings a server a handful of
+        // times while browsing and connects once, so these leave plenty of
+        // headroom for legitimate traffic (including several clients behind
+        // one NAT) while capping what a single source can make us do.
+        //
+        // The exception is the server list which the master sends as a burst
+        // of up to max_parts packets (see discovery-protocol.hxx). Only the
+        // master's are accepted anyway.
+        //
+        constexpr oob_rate_budget default_budgets[] = {
+          {20,  40},   // ping
+          {2,   5},    // connect
+          {10,  20},   // query
+          {100, 1024}, // list
+          {20,  40}    // other
+        };
+
+        static_assert (size (default_budgets) ==
+                       size_t (oob_rate_class::count));
+
+        // A source that has not been seen for this long is forgotten. By
+        // then its buckets would have refilled anyway, so there is nothing
+        // to remember.
+        //
+        constexpr uint32_t idle_ms (30000);
+
+        inline uint64_t
+        source_key (const network_address& a)
+        {
+          // Note that the port is kept in network order, the same as the
+          // address: all we need is a unique key. Set a bit above the port
+          // so that 0.0.0.0:0 does not collide with the empty slot.
+          //
+          const unsigned char* ip (
+            reinterpret_cast<const unsigned char*> (a.ip));
+
+          return uint64_t (1)     << 48 |
+                 uint64_t (ip[0]) << 40 |
+                 uint64_t (ip[1]) << 32 |
+                 uint64_t (ip[2]) << 24 |
+                 uint64_t (ip[3]) << 16 |
+                 uint64_t (a.port);
+        }
+      }
+
+      oob_rate_limiter::
+      oob_rate_limiter ()
+        : epoch_ (clock::now ())
+      {
+        copy (begin (default_budgets), end (default_budgets),
+              budgets_.begin ());
+      }
+
+      oob_rate_class oob_rate_limiter::
+      classify (oob_command c)
+      {
+        switch (c)
+        {
+        case oob_command::ping:
+        case oob_command::pong:           return oob_rate_class::ping;
+        case oob_command::connect:
+        case oob_command::cookie:
+        case oob_command::connect_cookie: return oob_rate_class::connect;
+        case oob_command::getinfo:
+        case oob_command::getstatus:      return oob_rate_class::query;
+        case oob_command::servers_delta:  return oob_rate_class::list;
+        default:                          return oob_rate_class::other;
+        }
+      }
+
+      void oob_rate_limiter::
+      budget (oob_rate_class c, oob_rate_budget b)
+      {
+        lock_guard<mutex> l (m_);
+        budgets_[static_cast<size_t> (c)] = b;
+      }
+
+      void oob_rate_limiter::
+      refill (entry& e, uint32_t now)
+      {
+        // Note that the elapsed time is computed with unsigned wraparound so
+        // this keeps working past the 49 days the 32-bit clock can hold.
+        //
+        uint64_t d (now - e.seen);
+
+        if (d == 0)
+          return;
+
+        for (size_t i (0); i != classes; ++i)
+        {
+          uint64_t cap (uint64_t (budgets_[i].burst) * scale);
+          uint64_t t (e.tokens[i] + d * budgets_[i].rate);
+
+          e.tokens[i] = static_cast<uint32_t> (min (t, cap));
+        }
+
+        e.seen = now;
+      }
+
+      oob_rate_limiter::entry& oob_rate_limiter::
+      lookup (uint64_t k, uint32_t now)
+      {
+        // Fibonacci hashing: the multiply spreads the address bits over the
+        // top of the word, which we use as the home slot.
+        //
+        size_t h (
+          static_cast<size_t> ((k * 0x9E3779B97F4A7C15) >> (64 - table_bits)));
+
+        entry* victim (nullptr);
+        bool stale (false);
+
+        for (size_t i (0); i != probe_window; ++i)
+        {
+          entry& e (table_[(h + i) & (table_size - 1)]);
+
+          if (e.key == k)
+            return e;
+
+          // Prefer an empty or stale slot. Otherwise remember the one idle
+          // the longest. Note that we still have to probe the whole window
+          // since the source may be further down.
+          //
+          if (e.key == 0 || now - e.seen >= idle_ms)
+          {
+            if (!stale)
+            {
+              victim = &e;
+              stale = true;
+            }
+          }
+          else if (!stale && (victim == nullptr ||
+                              now - e.seen > now - victim->seen))
+            victim = &e;
+        }
+
+        if (!stale)
+          evictions_.fetch_add (1, memory_order_relaxed);
+
+        // A new source starts with full buckets.
+        //
+        victim->key = k;
+        victim->seen = now;
+
+        for (size_t i (0); i != classes; ++i)
+          victim->tokens[i] = budgets_[i].burst * scale;
+
+        return *victim;
+      }
+
+      bool oob_rate_limiter::
+      allow (const network_address& a, oob_command c, clock::time_point t)
+      {
+        // Loopback traffic is ours, don't limit it. Anything else is keyed
+        // by its address whatever the type the engine gave it, so that a
+        // source can't get around its budget that way.
+        //
+        if (a.type == NETWORK_ADDRESS_LOOPBACK)
+          return true;
+
+        size_t ci (static_cast<size_t> (classify (c)));
+
+        uint32_t now (static_cast<uint32_t> (
+          duration_cast<milliseconds> (t - epoch_).count ()));
+
+        bool r;
+        {
+          lock_guard<mutex> l (m_);
+
+          entry& e (lookup (source_key (a), now));
+          refill (e, now);
+
+          r = e.tokens[ci] >= scale;
+
+          if (r)
+            e.tokens[ci] -= scale;
+        }
+
+        if (r)
+        {
+          allowed_[ci].fetch_add (1, memory_order_relaxed);
+          return true;
+        }
+
+        // As with the queue, only log the first drop in a burst.
+        //
+        if (dropped_[ci].fetch_add (1, memory_order_relaxed) % 1024 == 0)
+        {
+          const unsigned char* ip (
+            reinterpret_cast<const unsigned char*> (a.ip));
+
+          log::warning << "rate limiting oob traffic from "
+                       << int (ip[0]) << '.' << int (ip[1]) << '.'
+                       << int (ip[2]) << '.' << int (ip[3]);
+        }
+
+        return false;
+      }
+
+      oob_rate_stats oob_rate_limiter::
+      stats () const
+      {
+        oob_rate_stats r {};
+
+        for (size_t i (0); i != classes; ++i)
+        {
+          r.allowed[i] = allowed_[i].load (memory_order_relaxed);
+          r.dropped[i] = dropped_[i].load (memory_order_relaxed);
+        }
+
+        r.evictions = evictions_.load (memory_order_relaxed);
+        return r;
+      }
+    }
+  }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include <libiw4x/mod/oob/oob-commands.hxx>
+
+#include <libiw4x/import-network.hxx>
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      // Rate limiting classes. Each source gets a separate budget for each.
+      //
+      enum class oob_rate_class : std::uint8_t
+      {
+        ping,    // ping, pong
+        connect, // connect, cookie, connectCookie
+        query,   // getinfo, getstatus
+        list,    // serversDelta
+        other,   // Everything else, including commands we don't know.
+
+        count
+      };
+
+      struct oob_rate_budget
+      {
+        std::uint32_t rate;  // Tokens per second.
+        std::uint32_t burst; // Bucket size.
+      };
+
+      struct oob_rate_stats
+      {
+        std::array<std::uint64_t, std::size_t (oob_rate_class::count)> allowed;
+        std::array<std::uint64_t, std::size_t (oob_rate_class::count)> dropped;
+        std::uint64_t evictions; // Live sources pushed out of the table.
+      };
+
+      // Per-source token bucket rate limiter for connectionless packets.
+      //
+      // Sources are keyed by IPv4 address and port and kept in a fixed-size
+      // open-addressing table, so the cost per packet is one hash and a probe
+      // of a few adjacent slots. A source that has been idle for a while is
+      // considered gone and its slot is reused. If all the slots a new source
+      // could go into are live, the one idle the longest is evicted. Note
+      // that an evicted source just starts over with a full bucket, so a flood
+      // of spoofed sources can't lock out legitimate ones, only make their
+      // budget less precise.
+      //
+      // Every source except loopback is limited, keyed by its address and
+      // port whatever address type the engine tagged it with.
+      //
+      class oob_rate_limiter
+      {
+      public:
+        using clock = std::chrono::steady_clock;
+
+        oob_rate_limiter ();
+
+        oob_rate_limiter (const oob_rate_limiter&) = delete;
+        oob_rate_limiter& operator = (const oob_rate_limiter&) = delete;
+
+        // Return true if the packet should be processed and false if it
+        // should be dropped.
+        //
+        bool
+        allow (const network_address&,
+               oob_command,
+               clock::time_point = clock::now ());
+
+        void
+        budget (oob_rate_class, oob_rate_budget);
+
+        oob_rate_stats
+        stats () const;
+
+        static oob_rate_class
+        classify (oob_command);
+
+      private:
+        static constexpr std::size_t classes =
+          static_cast<std::size_t> (oob_rate_class::count);
+
+        static constexpr unsigned int table_bits = 12;
+        static constexpr std::size_t table_size = std::size_t (1) << table_bits;
+
+        // Number of slots probed starting at the home slot.
+        //
+        static constexpr std::size_t probe_window = 8;
+
+        // Tokens are kept in thousandths so that slow rates refill smoothly.
+        //
+        static constexpr std::uint32_t scale = 1000;
+
+        struct entry
+        {
+          std::uint64_t key;  // 0 for an empty slot.
+          std::uint32_t seen; // Milliseconds since epoch_.
+          std::array<std::uint32_t, classes> tokens;
+        };
+
+        entry&
+        lookup (std::uint64_t key, std::uint32_t now);
+
+        void
+        refill (entry&, std::uint32_t now);
+
+        clock::time_point epoch_;
+        std::array<oob_rate_budget, classes> budgets_;
+
+        // Note that both the server and the client connectionless paths run
+        // on the engine's main thread so the lock is normally uncontended.
+        //
+        std::mutex m_;
+        std::array<entry, table_size> table_ {};
+
+        std::array<std::atomic<std::uint64_t>, classes> allowed_ {};
+        std::array<std::atomic<std::uint64_t>, classes> dropped_ {};
+        std::atomic<std::uint64_t> evictions_ {0};
+      };
+    }
+  }
+}
@@ -0,0 +1,204 @@
+#include <libiw4x/mod/oob/oob-tokenizer.hxx>
+
+#include <bit>
+#include <cstring>
+
+#include <emmintrin.h>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      namespace
+      {
+        // The scanners below look at 16 bytes at a time with SSE2 (which is
+        // part of the x86-64 baseline) and finish the tail a byte at a time.
+        // Each returns a pointer to the first matching byte or e if there is
+        // none.
+        //
+        // Note that "whitespace" is any byte up to and including space,
+        // compared unsigned. So, in particular, UTF-8 sequences are never
+        // mistaken for it.
+
+        inline bool
+        space (char c)
+        {
+          return static_cast<unsigned char> (c) <= ' ';
+        }
+
+        // Return a mask of bytes in x that are whitespace. Unsigned x <= ' '
+        // is the same as max (x, ' ') == ' '.
+        //
+        inline unsigned int
+        space_mask (__m128i x)
+        {
+          const __m128i s (_mm_set1_epi8 (' '));
+          return static_cast<unsigned int> (
+            _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_max_epu8 (x, s), s)));
+        }
+
+        // Find the first non-whitespace byte.
+        //
+        const char*
+        skip_space (const char* p, const char* e)
+        {
+          for (; e - p >= 16; p += 16)
+          {
+            __m128i x (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (p)));
+
+            if (unsigned int m = ~space_mask (x) & 0xFFFF)
+              return p + countr_zero (m);
+          }
+
+          while (p != e && space (*p))
+            ++p;
+
+          return p;
+        }
+
+        // Find the first whitespace byte or double quote, that is, the end of
+        // an unquoted argument.
+        //
+        const char*
+        find_delimiter (const char* p, const char* e)
+        {
+          const __m128i q (_mm_set1_epi8 ('"'));
+
+          for (; e - p >= 16; p += 16)
+          {
+            __m128i x (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (p)));
+
+            unsigned int m (
+              space_mask (x) |
+              static_cast<unsigned int> (
+                _mm_movemask_epi8 (_mm_cmpeq_epi8 (x, q))));
+
+            if (m != 0)
+              return p + countr_zero (m);
+          }
+
+          while (p != e && !space (*p) && *p != '"')
+            ++p;
+
+          return p;
+        }
+
+        inline char
+        lower (char c)
+        {
+          return c >= 'A' && c <= 'Z' ? static_cast<char> (c - 'A' + 'a') : c;
+        }
+
+        bool
+        iequal (string_view x, string_view y)
+        {
+          if (x.size () != y.size ())
+            return false;
+
+          for (size_t i (0); i != x.size (); ++i)
+          {
+            if (lower (x[i]) != lower (y[i]))
+              return false;
+          }
+
+          return true;
+        }
+      }
+
+      oob_args::
+      oob_args (string_view s)
+      {
+        if (s.empty ())
+          return;
+
+        // Everything after the first null is garbage as far as the engine is
+        // concerned.
+        //
+        if (const void* z = memchr (s.data (), '\0', s.size ()))
+          s = s.substr (0, static_cast<const char*> (z) - s.data ());
+
+        const char* p (s.data ());
+        const char* e (p + s.size ());
+
+        for (;;)
+        {
+          p = skip_space (p, e);
+
+          if (p == e)
+            break;
+
+          // A // comment runs to the end of the input.
+          //
+          if (*p == '/' && e - p > 1 && p[1] == '/')
+            break;
+
+          const char* b;
+          bool q (*p == '"');
+
+          if (q)
+          {
+            b = ++p;
+
+            const void* c (memchr (p, '"', static_cast<size_t> (e - p)));
+            p = c != nullptr ? static_cast<const char*> (c) : e;
+          }
+          else
+          {
+            b = p;
+            p = find_delimiter (p, e);
+          }
+
+          if (size_ == capacity)
+          {
+            truncated_ = true;
+            break;
+          }
+
+          args_[size_++] = string_view (b, static_cast<size_t> (p - b));
+
+          // Skip the closing quote.
+          //
+          if (q && p != e)
+            ++p;
+        }
+      }
+
+      optional<string_view>
+      info_value (string_view s, string_view k)
+      {
+        size_t p (0);
+
+        if (!s.empty () && s[0] == '\\')
+          ++p;
+
+        while (p < s.size ())
+        {
+          size_t kb (p);
+          size_t ke (s.find ('\\', kb));
+
+          // A key without a value.
+          //
+          if (ke == string_view::npos)
+            break;
+
+          size_t vb (ke + 1);
+          size_t ve (s.find ('\\', vb));
+
+          if (ve == string_view::npos)
+            ve = s.size ();
+
+          if (iequal (s.substr (kb, ke - kb), k))
+            return s.substr (vb, ve - vb);
+
+          p = ve + 1;
+        }
+
+        return nullopt;
+      }
+    }
+  }
+}
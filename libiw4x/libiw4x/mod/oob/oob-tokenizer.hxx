@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+namespace iw4x
+{
+  namespace mod
+  {
+    namespace oob
+    {
+      // Arguments of an OOB command split in place.
+      //
+      // This follows the engine's Cmd_TokenizeString () rules: arguments are
+      // separated by whitespace (any character up to and including space), a
+      // double-quoted argument may contain whitespace and ends at the closing
+      // quote (or the end of the input), and the input ends at the first null.
+      // Backslashes are not special which means an info string such as
+      // \name\foo\clients\3 comes through as a single argument (see
+      // info_value () below for picking it apart).
+      //
+      // Unlike the engine, nothing is copied: the arguments are views into
+      // the tokenized buffer and so are only valid for as long as it is.
+      // There is room for a fixed number of arguments and anything past that
+      // is dropped, the same as the engine does with MAX_STRING_TOKENS.
+      //
+      class oob_args
+      {
+      public:
+        static constexpr std::size_t capacity = 32;
+
+        oob_args () = default;
+
+        explicit
+        oob_args (std::string_view);
+
+        std::size_t
+        size () const {return size_;}
+
+        bool
+        empty () const {return size_ == 0;}
+
+        // True if there were more than capacity arguments.
+        //
+        bool
+        truncated () const {return truncated_;}
+
+        // Return an empty view if the argument is out of range, the same as
+        // Cmd_Argv ().
+        //
+        std::string_view
+        operator[] (std::size_t i) const
+        {
+          return i < size_ ? args_[i] : std::string_view ();
+        }
+
+        const std::string_view*
+        begin () const {return args_.data ();}
+
+        const std::string_view*
+        end () const {return args_.data () + size_;}
+
+      private:
+        std::array<std::string_view, capacity> args_;
+        std::size_t size_ = 0;
+        bool truncated_ = false;
+      };
+
+      // Look up a key in a backslash-separated info string, that is,
+      // \key1\value1\key2\value2. The leading backslash is optional and keys
+      // are compared case-insensitively, as in Info_ValueForKey (). Return
+      // nullopt if the key is not present.
+      //
+      // Note that the returned view refers to the info string.
+      //
+      std::optional<std::string_view>
+      info_value (std::string_view info, std::string_view key);
+    }
+  }
+}
@@ -1,8 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <span>
 
-#include <libiw4x/import.hxx>
+#include <libiw4x/import-network.hxx>
 
 namespace iw4x
 {
@@ -14,6 +15,8 @@ namespace iw4x
       {
         ping = 0x0100,
         pong = 0x0101,
+        servers_delta = 0x0102,
+        connect_cookie = 0x0103,
       };
 
       struct oob_source_endpoint
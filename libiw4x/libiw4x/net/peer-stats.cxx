@@ -0,0 +1,456 @@
+#include <libiw4x/net/peer-stats.hxx>
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace net
+  {
+    namespace
+    {
+      // Same probing scheme as the OOB rate limiter: a Fibonacci hash of the
+      // key picks the first slot and we look at a few after it.
+      //
+      constexpr size_t window (8);
+      constexpr unsigned int table_bits (6);
+
+      static_assert (peer_stats::capacity == size_t (1) << table_bits);
+
+      // Sequence gap past which we assume the peer reconnected rather than
+      // that we lost that many packets.
+      //
+      constexpr uint32_t max_gap (1024);
+
+      uint64_t
+      key_of (const udp_endpoint& e)
+      {
+        uint64_t k (uint64_t (1) << 48);
+
+        for (size_t i (0); i != 4; ++i)
+          k |= uint64_t (e.address[i]) << (40 - 8 * i);
+
+        return k | e.port;
+      }
+
+      udp_endpoint
+      endpoint_of (uint64_t k)
+      {
+        udp_endpoint e {};
+
+        for (size_t i (0); i != 4; ++i)
+          e.address[i] = static_cast<uint8_t> (k >> (40 - 8 * i));
+
+        e.port = static_cast<uint16_t> (k);
+        return e;
+      }
+
+      // Connectionless packets start with four 0xFF bytes, anything else is
+      // netchan.
+      //
+      bool
+      netchan (const char* d, size_t n)
+      {
+        static const char h[4] {'\xFF', '\xFF', '\xFF', '\xFF'};
+        return n >= 4 && memcmp (d, h, 4) != 0;
+      }
+
+      string
+      address (const udp_endpoint& e)
+      {
+        ostringstream os;
+        os << unsigned (e.address[0]) << '.' << unsigned (e.address[1]) << '.'
+           << unsigned (e.address[2]) << '.' << unsigned (e.address[3]) << ':'
+           << unsigned ((e.port & 0xFF) << 8 | e.port >> 8);
+        return os.str ();
+      }
+
+      // Percentage, or -1 if there is nothing to base it on.
+      //
+      double
+      percent (uint64_t x, uint64_t total)
+      {
+        return total != 0 ? 100.0 * double (x) / double (total) : -1.0;
+      }
+
+      // Probes lost, not counting the one that may still be in flight.
+      //
+      uint64_t
+      probes_lost (const peer_stats_entry& e)
+      {
+        uint64_t m (e.probes - min (e.replies, e.probes));
+        return m != 0 ? m - 1 : 0;
+      }
+    }
+
+    peer_stats::slot* peer_stats::
+    find (uint64_t k, bool create, clock::time_point now)
+    {
+      size_t h (static_cast<size_t> ((k * 0x9E3779B97F4A7C15) >>
+                                     (64 - table_bits)));
+
+      for (size_t i (0); i != window; ++i)
+      {
+        slot& s (slots_[(h + i) % capacity]);
+
+        if (s.key.load (memory_order_acquire) == k)
+          return &s;
+      }
+
+      if (!create)
+        return nullptr;
+
+      for (size_t i (0); i != window; ++i)
+      {
+        slot& s (slots_[(h + i) % capacity]);
+        uint64_t e (0);
+
+        if (s.key.compare_exchange_strong (e, k, memory_order_acq_rel))
+        {
+          reset (s, now);
+          return &s;
+        }
+
+        // Someone beat us to it for the same peer.
+        //
+        if (e == k)
+          return &s;
+      }
+
+      // No free slots, try to reuse one that went idle.
+      //
+      for (size_t i (0); i != window; ++i)
+      {
+        slot& s (slots_[(h + i) % capacity]);
+        uint64_t e (s.key.load (memory_order_acquire));
+
+        clock::time_point t (
+          clock::duration (s.last_seen.load (memory_order_relaxed)));
+
+        if (now - t >= max_idle &&
+            s.key.compare_exchange_strong (e, k, memory_order_acq_rel))
+        {
+          reset (s, now);
+          return &s;
+        }
+      }
+
+      untracked_.fetch_add (1, memory_order_relaxed);
+      return nullptr;
+    }
+
+    void peer_stats::
+    reset (slot& s, clock::time_point now)
+    {
+      for (atomic<uint64_t>* c : {&s.packets_in,
+                                 &s.bytes_in,
+                                 &s.packets_out,
+                                 &s.bytes_out,
+                                 &s.send_failures,
+                                 &s.lost_in,
+                                 &s.probes,
+                                 &s.replies})
+        c->store (0, memory_order_relaxed);
+
+      s.sequence.store (0, memory_order_relaxed);
+      s.rtt.store (0, memory_order_relaxed);
+      s.rtt_last.store (0, memory_order_relaxed);
+      s.last_seen.store (now.time_since_epoch ().count (),
+                         memory_order_relaxed);
+    }
+
+    void peer_stats::
+    received (const udp_endpoint& e,
+              const char* d,
+              size_t n,
+              clock::time_point now)
+    {
+      // Only update a peer we already track (see the header for why).
+      //
+      slot* s (find (key_of (e), false, now));
+
+      if (s == nullptr)
+      {
+        packets_in_.fetch_add (1, memory_order_relaxed);
+        bytes_in_.fetch_add (n, memory_order_relaxed);
+        return;
+      }
+
+      s->packets_in.fetch_add (1, memory_order_relaxed);
+      s->bytes_in.fetch_add (n, memory_order_relaxed);
+      s->last_seen.store (now.time_since_epoch ().count (),
+                          memory_order_relaxed);
+
+      if (!netchan (d, n))
+        return;
+
+      // The netchan header starts with the little-endian sequence number,
+      // with the top bit set for fragments (which share the sequence number
+      // of the message they are part of).
+      //
+      uint32_t q;
+      memcpy (&q, d, 4);
+      q &= 0x7FFFFFFF;
+
+      // Packets only come in on the frame's thread, so we don't need to
+      // worry about concurrent updates here.
+      //
+      uint32_t p (s->sequence.load (memory_order_relaxed));
+
+      if (p != 0 && q > p && q - p <= max_gap)
+        s->lost_in.fetch_add (q - p - 1, memory_order_relaxed);
+
+      if (q > p || p - q > max_gap)
+        s->sequence.store (q, memory_order_relaxed);
+    }
+
+    void peer_stats::
+    sent (const udp_endpoint& e,
+          const char* d,
+          size_t n,
+          clock::time_point now)
+    {
+      slot* s (find (key_of (e), netchan (d, n), now));
+
+      if (s == nullptr)
+      {
+        packets_out_.fetch_add (1, memory_order_relaxed);
+        bytes_out_.fetch_add (n, memory_order_relaxed);
+        return;
+      }
+
+      s->packets_out.fetch_add (1, memory_order_relaxed);
+      s->bytes_out.fetch_add (n, memory_order_relaxed);
+      s->last_seen.store (now.time_since_epoch ().count (),
+                          memory_order_relaxed);
+    }
+
+    void peer_stats::
+    send_failed (const udp_endpoint& e)
+    {
+      if (slot* s = find (key_of (e), false, clock::now ()))
+        s->send_failures.fetch_add (1, memory_order_relaxed);
+      else
+        send_failures_.fetch_add (1, memory_order_relaxed);
+    }
+
+    bool peer_stats::
+    probe_sent (const udp_endpoint& e)
+    {
+      slot* s (find (key_of (e), false, clock::now ()));
+
+      if (s == nullptr)
+        return false;
+
+      s->probes.fetch_add (1, memory_order_relaxed);
+      return true;
+    }
+
+    bool peer_stats::
+    probe_reply (const udp_endpoint& e, clock::duration d)
+    {
+      slot* s (find (key_of (e), false, clock::now ()));
+
+      if (s == nullptr)
+        return false;
+
+      // Ignore replies we didn't ask for.
+      //
+      uint64_t r (s->replies.load (memory_order_relaxed));
+
+      do
+      {
+        if (r >= s->probes.load (memory_order_relaxed))
+          return false;
+      }
+      while (!s->replies.compare_exchange_weak (r, r + 1,
+                                                memory_order_relaxed));
+
+      int64_t us (chrono::duration_cast<chrono::microseconds> (d).count ());
+      uint32_t x (static_cast<uint32_t> (
+        clamp<int64_t> (us, 1, numeric_limits<uint32_t>::max ())));
+
+      s->rtt_last.store (x, memory_order_relaxed);
+
+      // The usual smoothed RTT (RFC 6298) with a gain of 1/8.
+      //
+      uint32_t o (s->rtt.load (memory_order_relaxed));
+      uint32_t n;
+
+      do
+      {
+        n = o == 0
+            ? x
+            : static_cast<uint32_t> (int64_t (o) + (int64_t (x) - o) / 8);
+      }
+      while (!s->rtt.compare_exchange_weak (o, n, memory_order_relaxed));
+
+      return true;
+    }
+
+    vector<peer_stats_entry> peer_stats::
+    peers (clock::duration active, clock::time_point now) const
+    {
+      vector<peer_stats_entry> r;
+
+      for (const slot& s : slots_)
+      {
+        uint64_t k (s.key.load (memory_order_acquire));
+
+        if (k == 0)
+          continue;
+
+        clock::time_point t (
+          clock::duration (s.last_seen.load (memory_order_relaxed)));
+
+        if (now - t > active)
+          continue;
+
+        r.push_back (peer_stats_entry {
+          endpoint_of (k),
+          s.packets_in.load (memory_order_relaxed),
+          s.bytes_in.load (memory_order_relaxed),
+          s.packets_out.load (memory_order_relaxed),
+          s.bytes_out.load (memory_order_relaxed),
+          s.send_failures.load (memory_order_relaxed),
+          s.lost_in.load (memory_order_relaxed),
+          s.probes.load (memory_order_relaxed),
+          s.replies.load (memory_order_relaxed),
+          chrono::microseconds (s.rtt.load (memory_order_relaxed)),
+          chrono::microseconds (s.rtt_last.load (memory_order_relaxed)),
+          max (now - t, clock::duration::zero ())});
+      }
+
+      sort (r.begin (), r.end (),
+            [] (const peer_stats_entry& x, const peer_stats_entry& y)
+      {
+        return x.idle < y.idle;
+      });
+
+      return r;
+    }
+
+    peer_stats_totals peer_stats::
+    totals () const
+    {
+      return peer_stats_totals {
+        packets_in_.load (memory_order_relaxed),
+        bytes_in_.load (memory_order_relaxed),
+        packets_out_.load (memory_order_relaxed),
+        bytes_out_.load (memory_order_relaxed),
+        send_failures_.load (memory_order_relaxed),
+        untracked_.load (memory_order_relaxed)};
+    }
+
+    void peer_stats::
+    print (ostream& os, clock::time_point now) const
+    {
+      vector<peer_stats_entry> ps (peers (max_idle, now));
+
+      os << left << setw (22) << "peer" << right
+         << setw (10) << "pkts in"
+         << setw (10) << "KiB in"
+         << setw (10) << "pkts out"
+         << setw (10) << "KiB out"
+         << setw (7)  << "fail"
+         << setw (8)  << "loss %"
+         << setw (9)  << "rtt ms"
+         << setw (8)  << "probe %"
+         << '\n';
+
+      os << fixed << setprecision (1);
+
+      auto pct ([&os] (double p, int w)
+      {
+        if (p < 0)
+          os << setw (w) << '-';
+        else
+          os << setw (w) << p;
+      });
+
+      for (const peer_stats_entry& e : ps)
+      {
+        os << left << setw (22) << address (e.endpoint) << right
+           << setw (10) << e.packets_in
+           << setw (10) << e.bytes_in / 1024
+           << setw (10) << e.packets_out
+           << setw (10) << e.bytes_out / 1024
+           << setw (7)  << e.send_failures;
+
+        pct (percent (e.lost_in, e.packets_in + e.lost_in), 8);
+
+        if (e.rtt.count () == 0)
+          os << setw (9) << '-';
+        else
+          os << setw (9) << double (e.rtt.count ()) / 1000;
+
+        pct (percent (probes_lost (e), e.probes), 8);
+
+        os << '\n';
+      }
+
+      peer_stats_totals t (totals ());
+
+      os << left << setw (22) << "connectionless" << right
+         << setw (10) << t.packets_in
+         << setw (10) << t.bytes_in / 1024
+         << setw (10) << t.packets_out
+         << setw (10) << t.bytes_out / 1024
+         << setw (7)  << t.send_failures
+         << '\n';
+
+      os.unsetf (ios_base::floatfield);
+    }
+
+    void peer_stats::
+    write_json (ostream& os, clock::time_point now) const
+    {
+      vector<peer_stats_entry> ps (peers (max_idle, now));
+      peer_stats_totals t (totals ());
+
+      auto us ([] (clock::duration d)
+      {
+        return chrono::duration_cast<chrono::microseconds> (d).count ();
+      });
+
+      os << "{\n  \"peers\": [";
+
+      for (size_t i (0); i != ps.size (); ++i)
+      {
+        const peer_stats_entry& e (ps[i]);
+
+        os << (i != 0 ? "," : "") << "\n    {"
+           << "\"address\": \"" << address (e.endpoint) << "\", "
+           << "\"packets_in\": " << e.packets_in << ", "
+           << "\"bytes_in\": " << e.bytes_in << ", "
+           << "\"packets_out\": " << e.packets_out << ", "
+           << "\"bytes_out\": " << e.bytes_out << ", "
+           << "\"send_failures\": " << e.send_failures << ", "
+           << "\"lost_in\": " << e.lost_in << ", "
+           << "\"probes\": " << e.probes << ", "
+           << "\"replies\": " << e.replies << ", "
+           << "\"probes_lost\": " << probes_lost (e) << ", "
+           << "\"rtt_us\": " << e.rtt.count () << ", "
+           << "\"rtt_last_us\": " << e.rtt_last.count () << ", "
+           << "\"idle_us\": " << us (e.idle) << "}";
+      }
+
+      os << (ps.empty () ? "" : "\n  ") << "],\n"
+         << "  \"connectionless\": {"
+         << "\"packets_in\": " << t.packets_in << ", "
+         << "\"bytes_in\": " << t.bytes_in << ", "
+         << "\"packets_out\": " << t.packets_out << ", "
+         << "\"bytes_out\": " << t.bytes_out << ", "
+         << "\"send_failures\": " << t.send_failures << ", "
+         << "\"untracked\": " << t.untracked << "}\n"
+         << "}\n";
+    }
+  }
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+#include <libiw4x/net/udp-socket.hxx>
+
+namespace iw4x
+{
+  namespace net
+  {
+    // Snapshot of the traffic exchanged with a single peer.
+    //
+    struct peer_stats_entry
+    {
+      udp_endpoint endpoint;
+
+      std::uint64_t packets_in;
+      std::uint64_t bytes_in;
+      std::uint64_t packets_out;
+      std::uint64_t bytes_out;
+      std::uint64_t send_failures;
+
+      // Incoming netchan packets we never saw, going by the gaps in their
+      // sequence numbers.
+      //
+      std::uint64_t lost_in;
+
+      // RTT probes sent and answered.
+      //
+      std::uint64_t probes;
+      std::uint64_t replies;
+
+      std::chrono::microseconds rtt;      // Smoothed, 0 if not yet known.
+      std::chrono::microseconds rtt_last; // Most recent sample.
+
+      std::chrono::steady_clock::duration idle;
+    };
+
+    // Traffic with peers we don't track, that is, connectionless traffic
+    // (say, server browsers and scanners), netchan-looking traffic from
+    // anyone we have not sent netchan traffic to, as well as netchan traffic
+    // of peers we had no room for.
+    //
+    struct peer_stats_totals
+    {
+      std::uint64_t packets_in;
+      std::uint64_t bytes_in;
+      std::uint64_t packets_out;
+      std::uint64_t bytes_out;
+      std::uint64_t send_failures;
+      std::uint64_t untracked; // Netchan sends to peers we had no room for.
+    };
+
+    // Per-peer network statistics.
+    //
+    // A peer is tracked once we send it netchan (that is, connected client)
+    // traffic, which only happens after a successful handshake. Receiving is
+    // not enough: the source address of a datagram is trivial to spoof and
+    // junk that merely looks like netchan could otherwise claim every slot.
+    // From then on everything to and from the peer, including connectionless
+    // packets, is counted in its entry. Traffic with anyone else goes to the
+    // totals, which keeps a flood of queries from pushing the clients out.
+    //
+    // The counters are updated from the receive and send paths without
+    // locking: each entry is a set of atomics and a free (or long idle) slot
+    // is claimed with a compare-and-swap of its key. Reusing an idle slot may
+    // race with a late update for its previous peer, which at worst skews the
+    // new peer's numbers by a packet.
+    //
+    class peer_stats
+    {
+    public:
+      using clock = std::chrono::steady_clock;
+
+      static constexpr std::size_t capacity = 64;
+
+      // Idle time after which a peer's slot can be reused.
+      //
+      static constexpr std::chrono::seconds max_idle {60};
+
+      peer_stats () = default;
+
+      peer_stats (const peer_stats&) = delete;
+      peer_stats& operator = (const peer_stats&) = delete;
+
+      void
+      received (const udp_endpoint&,
+                const char* data,
+                std::size_t size,
+                clock::time_point = clock::now ());
+
+      void
+      sent (const udp_endpoint&,
+            const char* data,
+            std::size_t size,
+            clock::time_point = clock::now ());
+
+      void
+      send_failed (const udp_endpoint&);
+
+      // RTT probes. Return false if the peer is not tracked (so there is no
+      // point in probing it) or, for a reply, has no probes outstanding.
+      //
+      bool
+      probe_sent (const udp_endpoint&);
+
+      bool
+      probe_reply (const udp_endpoint&, clock::duration rtt);
+
+      // Peers that exchanged traffic within the specified time, most recently
+      // active first.
+      //
+      std::vector<peer_stats_entry>
+      peers (clock::duration active = max_idle,
+             clock::time_point = clock::now ()) const;
+
+      peer_stats_totals
+      totals () const;
+
+      // Human-readable table, one line per peer.
+      //
+      void
+      print (std::ostream&, clock::time_point = clock::now ()) const;
+
+      // Machine-readable dump as a JSON object.
+      //
+      void
+      write_json (std::ostream&, clock::time_point = clock::now ()) const;
+
+    private:
+      struct slot
+      {
+        std::atomic<std::uint64_t> key {0}; // 0 if free.
+
+        std::atomic<std::uint64_t> packets_in {0};
+        std::atomic<std::uint64_t> bytes_in {0};
+        std::atomic<std::uint64_t> packets_out {0};
+        std::atomic<std::uint64_t> bytes_out {0};
+        std::atomic<std::uint64_t> send_failures {0};
+        std::atomic<std::uint64_t> lost_in {0};
+        std::atomic<std::uint64_t> probes {0};
+        std::atomic<std::uint64_t> replies {0};
+
+        std::atomic<std::uint32_t> sequence {0}; // Last incoming sequence.
+        std::atomic<std::uint32_t> rtt {0};      // Microseconds.
+        std::atomic<std::uint32_t> rtt_last {0};
+
+        std::atomic<clock::rep> last_seen {0};
+      };
+
+      slot*
+      find (std::uint64_t key, bool create, clock::time_point);
+
+      void
+      reset (slot&, clock::time_point);
+
+      std::array<slot, capacity> slots_;
+
+      std::atomic<std::uint64_t> packets_in_ {0};
+      std::atomic<std::uint64_t> bytes_in_ {0};
+      std::atomic<std::uint64_t> packets_out_ {0};
+      std::atomic<std::uint64_t> bytes_out_ {0};
+      std::atomic<std::uint64_t> send_failures_ {0};
+      std::atomic<std::uint64_t> untracked_ {0};
+    };
+  }
+}
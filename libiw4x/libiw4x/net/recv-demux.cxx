@@ -0,0 +1,155 @@
+#include <libiw4x/net/recv-demux.hxx>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace net
+  {
+    recv_demux::
+    recv_demux (size_t g, size_t s)
+    {
+      game_.slots.resize (g);
+      stun_.slots.resize (s);
+    }
+
+    datagram_class recv_demux::
+    classify (const char* d, size_t n)
+    {
+      // STUN messages have the top two bits of the first byte clear (RFC
+      // 5389). Everything else (connectionless 0xFF... and netchan) is for
+      // the engine, as is an empty datagram.
+      //
+      return n != 0 && (static_cast<unsigned char> (d[0]) & 0xC0) == 0
+             ? datagram_class::stun
+             : datagram_class::game;
+    }
+
+    void recv_demux::
+    drain (udp_socket& s)
+    {
+      // Bound the number of attempts so that a socket that keeps failing
+      // (which on Windows includes every ICMP port unreachable we get back)
+      // cannot keep us here.
+      //
+      size_t n (game_.slots.size () + stun_.slots.size ());
+
+      for (size_t i (0); i != n && !game_.full (); ++i)
+      {
+        // Receive straight into the next game slot since that's what most
+        // datagrams are.
+        //
+        slot& g (game_.back ());
+
+        udp_receive_result r (s.receive (g.data, slot_size, g.from));
+        ++stats_.calls;
+
+        if (r.error == udp_error::would_block)
+          break;
+
+        if (r.error == udp_error::failed)
+        {
+          ++stats_.failures;
+          continue;
+        }
+
+        ++stats_.received;
+
+        // A datagram that does not fit a slot came out truncated. Nothing
+        // the engine or bdNet send comes close to the slot size so it can
+        // only be junk and we drop it rather than pass on a part of it.
+        //
+        if (r.size > slot_size)
+        {
+          ++stats_.oversized;
+          continue;
+        }
+
+        g.size = r.size;
+
+        if (classify (g.data, g.size) == datagram_class::game)
+        {
+          ++game_.tail;
+          ++stats_.game;
+          stats_.high_water = max<uint64_t> (stats_.high_water, game_.size ());
+          continue;
+        }
+
+        ++stats_.stun;
+
+        if (stun_.full ())
+        {
+          ++stats_.dropped;
+          continue;
+        }
+
+        slot& t (stun_.back ());
+        t.from = g.from;
+        t.size = g.size;
+        memcpy (t.data, g.data, g.size);
+        ++stun_.tail;
+      }
+    }
+
+    udp_receive_result recv_demux::
+    receive (udp_socket& s,
+             datagram_class c,
+             char* d,
+             size_t n,
+             udp_endpoint& from)
+    {
+      lock_guard<mutex> l (m_);
+
+      ring& r (ring_of (c));
+
+      if (r.size () == 0)
+      {
+        drain (s);
+
+        if (r.size () == 0)
+          return udp_receive_result {0, udp_error::would_block};
+      }
+
+      slot& x (r.front ());
+
+      from = x.from;
+      memcpy (d, x.data, min (n, x.size));
+
+      ++r.head;
+
+      return udp_receive_result {x.size, udp_error::none};
+    }
+
+    bool recv_demux::
+    pending (udp_socket& s, datagram_class c)
+    {
+      lock_guard<mutex> l (m_);
+
+      ring& r (ring_of (c));
+
+      if (r.size () == 0)
+        drain (s);
+
+      return r.size () != 0;
+    }
+
+    void recv_demux::
+    clear ()
+    {
+      lock_guard<mutex> l (m_);
+
+      game_.head = game_.tail = 0;
+      stun_.head = stun_.tail = 0;
+    }
+
+    recv_demux_stats recv_demux::
+    stats () const
+    {
+      lock_guard<mutex> l (m_);
+      return stats_;
+    }
+  }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <libiw4x/net/udp-socket.hxx>
+
+namespace iw4x
+{
+  namespace net
+  {
+    // Who a datagram received on the shared socket is for.
+    //
+    enum class datagram_class
+    {
+      stun, // bdNet's NAT traversal and IP discovery.
+      game  // Connectionless (0xFF...) and netchan traffic for the engine.
+    };
+
+    struct recv_demux_stats
+    {
+      std::uint64_t calls;      // Receive system calls, including empty ones.
+      std::uint64_t received;   // Datagrams received.
+      std::uint64_t stun;       // Of which for bdNet.
+      std::uint64_t game;       // Of which for the engine.
+      std::uint64_t failures;   // Failed receives (say, ICMP port unreachable).
+      std::uint64_t dropped;    // STUN datagrams dropped, their ring full.
+      std::uint64_t oversized;  // Datagrams dropped, too large for a slot.
+      std::uint64_t high_water; // Most game datagrams pending at once.
+    };
+
+    // Receive demultiplexer for a socket shared by bdNet and the engine.
+    //
+    // The socket is drained with a single receive per datagram into rings of
+    // preallocated buffers, one per consumer, and each datagram is classified
+    // in user space as it arrives. The consumers then take their datagrams from
+    // the rings rather than from the socket. Before, every datagram was first
+    // peeked at by bdNet's receive and then received for real by the engine.
+    //
+    // Draining stops when the game ring is full (the remaining datagrams stay
+    // in the socket buffer until the engine catches up) and STUN datagrams
+    // that do not fit their (much smaller) ring are dropped, same as they
+    // would be by a full socket buffer. Datagrams larger than a slot are
+    // dropped as well.
+    //
+    class recv_demux
+    {
+    public:
+      // Large enough for any packet the engine sends (its limit is 1400
+      // bytes) as well as the STUN messages bdNet deals with.
+      //
+      static constexpr std::size_t slot_size = 2048;
+
+      explicit
+      recv_demux (std::size_t game_capacity = 256,
+                  std::size_t stun_capacity = 16);
+
+      recv_demux (const recv_demux&) = delete;
+      recv_demux& operator = (const recv_demux&) = delete;
+
+      static datagram_class
+      classify (const char* data, std::size_t size);
+
+      // Take the next datagram of the specified class, draining the socket
+      // first if none are pending. The result follows udp_socket::receive ():
+      // would_block if there is nothing, size larger than the buffer if the
+      // datagram was truncated.
+      //
+      udp_receive_result
+      receive (udp_socket&,
+               datagram_class,
+               char* data,
+               std::size_t size,
+               udp_endpoint& from);
+
+      // Return true if a datagram of the specified class is pending, draining
+      // the socket first if none are.
+      //
+      bool
+      pending (udp_socket&, datagram_class);
+
+      // Drop all pending datagrams, for example, because the socket changed.
+      //
+      void
+      clear ();
+
+      recv_demux_stats
+      stats () const;
+
+    private:
+      struct slot
+      {
+        udp_endpoint from;
+        std::size_t size;
+        char data[slot_size];
+      };
+
+      struct ring
+      {
+        std::vector<slot> slots;
+        std::size_t head = 0; // Next slot to take.
+        std::size_t tail = 0; // Next slot to fill.
+
+        std::size_t
+        size () const {return tail - head;}
+
+        bool
+        full () const {return size () == slots.size ();}
+
+        slot&
+        front () {return slots[head % slots.size ()];}
+
+        slot&
+        back () {return slots[tail % slots.size ()];}
+      };
+
+      ring&
+      ring_of (datagram_class c)
+      {
+        return c == datagram_class::stun ? stun_ : game_;
+      }
+
+      void
+      drain (udp_socket&);
+
+      mutable std::mutex m_;
+
+      ring game_;
+      ring stun_;
+
+      recv_demux_stats stats_ {};
+    };
+  }
+}
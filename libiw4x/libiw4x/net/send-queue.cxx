@@ -0,0 +1,164 @@
+#include <libiw4x/net/send-queue.hxx>
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+
+#include <libiw4x/logger.hxx>
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace net
+  {
+    send_queue::
+    send_queue (size_t n, size_t b, bool batch)
+      : batch_ (batch)
+    {
+      if (batch_)
+      {
+        datagrams_.reserve (n);
+        buffer_.resize (b);
+      }
+    }
+
+    bool send_queue::
+    enqueue (udp_socket& s, const udp_endpoint& e, const char* d, size_t n)
+    {
+      lock_guard<mutex> l (m_);
+
+      if (!batch_)
+      {
+        udp_datagram g {e, d, n};
+
+        ++stats_.queued;
+        send_locked (s, span<const udp_datagram> (&g, 1));
+        return true;
+      }
+
+      if (n > buffer_.size ())
+        return false;
+
+      if (datagrams_.size () == datagrams_.capacity () ||
+          buffer_.size () - used_ < n)
+      {
+        ++stats_.overflows;
+        flush_locked (s);
+      }
+
+      char* p (buffer_.data () + used_);
+      memcpy (p, d, n);
+      used_ += n;
+
+      datagrams_.push_back (udp_datagram {e, p, n});
+      ++stats_.queued;
+
+      return true;
+    }
+
+    void send_queue::
+    flush (udp_socket& s)
+    {
+      lock_guard<mutex> l (m_);
+      flush_locked (s);
+    }
+
+    void send_queue::
+    flush_locked (udp_socket& s)
+    {
+      if (datagrams_.empty ())
+        return;
+
+      send_locked (s, datagrams_);
+
+      datagrams_.clear ();
+      used_ = 0;
+    }
+
+    void send_queue::
+    send_locked (udp_socket& s, span<const udp_datagram> ds)
+    {
+      if (!s.valid ())
+      {
+        drop (ds);
+        ds = {};
+      }
+
+      while (!ds.empty ())
+      {
+        size_t n (min (ds.size (), udp_socket::max_batch));
+
+        udp_send_result r (s.send (ds.first (n)));
+
+        ++stats_.batches;
+        stats_.sent += r.sent;
+        ds = ds.subspan (r.sent);
+
+        switch (r.error)
+        {
+        case udp_error::none:
+          break;
+
+        case udp_error::failed:
+          {
+            // Skip the offending datagram and carry on with the rest.
+            //
+            if (stats_.failures++ % 1024 == 0)
+              log::warning << "failed to send datagram";
+
+            drop (ds.first (1));
+            ds = ds.subspan (1);
+            break;
+          }
+
+        case udp_error::would_block:
+          {
+            if (stats_.would_block++ % 1024 == 0)
+              log::warning << "socket send buffer full, dropping "
+                           << ds.size () << " datagrams";
+
+            drop (ds);
+            ds = {};
+            break;
+          }
+        }
+      }
+    }
+
+    void send_queue::
+    drop (span<const udp_datagram> ds)
+    {
+      stats_.dropped += ds.size ();
+
+      if (drop_ != nullptr)
+      {
+        for (const udp_datagram& d : ds)
+          drop_ (d);
+      }
+    }
+
+    void send_queue::
+    clear ()
+    {
+      lock_guard<mutex> l (m_);
+
+      datagrams_.clear ();
+      used_ = 0;
+    }
+
+    size_t send_queue::
+    size () const
+    {
+      lock_guard<mutex> l (m_);
+      return datagrams_.size ();
+    }
+
+    send_queue_stats send_queue::
+    stats () const
+    {
+      lock_guard<mutex> l (m_);
+      return stats_;
+    }
+  }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include <libiw4x/net/udp-socket.hxx>
+
+namespace iw4x
+{
+  namespace net
+  {
+    struct send_queue_stats
+    {
+      std::uint64_t queued;      // Datagrams accepted by enqueue ().
+      std::uint64_t sent;        // Datagrams handed to the system.
+      std::uint64_t batches;     // Calls to udp_socket::send ().
+      std::uint64_t failures;    // Datagrams the system refused.
+      std::uint64_t would_block; // Flushes cut short by a full socket buffer.
+      std::uint64_t dropped;     // Datagrams dropped because of either.
+      std::uint64_t overflows;   // Flushes forced by a full queue.
+    };
+
+    // Outgoing datagram queue.
+    //
+    // Instead of a system call per packet, the packets sent during a frame
+    // are collected (copied into a preallocated buffer) and sent in one batch
+    // by flush () at the end of it. A full server sends a snapshot to every
+    // client each frame so this turns a couple dozen sendto () calls into one
+    // sendmmsg () where available.
+    //
+    // The price is latency: a datagram waits for the next flush, which is up
+    // to a frame (and a whole one for those queued after the flush, say, by
+    // a task that runs later in the same frame). Where the socket has no
+    // batch send (see udp_socket::batch_send) that buys nothing so by
+    // default the queue is bypassed and enqueue () sends right away.
+    //
+    // If the queue fills up before the end of the frame, it is flushed early.
+    // If a datagram fails, it is counted and skipped. If the socket buffer is
+    // full, the rest of the batch is dropped: by the next frame the engine
+    // will have something newer to send anyway and holding on to stale
+    // snapshots would only add latency. Either way the datagram is gone, the
+    // same as with a lossy network.
+    //
+    class send_queue
+    {
+    public:
+      // The defaults comfortably hold a frame of a full server (18 clients,
+      // each snapshot well under the 1400-byte packet limit) plus whatever
+      // connectionless traffic comes with it.
+      //
+      explicit
+      send_queue (std::size_t max_datagrams = 256,
+                  std::size_t max_bytes = 256 * 1024,
+                  bool batch = udp_socket::batch_send);
+
+      send_queue (const send_queue&) = delete;
+      send_queue& operator = (const send_queue&) = delete;
+
+      // Queue a datagram, flushing to the socket first if there is no room
+      // for it, or send it right away if not batching. Return false if the
+      // datagram is too large for the queue.
+      //
+      bool
+      enqueue (udp_socket&, const udp_endpoint&, const char* data, std::size_t);
+
+      // Send everything queued so far.
+      //
+      void
+      flush (udp_socket&);
+
+      // Drop everything queued so far, for example, because the socket went
+      // away.
+      //
+      void
+      clear ();
+
+      std::size_t
+      size () const;
+
+      // Call the specified function for every datagram flush () drops. Note
+      // that it is called with the queue locked.
+      //
+      using drop_handler = void (*) (const udp_datagram&);
+
+      void
+      on_drop (drop_handler h) {drop_ = h;}
+
+      send_queue_stats
+      stats () const;
+
+    private:
+      void
+      flush_locked (udp_socket&);
+
+      void
+      send_locked (udp_socket&, std::span<const udp_datagram>);
+
+      void
+      drop (std::span<const udp_datagram>);
+
+      const bool batch_;
+
+      mutable std::mutex m_;
+
+      std::vector<udp_datagram> datagrams_;
+      std::vector<char> buffer_;
+      std::size_t used_ = 0;
+
+      send_queue_stats stats_ {};
+      drop_handler drop_ = nullptr;
+    };
+  }
+}
@@ -0,0 +1,437 @@
+// Tests for send_queue over the POSIX udp_socket.
+//
+// The datagrams go over real sockets on the loopback interface. To exercise
+// the paths a healthy loopback never takes (short counts and a full socket
+// buffer), sendmmsg () is interposed below and can be told to accept fewer
+// datagrams than asked or to fail a particular call. A datagram to port 0 is
+// refused by the kernel itself, which gives us a genuine failure.
+//
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <libiw4x/net/send-queue.hxx>
+#include <libiw4x/net/udp-socket.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace iw4x::net;
+
+namespace
+{
+  struct
+  {
+    size_t calls = 0;     // Calls to sendmmsg () so far.
+    size_t cap = 0;       // Accept at most this many per call (0 for all).
+    size_t fail_call = 0; // Fail this call (1-based, 0 for none) ...
+    int fail_errno = 0;   // ... with this error.
+  } fault;
+
+  vector<size_t> dropped; // Sizes of datagrams passed to the drop handler.
+
+  void
+  reset ()
+  {
+    fault = {};
+    dropped.clear ();
+  }
+
+  void
+  on_drop (const udp_datagram& d)
+  {
+    dropped.push_back (d.size);
+  }
+
+  int
+  open_socket ()
+  {
+    int s (socket (AF_INET, SOCK_DGRAM, 0));
+    assert (s != -1);
+
+    sockaddr_in a {};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+    assert (bind (s, reinterpret_cast<sockaddr*> (&a), sizeof (a)) == 0);
+    assert (fcntl (s, F_SETFL, fcntl (s, F_GETFL) | O_NONBLOCK) == 0);
+
+    return s;
+  }
+
+  udp_endpoint
+  local_endpoint (int s)
+  {
+    sockaddr_in a {};
+    socklen_t n (sizeof (a));
+    assert (getsockname (s, reinterpret_cast<sockaddr*> (&a), &n) == 0);
+
+    udp_endpoint e {};
+    memcpy (e.address, &a.sin_addr, 4);
+    e.port = a.sin_port;
+    return e;
+  }
+
+  // Everything waiting on the socket, in order. Loopback delivery happens
+  // during the send so there is no need to wait.
+  //
+  vector<string>
+  receive_all (int s)
+  {
+    vector<string> r;
+    vector<char> b (65536); // Largest UDP datagram.
+    udp_socket u (static_cast<udp_socket::native_handle_type> (s));
+
+    for (;;)
+    {
+      udp_endpoint f;
+      udp_receive_result x (u.receive (b.data (), b.size (), f));
+
+      if (x.error != udp_error::none)
+        break;
+
+      assert (x.size <= b.size ());
+      r.emplace_back (b.data (), x.size);
+    }
+
+    return r;
+  }
+
+  struct fixture
+  {
+    int tx;
+    int rx;
+    udp_socket socket;
+    udp_endpoint to;
+    vector<string> payloads;
+
+    explicit
+    fixture (size_t n)
+      : tx (open_socket ()),
+        rx (open_socket ()),
+        socket (static_cast<udp_socket::native_handle_type> (tx)),
+        to (local_endpoint (rx))
+    {
+      for (size_t i (0); i != n; ++i)
+        payloads.push_back ("datagram " + to_string (i));
+
+      reset ();
+    }
+
+    ~fixture ()
+    {
+      close (tx);
+      close (rx);
+    }
+
+    void
+    enqueue (send_queue& q, size_t i, const udp_endpoint& e)
+    {
+      assert (q.enqueue (socket, e, payloads[i].data (), payloads[i].size ()));
+    }
+
+    void
+    enqueue_all (send_queue& q)
+    {
+      for (size_t i (0); i != payloads.size (); ++i)
+        enqueue (q, i, to);
+    }
+
+    // Payloads except those at the specified indexes.
+    //
+    vector<string>
+    expected (const vector<size_t>& except = {}) const
+    {
+      vector<string> r;
+
+      for (size_t i (0); i != payloads.size (); ++i)
+      {
+        bool x (false);
+        for (size_t j : except)
+          x = x || i == j;
+
+        if (!x)
+          r.push_back (payloads[i]);
+      }
+
+      return r;
+    }
+  };
+
+  // Nothing goes out until the flush, which then sends everything in as few
+  // calls as the batch limit allows.
+  //
+  void
+  test_batch ()
+  {
+    const size_t n (udp_socket::max_batch + 10);
+
+    fixture f (n);
+    send_queue q (256, 256 * 1024, true);
+
+    f.enqueue_all (q);
+
+    assert (q.size () == n);
+    assert (receive_all (f.rx).empty ());
+    assert (fault.calls == 0);
+
+    q.flush (f.socket);
+
+    assert (q.size () == 0);
+    assert (receive_all (f.rx) == f.expected ());
+    assert (fault.calls == 2);
+
+    send_queue_stats s (q.stats ());
+    assert (s.queued == n && s.sent == n && s.dropped == 0);
+    assert (s.batches == 2);
+
+    // Flushing an empty queue is a no-op.
+    //
+    q.flush (f.socket);
+    assert (fault.calls == 2);
+  }
+
+  // The system accepting only part of a batch is not an error: the rest is
+  // sent with further calls.
+  //
+  void
+  test_partial ()
+  {
+    fixture f (10);
+    send_queue q (256, 256 * 1024, true);
+
+    fault.cap = 3;
+
+    f.enqueue_all (q);
+    q.flush (f.socket);
+
+    assert (receive_all (f.rx) == f.expected ());
+    assert (fault.calls == 4);
+
+    send_queue_stats s (q.stats ());
+    assert (s.sent == 10 && s.dropped == 0 && s.failures == 0);
+  }
+
+  // A full socket buffer drops the rest of the batch.
+  //
+  void
+  test_would_block ()
+  {
+    fixture f (10);
+    send_queue q (256, 256 * 1024, true);
+    q.on_drop (&on_drop);
+
+    fault.cap = 4;
+    fault.fail_call = 2;
+    fault.fail_errno = EAGAIN;
+
+    f.enqueue_all (q);
+    q.flush (f.socket);
+
+    assert (receive_all (f.rx) == f.expected ({4, 5, 6, 7, 8, 9}));
+    assert (fault.calls == 2);
+    assert (q.size () == 0);
+
+    send_queue_stats s (q.stats ());
+    assert (s.sent == 4 && s.would_block == 1 && s.dropped == 6);
+    assert (s.failures == 0);
+
+    assert (dropped.size () == 6);
+    for (size_t i (0); i != 6; ++i)
+      assert (dropped[i] == f.payloads[4 + i].size ());
+
+    // ENOBUFS is treated the same way.
+    //
+    reset ();
+    fault.fail_call = 1;
+    fault.fail_errno = ENOBUFS;
+
+    f.enqueue_all (q);
+    q.flush (f.socket);
+
+    assert (receive_all (f.rx).empty ());
+    assert (q.stats ().would_block == 2 && dropped.size () == 10);
+  }
+
+  // A datagram the system refuses is skipped and the rest still go out.
+  //
+  void
+  test_failure ()
+  {
+    fixture f (10);
+    send_queue q (256, 256 * 1024, true);
+    q.on_drop (&on_drop);
+
+    udp_endpoint bad (f.to);
+    bad.port = 0;
+
+    for (size_t i (0); i != 10; ++i)
+      f.enqueue (q, i, i == 3 || i == 9 ? bad : f.to);
+
+    q.flush (f.socket);
+
+    assert (receive_all (f.rx) == f.expected ({3, 9}));
+
+    send_queue_stats s (q.stats ());
+    assert (s.sent == 8 && s.failures == 2 && s.dropped == 2);
+    assert (s.would_block == 0);
+    assert (dropped.size () == 2);
+
+    // An injected hard error on the first call of a batch.
+    //
+    reset ();
+    fault.fail_call = 1;
+    fault.fail_errno = EHOSTUNREACH;
+
+    f.enqueue_all (q);
+    q.flush (f.socket);
+
+    assert (receive_all (f.rx) == f.expected ({0}));
+    assert (q.stats ().failures == 3);
+  }
+
+  // Without a socket everything queued is dropped.
+  //
+  void
+  test_invalid_socket ()
+  {
+    fixture f (5);
+    send_queue q (256, 256 * 1024, true);
+    q.on_drop (&on_drop);
+
+    f.enqueue_all (q);
+
+    udp_socket none;
+    q.flush (none);
+
+    assert (fault.calls == 0);
+    assert (q.size () == 0);
+    assert (dropped.size () == 5);
+    assert (q.stats ().dropped == 5 && q.stats ().sent == 0);
+
+    q.flush (f.socket);
+    assert (receive_all (f.rx).empty ());
+  }
+
+  // Running out of room flushes early, a datagram that could never fit is
+  // refused, and clear () discards without sending.
+  //
+  void
+  test_limits ()
+  {
+    fixture f (10);
+    send_queue q (4, 64, true);
+
+    f.enqueue_all (q);
+
+    // Two early flushes of four datagrams each.
+    //
+    assert (q.size () == 2);
+    assert (receive_all (f.rx).size () == 8);
+    assert (q.stats ().overflows == 2);
+
+    q.flush (f.socket);
+    assert (receive_all (f.rx).size () == 2);
+
+    // The byte limit also triggers a flush.
+    //
+    string b (40, 'x');
+    assert (q.enqueue (f.socket, f.to, b.data (), b.size ()));
+    assert (q.enqueue (f.socket, f.to, b.data (), b.size ()));
+    assert (q.size () == 1);
+    assert (q.stats ().overflows == 3);
+
+    string h (65, 'x');
+    assert (!q.enqueue (f.socket, f.to, h.data (), h.size ()));
+    assert (q.size () == 1);
+
+    q.clear ();
+    assert (q.size () == 0);
+
+    q.flush (f.socket);
+
+    vector<string> r (receive_all (f.rx));
+    assert (r.size () == 1 && r[0] == b);
+    assert (q.stats ().queued == 12 && q.stats ().sent == 11);
+  }
+
+  // Without batching, enqueue () sends right away and nothing is held.
+  //
+  void
+  test_direct ()
+  {
+    fixture f (5);
+    send_queue q (256, 256 * 1024, false);
+    q.on_drop (&on_drop);
+
+    for (size_t i (0); i != 5; ++i)
+    {
+      f.enqueue (q, i, f.to);
+
+      assert (q.size () == 0);
+      assert (fault.calls == i + 1);
+
+      vector<string> r (receive_all (f.rx));
+      assert (r.size () == 1 && r[0] == f.payloads[i]);
+    }
+
+    // There is no queue to run out of.
+    //
+    string h (8 * 1024, 'x');
+    assert (q.enqueue (f.socket, f.to, h.data (), h.size ()));
+    assert (receive_all (f.rx).size () == 1);
+
+    udp_endpoint bad (f.to);
+    bad.port = 0;
+    f.enqueue (q, 0, bad);
+
+    send_queue_stats s (q.stats ());
+    assert (s.queued == 7 && s.sent == 6);
+    assert (s.failures == 1 && s.dropped == 1 && dropped.size () == 1);
+
+    q.flush (f.socket);
+    assert (fault.calls == 7);
+  }
+}
+
+// Interpose the C library's sendmmsg () (which udp_socket calls) to count
+// the calls and inject faults.
+//
+extern "C" int
+sendmmsg (int fd, mmsghdr* ms, unsigned int n, int flags)
+{
+  size_t c (++fault.calls);
+
+  if (c == fault.fail_call)
+  {
+    errno = fault.fail_errno;
+    return -1;
+  }
+
+  if (fault.cap != 0 && n > fault.cap)
+    n = static_cast<unsigned int> (fault.cap);
+
+  return static_cast<int> (syscall (SYS_sendmmsg, fd, ms, n, flags));
+}
+
+int
+main ()
+{
+  test_batch ();
+  test_partial ();
+  test_would_block ();
+  test_failure ();
+  test_invalid_socket ();
+  test_limits ();
+  test_direct ();
+}
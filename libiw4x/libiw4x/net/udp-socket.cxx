@@ -0,0 +1,217 @@
+#include <libiw4x/net/udp-socket.hxx>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#else
+#  include <cerrno>
+#  include <netinet/in.h>
+#  include <sys/socket.h>
+#  include <sys/uio.h>
+#endif
+
+using namespace std;
+
+namespace iw4x
+{
+  namespace net
+  {
+    namespace
+    {
+      sockaddr_in
+      address (const udp_endpoint& e)
+      {
+        sockaddr_in a {};
+        a.sin_family = AF_INET;
+        memcpy (&a.sin_addr, e.address, 4);
+        a.sin_port = e.port;
+        return a;
+      }
+
+      udp_endpoint
+      endpoint (const sockaddr_in& a)
+      {
+        udp_endpoint e {};
+        memcpy (e.address, &a.sin_addr, 4);
+        e.port = a.sin_port;
+        return e;
+      }
+
+#ifdef _WIN32
+      udp_error
+      last_error ()
+      {
+        return WSAGetLastError () == WSAEWOULDBLOCK
+               ? udp_error::would_block
+               : udp_error::failed;
+      }
+#else
+      udp_error
+      last_error ()
+      {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS
+               ? udp_error::would_block
+               : udp_error::failed;
+      }
+#endif
+    }
+
+#ifdef _WIN32
+    udp_send_result udp_socket::
+    send (span<const udp_datagram> ds)
+    {
+      SOCKET s (static_cast<SOCKET> (handle_));
+
+      for (size_t i (0); i != ds.size (); ++i)
+      {
+        const udp_datagram& d (ds[i]);
+        sockaddr_in a (address (d.to));
+
+        int r (sendto (s,
+                       d.data,
+                       static_cast<int> (d.size),
+                       0,
+                       reinterpret_cast<const sockaddr*> (&a),
+                       sizeof (a)));
+
+        if (r == SOCKET_ERROR)
+          return udp_send_result {i, last_error ()};
+      }
+
+      return udp_send_result {ds.size (), udp_error::none};
+    }
+
+    udp_receive_result udp_socket::
+    receive (char* d, size_t n, udp_endpoint& from)
+    {
+      sockaddr_in a {};
+      int al (sizeof (a));
+
+      int r (recvfrom (static_cast<SOCKET> (handle_),
+                       d,
+                       static_cast<int> (n),
+                       0,
+                       reinterpret_cast<sockaddr*> (&a),
+                       &al));
+
+      if (r == SOCKET_ERROR)
+      {
+        // Winsock fills the buffer and reports the rest as lost.
+        //
+        if (WSAGetLastError () == WSAEMSGSIZE)
+        {
+          from = endpoint (a);
+          return udp_receive_result {n + 1, udp_error::none};
+        }
+
+        return udp_receive_result {0, last_error ()};
+      }
+
+      from = endpoint (a);
+      return udp_receive_result {static_cast<size_t> (r), udp_error::none};
+    }
+#elif defined(__linux__)
+    udp_send_result udp_socket::
+    send (span<const udp_datagram> ds)
+    {
+      int s (static_cast<int> (handle_));
+      size_t i (0);
+
+      while (i != ds.size ())
+      {
+        size_t n (min (ds.size () - i, max_batch));
+
+        sockaddr_in as[max_batch];
+        iovec vs[max_batch];
+        mmsghdr ms[max_batch];
+
+        for (size_t j (0); j != n; ++j)
+        {
+          const udp_datagram& d (ds[i + j]);
+
+          as[j] = address (d.to);
+          vs[j].iov_base = const_cast<char*> (d.data);
+          vs[j].iov_len = d.size;
+
+          ms[j] = mmsghdr {};
+          ms[j].msg_hdr.msg_name = &as[j];
+          ms[j].msg_hdr.msg_namelen = sizeof (as[j]);
+          ms[j].msg_hdr.msg_iov = &vs[j];
+          ms[j].msg_hdr.msg_iovlen = 1;
+        }
+
+        int r (sendmmsg (s, ms, static_cast<unsigned int> (n), 0));
+
+        // Note that a failure past the first datagram is reported as a short
+        // count and the error only comes up on the next call, which is the
+        // one that starts with the failed datagram.
+        //
+        if (r < 0)
+          return udp_send_result {i, last_error ()};
+
+        if (r == 0)
+          return udp_send_result {i, udp_error::would_block};
+
+        i += static_cast<size_t> (r);
+      }
+
+      return udp_send_result {i, udp_error::none};
+    }
+#else
+    udp_send_result udp_socket::
+    send (span<const udp_datagram> ds)
+    {
+      int s (static_cast<int> (handle_));
+
+      for (size_t i (0); i != ds.size (); ++i)
+      {
+        const udp_datagram& d (ds[i]);
+        sockaddr_in a (address (d.to));
+
+        if (sendto (s,
+                    d.data,
+                    d.size,
+                    0,
+                    reinterpret_cast<const sockaddr*> (&a),
+                    sizeof (a)) < 0)
+          return udp_send_result {i, last_error ()};
+      }
+
+      return udp_send_result {ds.size (), udp_error::none};
+    }
+#endif
+
+#ifndef _WIN32
+    udp_receive_result udp_socket::
+    receive (char* d, size_t n, udp_endpoint& from)
+    {
+      sockaddr_in a {};
+      socklen_t al (sizeof (a));
+
+#ifdef __linux__
+      // With MSG_TRUNC Linux returns the real size of a truncated datagram.
+      //
+      const int f (MSG_TRUNC);
+#else
+      const int f (0);
+#endif
+
+      ssize_t r (recvfrom (static_cast<int> (handle_),
+                           d,
+                           n,
+                           f,
+                           reinterpret_cast<sockaddr*> (&a),
+                           &al));
+
+      if (r < 0)
+        return udp_receive_result {0, last_error ()};
+
+      from = endpoint (a);
+      return udp_receive_result {static_cast<size_t> (r), udp_error::none};
+    }
+#endif
+  }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace iw4x
+{
+  namespace net
+  {
+    // IPv4 endpoint. Both the address and the port are in network order, the
+    // same as in the engine's network_address and sockaddr_in.
+    //
+    struct udp_endpoint
+    {
+      std::uint8_t address[4];
+      std::uint16_t port;
+    };
+
+    struct udp_datagram
+    {
+      udp_endpoint to;
+      const char* data;
+      std::size_t size;
+    };
+
+    enum class udp_error
+    {
+      none,
+      would_block, // Socket buffer is full.
+      failed       // Anything else, say, host unreachable.
+    };
+
+    struct udp_send_result
+    {
+      std::size_t sent;  // Number of leading datagrams sent.
+      udp_error error;   // Why the next one was not, if any.
+    };
+
+    struct udp_receive_result
+    {
+      std::size_t size;  // Size of the datagram, which may exceed the buffer.
+      udp_error error;   // would_block if there was nothing to receive.
+    };
+
+    // Thin UDP socket abstraction.
+    //
+    // This exists so that the code built on top of it (such as the send
+    // queue) does not have to know about Winsock and can be exercised on
+    // POSIX systems. The socket is not owned: we normally use the one we
+    // adopted from bdNet (see mod-network.cxx), so closing it is up to whoever
+    // created it.
+    //
+    // Sending a batch uses sendmmsg () where available (Linux), that is, a
+    // single system call for the whole batch. Winsock has no equivalent for
+    // multiple destinations so there we fall back to sendto () for each
+    // datagram (and batch_send is false so that callers don't bother
+    // batching).
+    //
+    class udp_socket
+    {
+    public:
+      // Wide enough for both SOCKET (UINT_PTR) and a POSIX descriptor.
+      //
+      using native_handle_type = std::uintptr_t;
+
+      static constexpr native_handle_type invalid_handle =
+        ~native_handle_type (0);
+
+      udp_socket () = default;
+
+      explicit
+      udp_socket (native_handle_type h): handle_ (h) {}
+
+      native_handle_type
+      native_handle () const {return handle_;}
+
+      void
+      native_handle (native_handle_type h) {handle_ = h;}
+
+      bool
+      valid () const {return handle_ != invalid_handle && handle_ != 0;}
+
+      // Send as many leading datagrams as possible, stopping at the first one
+      // that could not be sent.
+      //
+      udp_send_result
+      send (std::span<const udp_datagram>);
+
+      // Receive a single datagram without blocking (the socket is expected
+      // to be in the non-blocking mode). If the datagram does not fit, it is
+      // truncated and the returned size is larger than the buffer where the
+      // platform lets us find out (on others the datagram is simply lost).
+      //
+      udp_receive_result
+      receive (char* data, std::size_t size, udp_endpoint& from);
+
+      // Largest batch send () passes to the system in one go.
+      //
+      static constexpr std::size_t max_batch = 64;
+
+      // Whether send () makes a single system call for a batch, that is,
+      // whether there is anything to gain from batching.
+      //
+#ifdef __linux__
+      static constexpr bool batch_send = true;
+#else
+      static constexpr bool batch_send = false;
+#endif
+
+    private:
+      native_handle_type handle_ = invalid_handle;
+    };
+  }
+}
@@ -0,0 +1,97 @@
+#include <libiw4x/record-file.hxx>
+
+#include <cstring>
+
+using namespace std;
+
+namespace iw4x
+{
+  // record_file_writer
+  //
+
+  bool record_file_writer::
+  open (const filesystem::path& p, const magic_type& m, uint32_t v)
+  {
+    lock_guard<mutex> l (m_);
+
+    os_.open (p, ios::binary | ios::trunc);
+
+    if (!os_.is_open ())
+      return false;
+
+    char b[4];
+    store_le (b, v);
+
+    os_.write (m, sizeof (m));
+    os_.write (b, sizeof (b));
+    os_.flush ();
+
+    return os_.good ();
+  }
+
+  void record_file_writer::
+  append ()
+  {
+    os_.write (buf_.data (), static_cast<streamsize> (buf_.size ()));
+
+    if (++unflushed_ >= flush_interval_)
+    {
+      os_.flush ();
+      unflushed_ = 0;
+    }
+  }
+
+  // record_file_reader
+  //
+
+  bool record_file_reader::
+  open (const filesystem::path& p, const magic_type& m, uint32_t v)
+  {
+    is_.open (p, ios::binary);
+
+    if (!is_.is_open ())
+      return false;
+
+    char h[sizeof (m)];
+    char b[4];
+
+    if (!is_.read (h, sizeof (h))          ||
+        !is_.read (b, sizeof (b))          ||
+        memcmp (h, m, sizeof (m)) != 0     ||
+        load_le<uint32_t> (b) != v)
+    {
+      error_ = true;
+      return false;
+    }
+
+    return true;
+  }
+
+  bool record_file_reader::
+  read_header (void* d, size_t n)
+  {
+    if (!is_.read (static_cast<char*> (d), static_cast<streamsize> (n)))
+    {
+      // Running out of data right at a record boundary is the normal end of
+      // the file.
+      //
+      error_ = is_.gcount () != 0;
+      return false;
+    }
+
+    return true;
+  }
+
+  bool record_file_reader::
+  read (void* d, size_t n)
+  {
+    if (n != 0 &&
+        !is_.read (static_cast<char*> (d), static_cast<streamsize> (n)))
+    {
+      error_ = true;
+      return false;
+    }
+
+    return true;
+  }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace iw4x
+{
+  // Little-endian integers in byte buffers.
+  //
+  template <std::unsigned_integral T>
+  inline void
+  store_le (void* p, T v)
+  {
+    unsigned char* b (static_cast<unsigned char*> (p));
+
+    for (std::size_t i (0); i != sizeof (T); ++i)
+      b[i] = static_cast<unsigned char> (v >> (8 * i));
+  }
+
+  template <std::unsigned_integral T>
+  inline T
+  load_le (const void* p)
+  {
+    const unsigned char* b (static_cast<const unsigned char*> (p));
+    T r (0);
+
+    for (std::size_t i (0); i != sizeof (T); ++i)
+      r |= static_cast<T> (static_cast<T> (b[i]) << (8 * i));
+
+    return r;
+  }
+
+  // Record file framing shared by our capture formats (DemonWare task traces
+  // and OOB packet captures).
+  //
+  // A record file starts with an 8-byte magic and a little-endian uint32
+  // version followed by records back to back. What a record contains is up
+  // to the format: we only make sure each one goes out with a single write
+  // (so that records from different threads do not interleave) and tell a
+  // clean end of file from a truncated record on the way back.
+  //
+  class record_file_writer
+  {
+  public:
+    using magic_type = char[8];
+
+    // Flush after every so many records. The default, every record, makes
+    // sure the file survives the process going down, which is often exactly
+    // when we want it.
+    //
+    explicit
+    record_file_writer (std::size_t flush_interval = 1)
+      : flush_interval_ (flush_interval) {}
+
+    record_file_writer (const record_file_writer&) = delete;
+    record_file_writer& operator = (const record_file_writer&) = delete;
+
+    // Create (or truncate) the file and write the header.
+    //
+    bool
+    open (const std::filesystem::path&, const magic_type&, std::uint32_t);
+
+    bool
+    is_open () const {return os_.is_open ();}
+
+    // Append a record of the specified size, calling f (char*) to fill it
+    // in. Safe to call from multiple threads.
+    //
+    template <typename F>
+    void
+    write (std::size_t size, F&& f)
+    {
+      std::lock_guard<std::mutex> l (m_);
+
+      if (!os_.is_open ())
+        return;
+
+      buf_.resize (size);
+      f (buf_.data ());
+      append ();
+    }
+
+  private:
+    void
+    append ();
+
+    std::mutex m_;
+    std::ofstream os_;
+    std::vector<char> buf_;
+    std::size_t flush_interval_;
+    std::size_t unflushed_ = 0;
+  };
+
+  class record_file_reader
+  {
+  public:
+    using magic_type = char[8];
+
+    // Open the file and verify the header.
+    //
+    bool
+    open (const std::filesystem::path&, const magic_type&, std::uint32_t);
+
+    // Read the fixed part of the next record. Return false at the end of the
+    // file, in which case error () is true if it ended mid-record.
+    //
+    bool
+    read_header (void*, std::size_t);
+
+    // Read the rest of the record. Return false (and set error ()) if it is
+    // truncated.
+    //
+    bool
+    read (void*, std::size_t);
+
+    // Mark the file as corrupt, say, because a record is malformed.
+    //
+    void
+    fail () {error_ = true;}
+
+    bool
+    error () const {return error_;}
+
+  private:
+    std::ifstream is_;
+    bool error_ = false;
+  };
+}
@@ -0,0 +1,369 @@
+// Replay a connectionless packet capture through the OOB pipeline.
+//
+// usage: oob-replay [--iterations <n>] [--realtime] [--frame <ms>]
+//                   [--batch <n>] [--no-rate-limit] <capture>
+//
+// Every packet in the capture (see IW4X_OOB_CAPTURE) is turned back into the
+// network_address and message the engine would hand to oob_dispatch () and
+// pushed through oob_pipeline::process (). The pipeline is ticked the way the
+// frame would: every --frame milliseconds of recorded time with --realtime
+// (which also paces the packets as they were recorded) and every --batch
+// packets otherwise, that is, at maximum speed.
+//
+// At the end we print the packet rate and the per-stage latencies, which makes
+// this a benchmark for the command lookup, the envelope parser, the queue, and
+// the message parser and dispatcher. Note that the rate limiter is in effect
+// by default, which at maximum speed means most packets from a busy source are
+// dropped early. Use --no-rate-limit to measure the full path.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <libiw4x/mod/oob/oob-capture.hxx>
+#include <libiw4x/mod/oob/oob-commands.hxx>
+#include <libiw4x/mod/oob/oob-dispatcher.hxx>
+#include <libiw4x/mod/oob/oob-envelope.hxx>
+#include <libiw4x/mod/oob/oob-pipeline.hxx>
+#include <libiw4x/mod/oob/oob-rate-limit.hxx>
+
+using namespace std;
+using namespace std::chrono;
+
+using namespace iw4x;
+using namespace iw4x::mod::oob;
+
+namespace
+{
+  // Latency samples of a stage, in nanoseconds.
+  //
+  struct stage
+  {
+    const char* name;
+    vector<uint64_t> samples;
+
+    void
+    add (steady_clock::duration d)
+    {
+      samples.push_back (
+        static_cast<uint64_t> (duration_cast<nanoseconds> (d).count ()));
+    }
+
+    void
+    print ()
+    {
+      cout << setw (10) << name;
+
+      if (samples.empty ())
+      {
+        cout << setw (12) << "-" << endl;
+        return;
+      }
+
+      auto pct ([this] (size_t p)
+      {
+        size_t i ((samples.size () - 1) * p / 100);
+        nth_element (samples.begin (), samples.begin () + i, samples.end ());
+        return samples[i];
+      });
+
+      uint64_t sum (0);
+      for (uint64_t s : samples)
+        sum += s;
+
+      cout << setw (12) << samples.size ()
+           << setw (10) << sum / samples.size ()
+           << setw (10) << pct (50)
+           << setw (10) << pct (99)
+           << setw (10) << *max_element (samples.begin (), samples.end ())
+           << endl;
+    }
+  };
+
+  int
+  usage ()
+  {
+    cerr << "usage: oob-replay [--iterations <n>] [--realtime] [--frame <ms>]"
+         << endl
+         << "                  [--batch <n>] [--no-rate-limit] <capture>"
+         << endl;
+    return 1;
+  }
+
+  bool
+  parse_uint (const char* s, uint64_t& r)
+  {
+    char* e (nullptr);
+    errno = 0;
+    r = strtoull (s, &e, 10);
+    return errno == 0 && e != s && *e == '\0';
+  }
+}
+
+int
+main (int argc, char* argv[])
+{
+  uint64_t iterations (1);
+  uint64_t frame_ms (16);
+  uint64_t batch (256);
+  bool realtime (false);
+  bool limit (true);
+  const char* file (nullptr);
+
+  for (int i (1); i != argc; ++i)
+  {
+    const char* a (argv[i]);
+
+    if (strcmp (a, "--iterations") == 0 && i + 1 != argc)
+    {
+      if (!parse_uint (argv[++i], iterations) || iterations == 0)
+        return usage ();
+    }
+    else if (strcmp (a, "--frame") == 0 && i + 1 != argc)
+    {
+      if (!parse_uint (argv[++i], frame_ms) || frame_ms == 0)
+        return usage ();
+    }
+    else if (strcmp (a, "--batch") == 0 && i + 1 != argc)
+    {
+      // More than the queue holds would just measure drops.
+      //
+      if (!parse_uint (argv[++i], batch) ||
+          batch == 0                     ||
+          batch > oob_pipeline::queue_capacity)
+        return usage ();
+    }
+    else if (strcmp (a, "--realtime") == 0)
+      realtime = true;
+    else if (strcmp (a, "--no-rate-limit") == 0)
+      limit = false;
+    else if (a[0] != '-' && file == nullptr)
+      file = a;
+    else
+      return usage ();
+  }
+
+  if (file == nullptr)
+    return usage ();
+
+  // Load the whole capture up front so that the file I/O does not skew the
+  // timings.
+  //
+  vector<oob_capture_record> rs;
+  {
+    oob_capture_reader r;
+
+    if (!r.open (file))
+    {
+      cerr << "error: unable to open capture " << file << endl;
+      return 1;
+    }
+
+    for (oob_capture_record c; r.read (c); )
+      rs.push_back (move (c));
+
+    if (r.error ())
+    {
+      cerr << "error: capture " << file << " is corrupt after " << rs.size ()
+           << " records" << endl;
+      return 1;
+    }
+  }
+
+  if (rs.empty ())
+  {
+    cerr << "error: capture " << file << " is empty" << endl;
+    return 1;
+  }
+
+  // The handlers only look at the arguments so that the tokenizer is part of
+  // what we measure.
+  //
+  oob_dispatcher d;
+  uint64_t args (0);
+
+  d.on_ping ([&args] (const oob_ping_message& m) {args += m.args.size ();});
+  d.on_pong ([&args] (const oob_pong_message& m) {args += m.args.size ();});
+
+  // The pipeline is too big for the stack.
+  //
+  auto p (make_unique<oob_pipeline> (d));
+
+  if (!limit)
+  {
+    for (size_t i (0); i != size_t (oob_rate_class::count); ++i)
+      p->limiter ().budget (
+        static_cast<oob_rate_class> (i),
+        oob_rate_budget {numeric_limits<uint32_t>::max () / 1000,
+                         numeric_limits<uint32_t>::max () / 1000});
+  }
+
+  stage classify {"classify", {}};
+  stage envelope {"envelope", {}};
+  stage process {"process", {}};
+  stage dispatch {"dispatch", {}};
+
+  for (stage* s : {&classify, &envelope, &process})
+    s->samples.reserve (rs.size () * iterations);
+
+  // Time spent in process () and tick (), which is what the packet rate is
+  // based on.
+  //
+  steady_clock::duration busy (0);
+
+  auto tick ([&p, &dispatch, &busy] ()
+  {
+    uint64_t b (p->stats ().dispatched + p->stats ().rejected);
+
+    auto s (steady_clock::now ());
+    p->tick ();
+    auto e (steady_clock::now () - s);
+
+    busy += e;
+
+    // Report the dispatch latency per message.
+    //
+    if (uint64_t n = p->stats ().dispatched + p->stats ().rejected - b)
+      dispatch.add (e / n);
+  });
+
+  uint64_t known (0);     // Packets with a command we recognize.
+  uint64_t ours (0);      // Packets with a command the pipeline handles.
+  uint64_t forwarded (0);
+  uint64_t rejected (0);
+
+  vector<char> buf;
+
+  for (uint64_t it (0); it != iterations; ++it)
+  {
+    auto start (steady_clock::now ());
+    uint64_t next_frame (frame_ms * 1000);
+    size_t pending (0);
+
+    for (const oob_capture_record& r : rs)
+    {
+      if (realtime)
+      {
+        // Run the frames that would have happened before this packet.
+        //
+        for (; r.time >= next_frame; next_frame += frame_ms * 1000)
+        {
+          this_thread::sleep_until (start + microseconds (next_frame));
+          tick ();
+        }
+
+        this_thread::sleep_until (start + microseconds (r.time));
+      }
+
+      // The engine's message buffer is writable and we don't want the
+      // pipeline to get away with holding on to it, so give it a copy that
+      // is scribbled over right after.
+      //
+      buf.assign (r.data.begin (), r.data.end ());
+
+      message m {};
+      m.data = buf.data ();
+      m.maximum_size = static_cast<int> (buf.size ());
+      m.current_size = static_cast<int> (buf.size ());
+
+      // Measure the lookup and envelope stages on their own. These are also
+      // part of process () below.
+      //
+      {
+        auto s (steady_clock::now ());
+        oob_command c (classify_command (command_token (buf.data (),
+                                                        buf.size ())));
+        classify.add (steady_clock::now () - s);
+
+        if (c != oob_command::unknown)
+          ++known;
+      }
+      {
+        auto s (steady_clock::now ());
+        auto e (parse_envelope (r.address, m));
+        envelope.add (steady_clock::now () - s);
+
+        if (e)
+          ++ours;
+      }
+
+      auto s (steady_clock::now ());
+      oob_disposition o (p->process (r.address, m));
+      auto e (steady_clock::now () - s);
+
+      busy += e;
+      process.add (e);
+
+      switch (o)
+      {
+      case oob_disposition::forward_to_engine: ++forwarded; break;
+      case oob_disposition::rejected:          ++rejected;  break;
+      case oob_disposition::consumed:          ++pending;   break;
+      }
+
+      fill (buf.begin (), buf.end (), '\x55');
+
+      if (!realtime && pending == batch)
+      {
+        tick ();
+        pending = 0;
+      }
+    }
+
+    tick ();
+  }
+
+  uint64_t n (rs.size () * iterations);
+  double secs (duration<double> (busy).count ());
+
+  cout << setw (10) << "stage"
+       << setw (12) << "samples"
+       << setw (10) << "avg ns"
+       << setw (10) << "p50 ns"
+       << setw (10) << "p99 ns"
+       << setw (10) << "max ns" << endl;
+
+  for (stage* s : {&classify, &envelope, &process, &dispatch})
+    s->print ();
+
+  oob_pipeline_stats ps (p->stats ());
+  oob_rate_stats ls (p->limiter ().stats ());
+
+  uint64_t limited (0);
+  for (uint64_t x : ls.dropped)
+    limited += x;
+
+  cout << endl
+       << "known commands:      " << known
+       << " (" << ours << " for the pipeline)" << endl
+       << "forwarded to engine: " << forwarded << endl
+       << "rejected:            " << rejected
+       << " (" << limited << " rate limited)" << endl
+       << "queued:              " << ps.queued
+       << " (" << ps.dropped << " dropped, queue full)" << endl
+       << "dispatched:          " << ps.dispatched
+       << " (" << ps.rejected << " malformed, " << args << " arguments)"
+       << endl
+       << "largest batch:       " << ps.high_water << endl
+       << endl;
+
+  cout << n << " packets in " << fixed << setprecision (3) << secs << "s";
+
+  if (secs > 0)
+    cout << " (" << setprecision (0) << n / secs << " packets/s)";
+
+  cout << endl;
+
+  return 0;
+}